@@ -0,0 +1,128 @@
+// alloc_count.h - Heap allocation counting for the Amarantine benchmarks
+//
+// With AMARANTH_COUNT_ALLOCATIONS defined, this header replaces the global
+// operator new and delete with versions that count calls and requested
+// bytes, so include it from exactly one translation unit of the program.
+// The CMake option of the same name defines it for the harness-based
+// benchmarks; compile_benchmark always counts. Without the macro the
+// counters stay at zero and allocationCountingEnabled() is false.
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace bench {
+
+struct AllocationCount {
+  uint64_t allocations = 0;
+  uint64_t bytes = 0;  // Requested, not including allocator overhead
+};
+
+inline std::atomic<uint64_t> g_allocations{0};
+inline std::atomic<uint64_t> g_allocatedBytes{0};
+
+constexpr bool allocationCountingEnabled() {
+#ifdef AMARANTH_COUNT_ALLOCATIONS
+  return true;
+#else
+  return false;
+#endif
+}
+
+// Totals since program start; subtract two readings to count a region
+inline AllocationCount allocationCount() {
+  AllocationCount c;
+  c.allocations = g_allocations.load(std::memory_order_relaxed);
+  c.bytes = g_allocatedBytes.load(std::memory_order_relaxed);
+  return c;
+}
+
+inline void* countedAlloc(size_t size) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  g_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+  return std::malloc(size ? size : 1);
+}
+
+inline void* countedAlignedAlloc(size_t size, std::align_val_t alignment) {
+  g_allocations.fetch_add(1, std::memory_order_relaxed);
+  g_allocatedBytes.fetch_add(size, std::memory_order_relaxed);
+  size_t align = static_cast<size_t>(alignment);
+  // aligned_alloc wants a size that is a multiple of the alignment
+  return std::aligned_alloc(align, ((size ? size : 1) + align - 1) / align * align);
+}
+
+}  // namespace bench
+
+#ifdef AMARANTH_COUNT_ALLOCATIONS
+// GCC pairs the inlined free() below with the caller's operator new
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size) {
+  if (void* p = bench::countedAlloc(size))
+    return p;
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return bench::countedAlloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return bench::countedAlloc(size);
+}
+
+void* operator new(size_t size, std::align_val_t alignment) {
+  if (void* p = bench::countedAlignedAlloc(size, alignment))
+    return p;
+  throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t alignment) {
+  return operator new(size, alignment);
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, size_t) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+void operator delete[](void* p, size_t, std::align_val_t) noexcept {
+  std::free(p);
+}
+
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#endif
@@ -0,0 +1,775 @@
+// bench_harness.h - Measurement harness shared by the Amarantine benchmarks
+//
+// Each case is a callable doing one unit of work. The harness:
+//   - warms the case up, then calibrates how many iterations make one sample
+//     last at least --min-time milliseconds
+//   - takes --samples samples and reports the median time per iteration, the
+//     median absolute deviation (MAD) and a distribution-free 95% confidence
+//     interval of the median
+//   - runs only the cases matching --filter (comma-separated substrings)
+//   - writes every result to --json=FILE
+//   - with --baseline=FILE, or standalone as --compare BASE NEW, compares
+//     medians against an earlier JSON run and flags regressions beyond noise
+//   - on Linux, counts cycles, instructions, branch misses and L1d/LLC misses
+//     with perf_event_open over the samples and reports IPC and misses per
+//     byte; events the kernel or CPU does not offer are left out
+//   - built with AMARANTH_COUNT_ALLOCATIONS, counts heap allocations and
+//     bytes of one iteration per case, and treats any increase over the
+//     baseline as a regression
+//   - with --latency, times calls one by one instead and reports p50, p99,
+//     p99.9 and max of: the first call on freshly built state (cases added
+//     with addFresh), warm calls, and calls after a sweep of a large buffer
+//     has evicted the caches
+// Exit status is 1 when a comparison found a regression, 2 on bad usage.
+#pragma once
+
+#include "amaranth/amaranth.h"
+
+#include "alloc_count.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace bench {
+
+// Keep the compiler from discarding a result it can prove unused
+template <typename T>
+inline void doNotOptimize(const T& value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "r,m"(value) : "memory");
+#else
+  static volatile const void* sink;
+  sink = &value;
+#endif
+}
+
+// ============================================================================
+// Hardware counters
+// ============================================================================
+enum Counter { CYCLES, INSTRUCTIONS, BRANCH_MISSES, L1D_MISSES, LLC_MISSES, COUNTERS };
+
+static const char* const COUNTER_NAMES[COUNTERS] = {"cycles", "instructions", "branch_misses",
+                                                    "l1d_misses", "llc_misses"};
+
+// User-space event counts of this thread through perf_event_open. Each
+// event is opened on its own, so a missing one (common in VMs and
+// containers, or with kernel.perf_event_paranoid > 2) only drops that
+// column. Counts are scaled when the kernel multiplexed the events.
+class PerfCounters {
+ public:
+  PerfCounters() {
+    for (int& fd : fds_)
+      fd = -1;
+#ifdef __linux__
+    static const uint64_t configs[COUNTERS][2] = {
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+        {PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                 (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+        {PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES}};
+    for (int c = 0; c < COUNTERS; ++c) {
+      perf_event_attr attr;
+      std::memset(&attr, 0, sizeof(attr));
+      attr.size = sizeof(attr);
+      attr.type = static_cast<uint32_t>(configs[c][0]);
+      attr.config = configs[c][1];
+      attr.disabled = 1;
+      attr.exclude_kernel = 1;
+      attr.exclude_hv = 1;
+      attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+      fds_[c] = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+      if (fds_[c] < 0 && error_.empty()) {
+        error_ = std::strerror(errno);
+        if (errno == EACCES || errno == EPERM)
+          error_ += "; lower kernel.perf_event_paranoid to 2 or less";
+      }
+    }
+#else
+    error_ = "perf_event_open is Linux only";
+#endif
+  }
+
+  ~PerfCounters() {
+#ifdef __linux__
+    for (int fd : fds_)
+      if (fd >= 0)
+        close(fd);
+#endif
+  }
+
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  bool has(Counter c) const {
+    return fds_[c] >= 0;
+  }
+
+  // Whether any event can be counted at all
+  bool available() const {
+    for (int c = 0; c < COUNTERS; ++c)
+      if (has(static_cast<Counter>(c)))
+        return true;
+    return false;
+  }
+
+  // Why the first missing event could not be opened
+  const std::string& error() const {
+    return error_;
+  }
+
+  void start() {
+#ifdef __linux__
+    for (int fd : fds_) {
+      if (fd >= 0) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+      }
+    }
+#endif
+  }
+
+  // Counts since start(); -1 for events that are not available
+  void stop(double (&counts)[COUNTERS]) {
+    for (int c = 0; c < COUNTERS; ++c) {
+      counts[c] = -1;
+#ifdef __linux__
+      if (fds_[c] < 0)
+        continue;
+      ioctl(fds_[c], PERF_EVENT_IOC_DISABLE, 0);
+      uint64_t value[3];  // count, time enabled, time running
+      if (read(fds_[c], value, sizeof(value)) != static_cast<ssize_t>(sizeof(value)) ||
+          value[2] == 0)
+        continue;
+      counts[c] = static_cast<double>(value[0]) * value[1] / value[2];
+#endif
+    }
+  }
+
+ private:
+  int fds_[COUNTERS];
+  std::string error_;
+};
+
+// ============================================================================
+// Results
+// ============================================================================
+struct Result {
+  std::string name;
+  double medianNs = 0;  // Per iteration
+  double madNs = 0;     // Median absolute deviation of the samples
+  double ciLowNs = 0;   // 95% confidence interval of the median
+  double ciHighNs = 0;
+  double minNs = 0;
+  double maxNs = 0;
+  uint64_t iterations = 0;  // Per sample
+  int samples = 0;
+  size_t bytes = 0;  // Input bytes per iteration, 0 if not meaningful
+  double counters[COUNTERS] = {-1, -1, -1, -1, -1};  // Events per iteration, -1 if not counted
+  double allocations = -1;  // Heap allocations per iteration, -1 if not counted
+  double allocatedBytes = -1;
+
+  double throughputMBs() const {
+    return bytes && medianNs > 0 ? bytes * 1e3 / medianNs : 0;
+  }
+
+  // Instructions per cycle, or -1
+  double ipc() const {
+    return counters[CYCLES] > 0 && counters[INSTRUCTIONS] >= 0
+               ? counters[INSTRUCTIONS] / counters[CYCLES]
+               : -1;
+  }
+
+  // Events of `c` per input byte (per iteration when bytes is 0), or -1
+  double perByte(Counter c) const {
+    return counters[c] < 0 ? -1 : counters[c] / (bytes ? bytes : 1);
+  }
+};
+
+struct Options {
+  std::vector<std::string> filters;
+  std::string jsonPath;
+  std::string baselinePath;
+  std::string compareBase;  // --compare BASE NEW: no benchmarks run
+  std::string compareNew;
+  int samples = 15;
+  double minTimeMs = 10;  // Per sample
+  double warmupMs = 20;
+  double threshold = 0.05;  // Smallest relative change reported as a regression
+  bool list = false;
+  bool counters = true;          // Read hardware counters when the system allows it
+  bool latency = false;          // Per-call latency distributions instead of throughput
+  int latencyCalls = 10000;      // Timed warm calls per case in --latency
+  size_t flushBytes = 64 << 20;  // Buffer swept before each cold call
+};
+
+inline double median(std::vector<double> v) {
+  if (v.empty())
+    return 0;
+  std::sort(v.begin(), v.end());
+  size_t n = v.size();
+  return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+// Fill the statistics of `r` from per-iteration sample times
+inline void summarize(Result& r, std::vector<double> samples) {
+  std::sort(samples.begin(), samples.end());
+  size_t n = samples.size();
+  r.samples = static_cast<int>(n);
+  r.medianNs = median(samples);
+  std::vector<double> deviations;
+  for (double s : samples)
+    deviations.push_back(std::fabs(s - r.medianNs));
+  r.madNs = median(deviations);
+  r.minNs = samples.front();
+  r.maxNs = samples.back();
+  // Order-statistic interval: ranks n/2 -+ 1.96 * sqrt(n) / 2
+  double half = 1.96 * std::sqrt(static_cast<double>(n)) / 2;
+  long lo = static_cast<long>(std::floor(n / 2.0 - half));
+  long hi = static_cast<long>(std::ceil(n / 2.0 + half));
+  r.ciLowNs = samples[std::max(0L, lo)];
+  r.ciHighNs = samples[std::min(static_cast<long>(n) - 1, hi)];
+}
+
+inline std::string formatNs(double ns) {
+  char buf[32];
+  if (ns < 1e3)
+    std::snprintf(buf, sizeof(buf), "%.1f ns", ns);
+  else if (ns < 1e6)
+    std::snprintf(buf, sizeof(buf), "%.2f us", ns / 1e3);
+  else if (ns < 1e9)
+    std::snprintf(buf, sizeof(buf), "%.2f ms", ns / 1e6);
+  else
+    std::snprintf(buf, sizeof(buf), "%.2f s", ns / 1e9);
+  return buf;
+}
+
+inline std::string jsonString(const std::string& s) {
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      char buf[8];
+      std::snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+inline std::string toJson(const std::vector<Result>& results) {
+  std::ostringstream out;
+  out.precision(6);
+  out << "{\n  \"benchmarks\": [";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    out << (i ? ",\n" : "\n") << "    {\"name\": " << jsonString(r.name)
+        << ", \"median_ns\": " << r.medianNs << ", \"mad_ns\": " << r.madNs
+        << ", \"ci_low_ns\": " << r.ciLowNs << ", \"ci_high_ns\": " << r.ciHighNs
+        << ", \"min_ns\": " << r.minNs << ", \"max_ns\": " << r.maxNs
+        << ", \"iterations\": " << r.iterations << ", \"samples\": " << r.samples
+        << ", \"bytes\": " << r.bytes;
+    for (int c = 0; c < COUNTERS; ++c)
+      if (r.counters[c] >= 0)
+        out << ", \"" << COUNTER_NAMES[c] << "\": " << r.counters[c];
+    if (r.allocations >= 0)
+      out << ", \"allocations\": " << r.allocations
+          << ", \"allocated_bytes\": " << r.allocatedBytes;
+    out << "}";
+  }
+  out << "\n  ]\n}\n";
+  return out.str();
+}
+
+// Reads back what toJson() wrote. Not a general JSON parser: it expects one
+// flat object per benchmark with a "name" string and numeric fields.
+inline bool fromJson(const std::string& path, std::vector<Result>& results) {
+  std::ifstream in(path);
+  if (!in)
+    return false;
+  std::stringstream buffer;
+  buffer << in.rdbuf();
+  std::string text = buffer.str();
+
+  auto number = [](const std::string& obj, const char* key) {
+    std::string needle = std::string("\"") + key + "\":";
+    size_t at = obj.find(needle);
+    return at == std::string::npos ? 0.0 : std::strtod(obj.c_str() + at + needle.size(), nullptr);
+  };
+  size_t pos = text.find("\"benchmarks\"");
+  while (pos != std::string::npos && (pos = text.find('{', pos)) != std::string::npos) {
+    size_t end = text.find('}', pos);
+    if (end == std::string::npos)
+      return false;
+    std::string obj = text.substr(pos, end - pos);
+    Result r;
+    size_t key = obj.find("\"name\":");
+    if (key == std::string::npos)
+      return false;
+    size_t q = obj.find('"', key + 7);
+    for (size_t i = q + 1; i < obj.size() && obj[i] != '"'; ++i) {
+      if (obj[i] == '\\' && i + 1 < obj.size())
+        ++i;
+      r.name += obj[i];
+    }
+    r.medianNs = number(obj, "median_ns");
+    r.madNs = number(obj, "mad_ns");
+    r.ciLowNs = number(obj, "ci_low_ns");
+    r.ciHighNs = number(obj, "ci_high_ns");
+    r.minNs = number(obj, "min_ns");
+    r.maxNs = number(obj, "max_ns");
+    r.iterations = static_cast<uint64_t>(number(obj, "iterations"));
+    r.samples = static_cast<int>(number(obj, "samples"));
+    r.bytes = static_cast<size_t>(number(obj, "bytes"));
+    for (int c = 0; c < COUNTERS; ++c)
+      if (obj.find(std::string("\"") + COUNTER_NAMES[c] + "\":") != std::string::npos)
+        r.counters[c] = number(obj, COUNTER_NAMES[c]);
+    if (obj.find("\"allocations\":") != std::string::npos) {
+      r.allocations = number(obj, "allocations");
+      r.allocatedBytes = number(obj, "allocated_bytes");
+    }
+    results.push_back(r);
+    pos = end + 1;
+  }
+  return true;
+}
+
+// Print how every benchmark in `current` moved against `base`. A change is
+// a regression (or improvement) only when the confidence intervals of the
+// two medians do not overlap and the medians differ by more than
+// `threshold`; anything else is noise. Allocation counts are exact, so when
+// both runs counted them any increase is a regression too. Returns the
+// number of regressions.
+inline int compare(const std::vector<Result>& base, const std::vector<Result>& current,
+                   double threshold) {
+  int regressions = 0;
+  std::printf("\n%-44s %12s %12s %9s\n", "benchmark", "base", "new", "change");
+  for (const Result& now : current) {
+    auto it = std::find_if(base.begin(), base.end(),
+                           [&](const Result& b) { return b.name == now.name; });
+    if (it == base.end()) {
+      std::printf("%-44s %12s %12s %9s\n", now.name.c_str(), "-", formatNs(now.medianNs).c_str(),
+                  "new");
+      continue;
+    }
+    const Result& was = *it;
+    double change = was.medianNs > 0 ? (now.medianNs - was.medianNs) / was.medianNs : 0;
+    const char* verdict = "";
+    if (change > threshold && now.ciLowNs > was.ciHighNs) {
+      verdict = "  REGRESSION";
+      ++regressions;
+    } else if (was.allocations >= 0 && now.allocations > was.allocations) {
+      verdict = "  MORE ALLOCATIONS";
+      ++regressions;
+    } else if (change < -threshold && now.ciHighNs < was.ciLowNs) {
+      verdict = "  improved";
+    }
+    std::printf("%-44s %12s %12s %+8.1f%%%s\n", now.name.c_str(), formatNs(was.medianNs).c_str(),
+                formatNs(now.medianNs).c_str(), change * 100, verdict);
+  }
+  std::printf("\n%d regression(s) beyond noise (threshold %.1f%%)\n", regressions,
+              threshold * 100);
+  return regressions;
+}
+
+class Harness {
+ public:
+  Harness(int argc, char* argv[]) {
+    for (int i = 1; i < argc; ++i) {
+      std::string arg = argv[i];
+      auto value = [&](const char* flag) -> const char* {
+        size_t len = std::strlen(flag);
+        if (arg.compare(0, len, flag) == 0 && arg.size() > len && arg[len] == '=')
+          return argv[i] + len + 1;
+        return nullptr;
+      };
+      if (const char* v = value("--filter")) {
+        std::stringstream list(v);
+        std::string item;
+        while (std::getline(list, item, ','))
+          if (!item.empty())
+            options_.filters.push_back(item);
+      } else if (const char* v = value("--json")) {
+        options_.jsonPath = v;
+      } else if (const char* v = value("--baseline")) {
+        options_.baselinePath = v;
+      } else if (const char* v = value("--samples")) {
+        options_.samples = std::max(3, std::atoi(v));
+      } else if (const char* v = value("--min-time")) {
+        options_.minTimeMs = std::max(0.1, std::atof(v));
+      } else if (const char* v = value("--threshold")) {
+        options_.threshold = std::atof(v) / 100;
+      } else if (arg == "--compare" && i + 2 < argc) {
+        options_.compareBase = argv[++i];
+        options_.compareNew = argv[++i];
+      } else if (arg == "--list") {
+        options_.list = true;
+      } else if (arg == "--no-counters") {
+        options_.counters = false;
+      } else if (arg == "--latency") {
+        options_.latency = true;
+      } else if (const char* v = value("--calls")) {
+        options_.latencyCalls = std::max(100, std::atoi(v));
+      } else if (const char* v = value("--flush-bytes")) {
+        options_.flushBytes = std::max<size_t>(1 << 20, std::strtoull(v, nullptr, 10));
+      } else if (arg == "--help" || arg == "-h") {
+        usage(argv[0]);
+        std::exit(0);
+      } else {
+        usage(argv[0]);
+        std::exit(2);
+      }
+    }
+  }
+
+  const Options& options() const {
+    return options_;
+  }
+
+  // Register `op`, one iteration of work; its return value is kept alive so
+  // the work cannot be optimized away. `bytes` is the input size per
+  // iteration, for throughput.
+  template <typename Fn>
+  void add(const std::string& name, Fn op, size_t bytes = 0) {
+    if (!selected(name))
+      return;
+    cases_.push_back({name, bytes,
+                      [op](uint64_t iterations) mutable {
+                        for (uint64_t i = 0; i < iterations; ++i)
+                          doNotOptimize(op());
+                      },
+                      nullptr});
+  }
+
+  // Like add(), but `make` builds the state `op` works on (compiles the
+  // pattern) and returns the op, so --latency can time the first call on
+  // fresh state. Otherwise the op of one make() call is measured.
+  template <typename Make>
+  void addFresh(const std::string& name, Make make, size_t bytes = 0) {
+    if (!selected(name))
+      return;
+    add(name, make(), bytes);
+    cases_.back().fresh = [make]() -> std::function<void()> {
+      auto op = make();
+      return [op]() mutable { doNotOptimize(op()); };
+    };
+  }
+
+  // Run every registered case, print the table and write/compare JSON.
+  // Returns the process exit status.
+  int run() {
+    if (!options_.compareBase.empty())
+      return compareFiles(options_.compareBase, options_.compareNew);
+    if (options_.list) {
+      for (const auto& c : cases_)
+        std::cout << c.name << "\n";
+      return 0;
+    }
+
+    if (options_.latency)
+      return runLatency();
+    if (options_.counters)
+      perf_.reset(new PerfCounters());
+    std::printf("%-44s %12s %10s %25s %12s %10s\n", "benchmark", "median", "MAD", "95% CI",
+                "iterations", "MB/s");
+    for (auto& c : cases_) {
+      Result r = measure(c);
+      std::string ci = formatNs(r.ciLowNs) + " .. " + formatNs(r.ciHighNs);
+      std::printf("%-44s %12s %10s %25s %7llux%-4d", r.name.c_str(), formatNs(r.medianNs).c_str(),
+                  formatNs(r.madNs).c_str(), ci.c_str(),
+                  static_cast<unsigned long long>(r.iterations), r.samples);
+      if (r.bytes)
+        std::printf(" %10.1f", r.throughputMBs());
+      std::printf("\n");
+      std::fflush(stdout);
+      results_.push_back(r);
+    }
+    printCounters();
+    printAllocations();
+
+    if (!options_.jsonPath.empty()) {
+      std::ofstream out(options_.jsonPath);
+      out << toJson(results_);
+      std::cout << "\nResults written to " << options_.jsonPath << "\n";
+    }
+    if (!options_.baselinePath.empty()) {
+      std::vector<Result> base;
+      if (!fromJson(options_.baselinePath, base)) {
+        std::cerr << "cannot read baseline " << options_.baselinePath << "\n";
+        return 2;
+      }
+      return compare(base, results_, options_.threshold) ? 1 : 0;
+    }
+    return 0;
+  }
+
+  // Whether --filter lets `name` run
+  bool selected(const std::string& name) const {
+    if (options_.filters.empty())
+      return true;
+    for (const auto& f : options_.filters)
+      if (name.find(f) != std::string::npos)
+        return true;
+    return false;
+  }
+
+  // Result of a case measured by run(), or nullptr
+  const Result* find(const std::string& name) const {
+    for (const auto& r : results_)
+      if (r.name == name)
+        return &r;
+    return nullptr;
+  }
+
+ private:
+  struct Case {
+    std::string name;
+    size_t bytes;
+    std::function<void(uint64_t)> body;
+    std::function<std::function<void()>()> fresh;  // Set by addFresh()
+  };
+
+  Options options_;
+  std::vector<Case> cases_;
+  std::vector<Result> results_;
+  std::unique_ptr<PerfCounters> perf_;  // Opened by run() unless --no-counters
+
+  static void usage(const char* argv0) {
+    std::cerr << "usage: " << argv0
+              << " [--filter=a,b] [--samples=N] [--min-time=MS] [--json=FILE]"
+                 " [--baseline=FILE] [--threshold=PCT] [--list] [--no-counters]\n"
+              << "       " << argv0
+              << " --latency [--calls=N] [--flush-bytes=N] [--filter=a,b] [--json=FILE]\n"
+              << "       " << argv0 << " --compare BASE.json NEW.json [--threshold=PCT]\n";
+  }
+
+  static double elapsedNs(std::function<void(uint64_t)>& body, uint64_t iterations) {
+    auto start = std::chrono::steady_clock::now();
+    body(iterations);
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start)
+        .count();
+  }
+
+  Result measure(Case& c) const {
+    // Warm up caches, branch predictors and lazily built state
+    auto warmupEnd = std::chrono::steady_clock::now() +
+                     std::chrono::duration<double, std::milli>(options_.warmupMs);
+    do {
+      c.body(1);
+    } while (std::chrono::steady_clock::now() < warmupEnd);
+
+    Result r;
+    if (allocationCountingEnabled()) {
+      AllocationCount before = allocationCount();
+      c.body(1);
+      AllocationCount after = allocationCount();
+      r.allocations = static_cast<double>(after.allocations - before.allocations);
+      r.allocatedBytes = static_cast<double>(after.bytes - before.bytes);
+    }
+
+    // Grow the batch until one sample lasts at least minTimeMs
+    const double target = options_.minTimeMs * 1e6;
+    uint64_t iterations = 1;
+    for (;;) {
+      double ns = elapsedNs(c.body, iterations);
+      if (ns >= target || iterations >= (uint64_t(1) << 40))
+        break;
+      double scale = ns > 0 ? target / ns : 100;
+      iterations = static_cast<uint64_t>(iterations * std::min(100.0, std::max(2.0, scale * 1.2)));
+    }
+
+    std::vector<double> samples;
+    if (perf_)
+      perf_->start();
+    for (int s = 0; s < options_.samples; ++s)
+      samples.push_back(elapsedNs(c.body, iterations) / iterations);
+    if (perf_) {
+      perf_->stop(r.counters);
+      for (double& count : r.counters)
+        if (count >= 0)
+          count /= static_cast<double>(iterations) * options_.samples;
+    }
+
+    r.name = c.name;
+    r.bytes = c.bytes;
+    r.iterations = iterations;
+    summarize(r, samples);
+    return r;
+  }
+
+  // IPC and events per byte next to the timing table; each column is
+  // blank when that event could not be counted
+  void printCounters() const {
+    if (!perf_ || results_.empty())
+      return;
+    if (!perf_->available()) {
+      std::cout << "\nHardware counters unavailable: " << perf_->error() << "\n";
+      return;
+    }
+    auto cell = [](double v, const char* format) {
+      char buf[32];
+      if (v < 0)
+        return std::string("-");
+      std::snprintf(buf, sizeof(buf), format, v);
+      return std::string(buf);
+    };
+    std::printf("\nHardware counters (per input byte; per iteration when a case has no input)\n");
+    std::printf("%-44s %10s %8s %12s %12s %12s\n", "benchmark", "cycles", "IPC", "br-misses",
+                "L1d-misses", "LLC-misses");
+    for (const Result& r : results_) {
+      std::printf("%-44s %10s %8s %12s %12s %12s\n", r.name.c_str(),
+                  cell(r.perByte(CYCLES), "%.3f").c_str(), cell(r.ipc(), "%.2f").c_str(),
+                  cell(r.perByte(BRANCH_MISSES), "%.5f").c_str(),
+                  cell(r.perByte(L1D_MISSES), "%.5f").c_str(),
+                  cell(r.perByte(LLC_MISSES), "%.5f").c_str());
+    }
+  }
+
+  void printAllocations() const {
+    if (!allocationCountingEnabled() || results_.empty())
+      return;
+    std::printf("\nHeap allocations per iteration\n");
+    std::printf("%-44s %12s %12s\n", "benchmark", "allocations", "bytes");
+    for (const Result& r : results_)
+      std::printf("%-44s %12.0f %12.0f\n", r.name.c_str(), r.allocations, r.allocatedBytes);
+  }
+
+  // ==========================================================================
+  // Latency mode
+  // ==========================================================================
+  struct Latency {
+    std::string name;
+    const char* condition;  // "first", "warm" or "flushed"
+    amaranth::LatencyHistogram histogram;
+  };
+
+  // Smallest time steady_clock reports for back-to-back reads, subtracted
+  // from every sample
+  static uint64_t clockOverheadNs() {
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < 1000; ++i) {
+      auto a = std::chrono::steady_clock::now();
+      auto b = std::chrono::steady_clock::now();
+      best = std::min<uint64_t>(best, std::chrono::nanoseconds(b - a).count());
+    }
+    return best;
+  }
+
+  template <typename Fn>
+  static uint64_t timeOnce(Fn& call, uint64_t overhead) {
+    auto start = std::chrono::steady_clock::now();
+    call();
+    uint64_t ns = std::chrono::nanoseconds(std::chrono::steady_clock::now() - start).count();
+    return ns > overhead ? ns - overhead : 0;
+  }
+
+  int runLatency() {
+    const uint64_t overhead = clockOverheadNs();
+    // Enough calls of each kind for a p99.9, fewer where each costs a sweep
+    // or a compile
+    const int coldCalls = std::max(100, options_.latencyCalls / 10);
+    std::vector<char> flush(options_.flushBytes, 1);
+    std::vector<Latency> latencies;
+
+    std::printf("Per-call latency, clock overhead of %llu ns subtracted\n",
+                static_cast<unsigned long long>(overhead));
+    std::printf("%-44s %8s %8s %10s %10s %10s %10s\n", "benchmark", "calls", "state", "p50",
+                "p99", "p99.9", "max");
+    for (auto& c : cases_) {
+      std::function<void()> once = [&c]() { c.body(1); };
+      std::vector<Latency> rows;
+
+      if (c.fresh) {
+        Latency first{c.name, "first", {}};
+        for (int i = 0; i < coldCalls; ++i) {
+          std::function<void()> op = c.fresh();
+          first.histogram.record(timeOnce(op, overhead));
+        }
+        rows.push_back(first);
+      }
+
+      auto warmupEnd = std::chrono::steady_clock::now() +
+                       std::chrono::duration<double, std::milli>(options_.warmupMs);
+      do {
+        once();
+      } while (std::chrono::steady_clock::now() < warmupEnd);
+      Latency warm{c.name, "warm", {}};
+      for (int i = 0; i < options_.latencyCalls; ++i)
+        warm.histogram.record(timeOnce(once, overhead));
+      rows.push_back(warm);
+
+      Latency flushed{c.name, "flushed", {}};
+      for (int i = 0; i < coldCalls; ++i) {
+        // Write every line so dirty evictions are part of the sweep, not
+        // of the timed call
+        for (size_t b = 0; b < flush.size(); b += 64)
+          flush[b] = static_cast<char>(flush[b] + 1);
+        doNotOptimize(flush[flush.size() / 2]);
+        flushed.histogram.record(timeOnce(once, overhead));
+      }
+      rows.push_back(flushed);
+
+      for (const Latency& l : rows) {
+        const amaranth::LatencyHistogram& h = l.histogram;
+        std::printf("%-44s %8llu %8s %10s %10s %10s %10s\n", l.name.c_str(),
+                    static_cast<unsigned long long>(h.count), l.condition,
+                    formatNs(static_cast<double>(h.percentile(0.5))).c_str(),
+                    formatNs(static_cast<double>(h.percentile(0.99))).c_str(),
+                    formatNs(static_cast<double>(h.percentile(0.999))).c_str(),
+                    formatNs(static_cast<double>(h.maxNanos)).c_str());
+        latencies.push_back(l);
+      }
+      std::fflush(stdout);
+    }
+
+    if (!options_.jsonPath.empty()) {
+      std::ofstream out(options_.jsonPath);
+      out << "{\n  \"latency\": [";
+      for (size_t i = 0; i < latencies.size(); ++i) {
+        const amaranth::LatencyHistogram& h = latencies[i].histogram;
+        out << (i ? ",\n" : "\n") << "    {\"name\": " << jsonString(latencies[i].name)
+            << ", \"condition\": \"" << latencies[i].condition << "\", \"calls\": " << h.count
+            << ", \"p50_ns\": " << h.percentile(0.5) << ", \"p99_ns\": " << h.percentile(0.99)
+            << ", \"p999_ns\": " << h.percentile(0.999) << ", \"max_ns\": " << h.maxNanos
+            << "}";
+      }
+      out << "\n  ]\n}\n";
+      std::cout << "\nResults written to " << options_.jsonPath << "\n";
+    }
+    return 0;
+  }
+
+  int compareFiles(const std::string& basePath, const std::string& newPath) const {
+    std::vector<Result> base, current;
+    if (!fromJson(basePath, base) || !fromJson(newPath, current)) {
+      std::cerr << "cannot read " << basePath << " or " << newPath << "\n";
+      return 2;
+    }
+    return compare(base, current, options_.threshold) ? 1 : 0;
+  }
+};
+
+}  // namespace bench
@@ -1,11 +1,22 @@
+// benchmark.cc - Matching speed of Amarantine against other regex libraries
+//
+// Every test case is registered once per available library as
+// "<case>/<library>" and measured by the harness in bench_harness.h; run
+// with --help for filtering, JSON output and baseline comparison. A summary
+// of each library's speed relative to Amarantine and the cost of
+// Regex::enableMetrics() follow the table. "<case>/amarantine-compile"
+// times constructing the Regex; build with -DAMARANTH_COUNT_ALLOCATIONS=ON
+// to also get heap allocations per match, search and compile.
 #include "amaranth/amaranth.h"
 
+#include "bench_harness.h"
+#include "corpus.h"
+
 #include <algorithm>
-#include <chrono>
 #include <cstring>
 #include <iomanip>
 #include <iostream>
-#include <random>
+#include <memory>
 #include <vector>
 
 // Try to include other regex libraries
@@ -32,100 +43,22 @@
 
 using namespace amaranth;
 
-// Timer utility
-class Timer {
- public:
-  Timer() : start_(std::chrono::high_resolution_clock::now()) {}
-
-  double elapsed_ms() const {
-    auto now = std::chrono::high_resolution_clock::now();
-    return std::chrono::duration<double, std::milli>(now - start_).count();
-  }
-
-  void reset() {
-    start_ = std::chrono::high_resolution_clock::now();
-  }
-
- private:
-  std::chrono::high_resolution_clock::time_point start_;
-};
-
-// Benchmark result for multiple libraries
-struct BenchmarkResult {
-  std::string name;
-  double amarantine_time_ms = 0;
-  double std_time_ms = 0;
-  double re2_time_ms = 0;
-  double pcre2_time_ms = 0;
-  double ctre_time_ms = 0;
-
-  void print() const {
-    auto format_time = [](double ms) -> std::string {
-      if (ms < 0.001) {
-        double ns = ms * 1000000.0;
-        return std::to_string(static_cast<long long>(ns)) + " ns";
-      } else if (ms < 0.01) {
-        return std::to_string(static_cast<int>(ms * 1000)) + " us";
-      } else if (ms < 1) {
-        return std::to_string(ms).substr(0, std::to_string(ms).find('.') + 3) + " ms";
-      } else {
-        return std::to_string(ms).substr(0, std::to_string(ms).find('.') + 2) + " ms";
-      }
-    };
-
-    std::cout << "\n  " << std::setw(30) << std::left << name;
-    std::cout << " | Amarantine: " << std::setw(12) << format_time(amarantine_time_ms);
-
-#ifdef USE_STD_REGEX
-    std::cout << " | std: " << std::setw(12) << format_time(std_time_ms);
-    if (std_time_ms > 0 && amarantine_time_ms > 0) {
-      double speedup = std_time_ms / amarantine_time_ms;
-      std::cout << " (" << std::fixed << std::setprecision(2) << speedup << "x)";
-    }
-#endif
-
-#ifdef HAVE_RE2
-    std::cout << " | RE2: " << std::setw(12) << format_time(re2_time_ms);
-    if (re2_time_ms > 0 && amarantine_time_ms > 0) {
-      double speedup = amarantine_time_ms / re2_time_ms;
-      std::cout << " (" << std::fixed << std::setprecision(2) << speedup << "x)";
-    }
-#endif
-
-#ifdef HAVE_PCRE2
-    std::cout << " | PCRE2: " << std::setw(12) << format_time(pcre2_time_ms);
-#endif
-
-#ifdef HAVE_CTRE
-    std::cout << " | CTRE: " << std::setw(12) << format_time(ctre_time_ms);
-    if (ctre_time_ms > 0 && amarantine_time_ms > 0) {
-      double speedup = amarantine_time_ms / ctre_time_ms;
-      std::cout << " (" << std::fixed << std::setprecision(2) << speedup << "x)";
-    }
-#endif
-
-    std::cout << "\n";
-  }
-};
-
-// Test data generators
+// Test data generators, seeded so every run times the same haystack
 std::string generate_email_string(int count) {
   std::string result = "Contact: ";
-  std::random_device rd;
-  std::mt19937 gen(rd());
-  std::uniform_int_distribution<> dis(0, 25);
+  corpus::Generator g(11);
 
   for (int i = 0; i < count; ++i) {
     std::string local;
-    int local_len = 5 + (dis(gen) % 5);
-    for (int j = 0; j < local_len; ++j) {
-      local += static_cast<char>('a' + dis(gen));
+    size_t local_len = 5 + g.below(5);
+    for (size_t j = 0; j < local_len; ++j) {
+      local += static_cast<char>('a' + g.below(26));
     }
 
     std::string domain;
-    int domain_len = 4 + (dis(gen) % 4);
-    for (int j = 0; j < domain_len; ++j) {
-      domain += static_cast<char>('a' + dis(gen));
+    size_t domain_len = 4 + g.below(4);
+    for (size_t j = 0; j < domain_len; ++j) {
+      domain += static_cast<char>('a' + g.below(26));
     }
 
     std::string tld = "com";
@@ -141,14 +74,13 @@ std::string generate_email_string(int count) {
 
 std::string generate_hex_string() {
   std::string result = "Colors: ";
-  const char* hex_colors[] = {"#FF0000", "#00FF00", "#0000FF", "#FFFF00", "#FF00FF", "#00FFFF",
-                              "#FFA500", "#800080", "#008080", "#FFC0CB", "#FFD700", "#C0C0C0"};
-  std::random_device rd;
-  std::mt19937 gen(rd());
-  std::uniform_int_distribution<> dis(0, 11);
+  const char* const hex_colors[] = {"#FF0000", "#00FF00", "#0000FF", "#FFFF00", "#FF00FF",
+                                    "#00FFFF", "#FFA500", "#800080", "#008080", "#FFC0CB",
+                                    "#FFD700", "#C0C0C0"};
+  corpus::Generator g(12);
 
   for (int i = 0; i < 50; ++i) {
-    result.append(hex_colors[dis(gen)]);
+    result.append(g.pick(hex_colors));
     result.push_back(' ');
   }
   return result;
@@ -156,326 +88,202 @@ std::string generate_hex_string() {
 
 std::string generate_ipv4_string(int count) {
   std::string result;
-  std::random_device rd;
-  std::mt19937 gen(rd());
-  std::uniform_int_distribution<> dis(0, 255);
+  corpus::Generator g(13);
 
   for (int i = 0; i < count; ++i) {
-    result += std::to_string(dis(gen)) + "." + std::to_string(dis(gen)) + "." +
-              std::to_string(dis(gen)) + "." + std::to_string(dis(gen)) + " ";
+    result += std::to_string(g.below(256)) + "." + std::to_string(g.below(256)) + "." +
+              std::to_string(g.below(256)) + "." + std::to_string(g.below(256)) + " ";
   }
   return result;
 }
 
-// Amarantine benchmark
-double benchmark_amarantine_match(const std::string& pattern, const std::string& text,
-                                  int iterations) {
-  try {
-    Regex re(pattern);
-    MatchResult result;
-
-    // Warmup
-    for (int i = 0; i < 10; ++i) {
-      re.match(text, result);
-    }
+// Log lines in mixed case with the keyword only in the last few
+std::string generate_mixed_case_log(int count) {
+  static const char* const levels[] = {"info", "INFO", "Debug", "debug", "NOTICE"};
+  static const char* const keywords[] = {"timeout", "TIMEOUT", "TimeOut"};
+  std::string result;
+  corpus::Generator g(14);
 
-    Timer timer;
-    for (int i = 0; i < iterations; ++i) {
-      re.match(text, result);
-    }
-    return timer.elapsed_ms() / iterations;
-  } catch (...) {
-    return -1;
+  for (int i = 0; i < count; ++i) {
+    result += std::string("[") + g.pick(levels) + "] request " + std::to_string(g.below(100000)) +
+              " served in " + std::to_string(g.below(900)) + "ms; ";
+    if (i >= count - 3)
+      result += std::string(g.pick(keywords)) + "; ";
   }
+  return result;
 }
 
-double benchmark_amarantine_search(const std::string& pattern, const std::string& text,
-                                   int iterations) {
-  try {
-    Regex re(pattern);
-    MatchResult result;
-
-    // Warmup
-    for (int i = 0; i < 10; ++i) {
-      re.search(text, result);
-    }
+// "error" inside longer words on every line, and on its own on the last few
+std::string generate_embedded_keyword_log(int count) {
+  static const char* const words[] = {"errors", "terror", "error_count", "mirrored", "errorless"};
+  std::string result;
+  corpus::Generator g(15);
 
-    Timer timer;
-    for (int i = 0; i < iterations; ++i) {
-      re.search(text, result);
-    }
-    return timer.elapsed_ms() / iterations;
-  } catch (...) {
-    return -1;
+  for (int i = 0; i < count; ++i) {
+    result += std::string("request ") + std::to_string(g.below(100000)) + " " + g.pick(words) +
+              "=" + std::to_string(g.below(10)) + "; ";
+    if (i >= count - 3)
+      result += "error; ";
   }
+  return result;
 }
 
-#ifdef USE_STD_REGEX
-double benchmark_std_match(const std::string& pattern, const std::string& text, int iterations) {
-  try {
-    std::regex re(pattern);
-    std::smatch smatch;
-
-    // Warmup
-    for (int i = 0; i < 10; ++i) {
-      std::regex_match(text, smatch, re);
-    }
+struct TestCase {
+  std::string name;
+  std::string pattern;
+  std::function<std::string()> text_generator;
+  bool search;
+};
 
-    Timer timer;
-    for (int i = 0; i < iterations; ++i) {
-      std::regex_match(text, smatch, re);
-    }
-    return timer.elapsed_ms() / iterations;
-  } catch (...) {
-    return -1;
+// "Email search" -> "email_search", so names are easy to pass to --filter
+std::string slug(const std::string& name) {
+  std::string out;
+  for (char c : name) {
+    out += c == ' ' ? '_' : static_cast<char>(::tolower(static_cast<unsigned char>(c)));
   }
+  return out;
 }
 
-double benchmark_std_search(const std::string& pattern, const std::string& text, int iterations) {
+// ============================================================================
+// Registration per library
+// ============================================================================
+// Each library registers a factory that compiles the pattern and returns the
+// timed op, so --latency can also time the first call on a new object
+void add_amarantine(bench::Harness& h, const TestCase& test, const std::string& text,
+                    bool metrics) {
   try {
-    std::regex re(pattern);
-    std::smatch smatch;
-
-    // Warmup
-    for (int i = 0; i < 10; ++i) {
-      std::regex_search(text, smatch, re);
-    }
-
-    Timer timer;
-    for (int i = 0; i < iterations; ++i) {
-      std::regex_search(text, smatch, re);
-    }
-    return timer.elapsed_ms() / iterations;
-  } catch (...) {
-    return -1;
+    Regex check(test.pattern);
+  } catch (const RegexError&) {
+    return;
+  }
+  std::string pattern = test.pattern;
+  bool search = test.search;
+  std::string name = slug(test.name) + (metrics ? "/amarantine+metrics" : "/amarantine");
+  h.addFresh(
+      name,
+      [pattern, search, metrics, &text]() {
+        auto re = std::make_shared<Regex>(pattern);
+        re->enableMetrics(metrics);
+        auto result = std::make_shared<MatchResult>();
+        return [re, result, search, &text]() {
+          return search ? re->search(text, *result) : re->match(text, *result);
+        };
+      },
+      text.size());
+  // Construction cost, mostly of interest for its allocations
+  if (!metrics) {
+    h.add(slug(test.name) + "/amarantine-compile",
+          [pattern]() { return Regex(pattern).isCompiled(); });
   }
 }
-#endif
 
-#ifdef HAVE_RE2
-double benchmark_re2_match(const std::string& pattern, const std::string& text, int iterations) {
+#ifdef USE_STD_REGEX
+void add_std(bench::Harness& h, const TestCase& test, const std::string& text) {
   try {
-    RE2 re(pattern, RE2::Quiet);
-    if (!re.ok())
-      return -1;
-
-    // Warmup
-    for (int i = 0; i < 10; ++i) {
-      RE2::FullMatch(text, re);
-    }
-
-    Timer timer;
-    for (int i = 0; i < iterations; ++i) {
-      RE2::FullMatch(text, re);
-    }
-    return timer.elapsed_ms() / iterations;
-  } catch (...) {
-    return -1;
+    std::regex check(test.pattern);
+  } catch (const std::regex_error&) {
+    return;
   }
+  std::string pattern = test.pattern;
+  bool search = test.search;
+  h.addFresh(
+      slug(test.name) + "/std",
+      [pattern, search, &text]() {
+        auto re = std::make_shared<std::regex>(pattern);
+        auto m = std::make_shared<std::smatch>();
+        return [re, m, search, &text]() {
+          return search ? std::regex_search(text, *m, *re) : std::regex_match(text, *m, *re);
+        };
+      },
+      text.size());
 }
+#endif
 
-double benchmark_re2_search(const std::string& pattern, const std::string& text, int iterations) {
-  try {
-    RE2 re(pattern, RE2::Quiet);
-    if (!re.ok())
-      return -1;
-    re2::StringPiece match;
-
-    // Warmup
-    for (int i = 0; i < 10; ++i) {
-      RE2::PartialMatch(text, re, &match);
-    }
-
-    Timer timer;
-    for (int i = 0; i < iterations; ++i) {
-      RE2::PartialMatch(text, re, &match);
-    }
-    return timer.elapsed_ms() / iterations;
-  } catch (...) {
-    return -1;
-  }
+#ifdef HAVE_RE2
+void add_re2(bench::Harness& h, const TestCase& test, const std::string& text) {
+  if (!RE2(test.pattern, RE2::Quiet).ok())
+    return;
+  std::string pattern = test.pattern;
+  bool search = test.search;
+  h.addFresh(
+      slug(test.name) + "/re2",
+      [pattern, search, &text]() {
+        auto re = std::make_shared<RE2>(pattern, RE2::Quiet);
+        return [re, search, &text]() {
+          re2::StringPiece match;
+          return search ? RE2::PartialMatch(text, *re, &match) : RE2::FullMatch(text, *re);
+        };
+      },
+      text.size());
 }
 #endif
 
 #ifdef HAVE_PCRE2
-double benchmark_pcre2_match(const std::string& pattern, const std::string& text, int iterations) {
-  try {
-    int errorcode;
-    PCRE2_SIZE erroroffset;
-    pcre2_code* re = pcre2_compile(reinterpret_cast<PCRE2_SPTR>(pattern.c_str()),
+// Null when the pattern does not compile
+static std::shared_ptr<pcre2_code> pcre2Compile(const std::string& pattern) {
+  int errorcode;
+  PCRE2_SIZE erroroffset;
+  pcre2_code* code = pcre2_compile(reinterpret_cast<PCRE2_SPTR>(pattern.c_str()),
                                    PCRE2_ZERO_TERMINATED, 0, &errorcode, &erroroffset, NULL);
-    if (!re)
-      return -1;
-
-    pcre2_match_data* match_data = pcre2_match_data_create_from_pattern(re, NULL);
-
-    // Warmup
-    for (int i = 0; i < 10; ++i) {
-      pcre2_match(re, reinterpret_cast<PCRE2_SPTR>(text.c_str()), text.length(), 0, 0, match_data,
-                  NULL);
-    }
-
-    Timer timer;
-    for (int i = 0; i < iterations; ++i) {
-      pcre2_match(re, reinterpret_cast<PCRE2_SPTR>(text.c_str()), text.length(), 0, 0, match_data,
-                  NULL);
-    }
-    double elapsed = timer.elapsed_ms() / iterations;
+  if (!code)
+    return nullptr;
+  return std::shared_ptr<pcre2_code>(code, pcre2_code_free);
+}
 
-    pcre2_match_data_free(match_data);
-    pcre2_code_free(re);
-    return elapsed;
-  } catch (...) {
-    return -1;
-  }
+void add_pcre2(bench::Harness& h, const TestCase& test, const std::string& text) {
+  if (!pcre2Compile(test.pattern))
+    return;
+  std::string pattern = test.pattern;
+  h.addFresh(
+      slug(test.name) + "/pcre2",
+      [pattern, &text]() {
+        std::shared_ptr<pcre2_code> re = pcre2Compile(pattern);
+        std::shared_ptr<pcre2_match_data> match_data(
+            pcre2_match_data_create_from_pattern(re.get(), NULL), pcre2_match_data_free);
+        return [re, match_data, &text]() {
+          return pcre2_match(re.get(), reinterpret_cast<PCRE2_SPTR>(text.c_str()), text.length(),
+                             0, 0, match_data.get(), NULL);
+        };
+      },
+      text.size());
 }
 #endif
 
 #ifdef HAVE_CTRE
-// CTRE benchmark - uses constexpr patterns at compile time
-// Since patterns must be compile-time, we have specific functions for each test
-double benchmark_ctre_literal_match(const std::string& text, int iterations) {
-  try {
-    static constexpr auto pattern = ctll::fixed_string{"hello"};
-    for (int i = 0; i < 10; ++i) {
-      ctre::search<pattern>(text);
-    }
-    Timer timer;
-    for (int i = 0; i < iterations; ++i) {
-      ctre::search<pattern>(text);
-    }
-    return timer.elapsed_ms() / iterations;
-  } catch (...) {
-    return -1;
-  }
-}
-
-double benchmark_ctre_digit_match(const std::string& text, int iterations) {
-  try {
-    static constexpr auto pattern = ctll::fixed_string{R"((\d+))"};
-    for (int i = 0; i < 10; ++i) {
-      ctre::search<pattern>(text);
-    }
-    Timer timer;
-    for (int i = 0; i < iterations; ++i) {
-      ctre::search<pattern>(text);
-    }
-    return timer.elapsed_ms() / iterations;
-  } catch (...) {
-    return -1;
-  }
-}
-
-double benchmark_ctre_word_match(const std::string& text, int iterations) {
-  try {
-    static constexpr auto pattern = ctll::fixed_string{R"(\w+)"};
-    for (int i = 0; i < 10; ++i) {
-      ctre::search<pattern>(text);
-    }
-    Timer timer;
-    for (int i = 0; i < iterations; ++i) {
-      ctre::search<pattern>(text);
-    }
-    return timer.elapsed_ms() / iterations;
-  } catch (...) {
-    return -1;
-  }
-}
-
-double benchmark_ctre_char_class(const std::string& text, int iterations) {
-  try {
-    static constexpr auto pattern = ctll::fixed_string{"[aeiou]+"};
-    for (int i = 0; i < 10; ++i) {
-      ctre::search<pattern>(text);
-    }
-    Timer timer;
-    for (int i = 0; i < iterations; ++i) {
-      ctre::search<pattern>(text);
-    }
-    return timer.elapsed_ms() / iterations;
-  } catch (...) {
-    return -1;
-  }
-}
-
-double benchmark_ctre_negated_class(const std::string& text, int iterations) {
-  try {
-    static constexpr auto pattern = ctll::fixed_string{"[^0-9]+"};
-    for (int i = 0; i < 10; ++i) {
-      ctre::search<pattern>(text);
-    }
-    Timer timer;
-    for (int i = 0; i < iterations; ++i) {
-      ctre::search<pattern>(text);
-    }
-    return timer.elapsed_ms() / iterations;
-  } catch (...) {
-    return -1;
-  }
-}
-
-double benchmark_ctre_email_search(const std::string& text, int iterations) {
-  try {
-    // Use \S+ instead of [\w.+] to simplify
-    static constexpr auto pattern = ctll::fixed_string{R"(\S+@\S+\.[a-zA-Z]+)"};
-    for (int i = 0; i < 10; ++i) {
-      ctre::search<pattern>(text);
-    }
-    Timer timer;
-    for (int i = 0; i < iterations; ++i) {
-      ctre::search<pattern>(text);
-    }
-    return timer.elapsed_ms() / iterations;
-  } catch (...) {
-    return -1;
-  }
-}
-
-double benchmark_ctre_hex_color(const std::string& text, int iterations) {
-  try {
-    static constexpr auto pattern = ctll::fixed_string{R"(#[0-9A-Fa-f]+)"};
-    for (int i = 0; i < 10; ++i) {
-      ctre::search<pattern>(text);
-    }
-    Timer timer;
-    for (int i = 0; i < iterations; ++i) {
-      ctre::search<pattern>(text);
-    }
-    return timer.elapsed_ms() / iterations;
-  } catch (...) {
-    return -1;
-  }
-}
-
-double benchmark_ctre_ipv4(const std::string& text, int iterations) {
-  try {
-    static constexpr auto pattern = ctll::fixed_string{R"([0-9]+\.[0-9]+\.[0-9]+\.[0-9]+)"};
-    for (int i = 0; i < 10; ++i) {
-      ctre::search<pattern>(text);
-    }
-    Timer timer;
-    for (int i = 0; i < iterations; ++i) {
-      ctre::search<pattern>(text);
-    }
-    return timer.elapsed_ms() / iterations;
-  } catch (...) {
-    return -1;
-  }
-}
-
-double benchmark_ctre_date_format(const std::string& text, int iterations) {
-  try {
-    static constexpr auto pattern = ctll::fixed_string{R"([0-9]+-[0-9]+-[0-9]+)"};
-    for (int i = 0; i < 10; ++i) {
-      ctre::search<pattern>(text);
-    }
-    Timer timer;
-    for (int i = 0; i < iterations; ++i) {
-      ctre::search<pattern>(text);
-    }
-    return timer.elapsed_ms() / iterations;
-  } catch (...) {
-    return -1;
+// CTRE patterns must be known at compile time, so each test case that CTRE
+// can express has its own pattern here
+static constexpr auto ctre_literal = ctll::fixed_string{"hello"};
+static constexpr auto ctre_digit = ctll::fixed_string{R"((\d+))"};
+static constexpr auto ctre_word = ctll::fixed_string{R"(\w+)"};
+static constexpr auto ctre_char_class = ctll::fixed_string{"[aeiou]+"};
+static constexpr auto ctre_negated_class = ctll::fixed_string{"[^0-9]+"};
+// Uses \S+ instead of [\w.+] to simplify
+static constexpr auto ctre_email = ctll::fixed_string{R"(\S+@\S+\.[a-zA-Z]+)"};
+static constexpr auto ctre_hex_color = ctll::fixed_string{R"(#[0-9A-Fa-f]+)"};
+static constexpr auto ctre_ipv4 = ctll::fixed_string{R"([0-9]+\.[0-9]+\.[0-9]+\.[0-9]+)"};
+static constexpr auto ctre_date = ctll::fixed_string{R"([0-9]+-[0-9]+-[0-9]+)"};
+
+void add_ctre(bench::Harness& h, const TestCase& test, const std::string& text) {
+  std::string name = slug(test.name) + "/ctre";
+  auto add = [&](auto op) { h.add(name, [op, &text]() { return bool(op(text)); }, text.size()); };
+  if (test.name == "Literal match") {
+    add([](const std::string& t) { return ctre::search<ctre_literal>(t); });
+  } else if (test.name == "Digit match") {
+    add([](const std::string& t) { return ctre::search<ctre_digit>(t); });
+  } else if (test.name == "Word match") {
+    add([](const std::string& t) { return ctre::search<ctre_word>(t); });
+  } else if (test.name == "Character class") {
+    add([](const std::string& t) { return ctre::search<ctre_char_class>(t); });
+  } else if (test.name == "Negated class") {
+    add([](const std::string& t) { return ctre::search<ctre_negated_class>(t); });
+  } else if (test.name == "Email search") {
+    add([](const std::string& t) { return ctre::search<ctre_email>(t); });
+  } else if (test.name == "Hex color") {
+    add([](const std::string& t) { return ctre::search<ctre_hex_color>(t); });
+  } else if (test.name == "IPv4" || test.name == "IPv4 search") {
+    add([](const std::string& t) { return ctre::search<ctre_ipv4>(t); });
+  } else if (test.name == "Date format") {
+    add([](const std::string& t) { return ctre::search<ctre_date>(t); });
   }
 }
 #endif
@@ -511,123 +319,101 @@ void print_available_libs() {
 
 // Main benchmark
 int main(int argc, char* argv[]) {
-  (void)argc;
-  (void)argv;
-
-  std::cout << "========================================\n";
-  std::cout << "  Amarantine Performance Benchmark\n";
-  std::cout << "========================================\n\n";
-
-  print_available_libs();
-  std::cout << "\n";
-
-  struct TestCase {
-    std::string name;
-    std::string pattern;
-    std::function<std::string()> text_generator;
-    int iterations;
-    bool search;
-  };
+  bench::Harness harness(argc, argv);
+  bool table = harness.options().compareBase.empty() && !harness.options().list;
+  // Latency mode has no medians for the summaries below
+  bool summaries = table && !harness.options().latency;
+
+  if (table) {
+    std::cout << "========================================\n";
+    std::cout << "  Amarantine Performance Benchmark\n";
+    std::cout << "========================================\n\n";
+    print_available_libs();
+    std::cout << "\n";
+  }
 
   std::vector<TestCase> tests = {
-      {"Literal match", "(hello)", []() -> std::string { return "hello world"; }, 10000, false},
-      {"Digit match", R"((\d+))", []() -> std::string { return "test 12345"; }, 10000, false},
-      {"Word match", R"(\w+)", []() -> std::string { return "hello123"; }, 10000, false},
-      {"Character class", R"([aeiou]+)", []() -> std::string { return "aeiou"; }, 10000, false},
-      {"Negated class", R"([^0-9]+)", []() -> std::string { return "abc"; }, 10000, false},
+      {"Literal match", "(hello)", []() -> std::string { return "hello world"; }, false},
+      {"Digit match", R"((\d+))", []() -> std::string { return "test 12345"; }, false},
+      {"Word match", R"(\w+)", []() -> std::string { return "hello123"; }, false},
+      {"Character class", R"([aeiou]+)", []() -> std::string { return "aeiou"; }, false},
+      {"Negated class", R"([^0-9]+)", []() -> std::string { return "abc"; }, false},
       {"Email search", R"([\w.+-]+@[\w.-]+\.[a-zA-Z]{2,})",
-       []() -> std::string { return generate_email_string(50); }, 100, true},
-      {"Hex color", R"(#[0-9A-Fa-f]{6})", generate_hex_string, 1000, false},
+       []() -> std::string { return generate_email_string(50); }, true},
+      {"Hex color", R"(#[0-9A-Fa-f]{6})", generate_hex_string, false},
       {"IPv4", R"(\d{1,3}\.\d{1,3}\.\d{1,3}\.\d{1,3})",
-       []() -> std::string { return "192.168.1.1"; }, 10000, false},
+       []() -> std::string { return "192.168.1.1"; }, false},
       {"IPv4 search", R"(\d{1,3}\.\d{1,3}\.\d{1,3}\.\d{1,3})",
-       []() -> std::string { return generate_ipv4_string(100); }, 100, true},
+       []() -> std::string { return generate_ipv4_string(100); }, true},
       {"Date format", R"((\d{4})-(\d{2})-(\d{2}))", []() -> std::string { return "2024-01-15"; },
-       10000, false},
+       false},
+      // Inline (?i); std::regex has no such syntax and sits this one out
+      {"Case-insensitive search", R"((?i)timeout)",
+       []() -> std::string { return generate_mixed_case_log(100); }, true},
+      {"Word-bounded keyword", R"(\berror\b)",
+       []() -> std::string { return generate_embedded_keyword_log(100); }, true},
   };
 
-  std::cout << "=== Pattern Matching Benchmarks ===";
+  // Texts outlive the harness run; the registered cases refer to them
+  std::vector<std::string> texts;
+  texts.reserve(tests.size());
+  for (const auto& test : tests) {
+    texts.push_back(test.text_generator());
+    const std::string& text = texts.back();
+    add_amarantine(harness, test, text, false);
+    add_amarantine(harness, test, text, true);
 #ifdef USE_STD_REGEX
-  std::cout << "                              Amarantine       std";
-#else
-  std::cout << "                              Amarantine";
+    add_std(harness, test, text);
 #endif
 #ifdef HAVE_RE2
-  std::cout << "         RE2";
+    add_re2(harness, test, text);
 #endif
 #ifdef HAVE_PCRE2
-  std::cout << "       PCRE2";
+    add_pcre2(harness, test, text);
 #endif
 #ifdef HAVE_CTRE
-  std::cout << "        CTRE";
+    add_ctre(harness, test, text);
 #endif
-  std::cout << "\n";
+  }
 
-  for (const auto& test : tests) {
-    BenchmarkResult res;
-    res.name = test.name;
-    std::string text = test.text_generator();
+  int status = harness.run();
+  if (!summaries)
+    return status;
 
-    if (test.search) {
-      res.amarantine_time_ms = benchmark_amarantine_search(test.pattern, text, test.iterations);
-#ifdef USE_STD_REGEX
-      res.std_time_ms = benchmark_std_search(test.pattern, text, test.iterations);
-#endif
-#ifdef HAVE_RE2
-      res.re2_time_ms = benchmark_re2_search(test.pattern, text, test.iterations);
-#endif
-#ifdef HAVE_PCRE2
-      res.pcre2_time_ms = benchmark_pcre2_match(test.pattern, text, test.iterations);
-#endif
-#ifdef HAVE_CTRE
-      // CTRE for search operations
-      if (test.name == "Email search") {
-        res.ctre_time_ms = benchmark_ctre_email_search(text, test.iterations);
-      } else if (test.name == "IPv4 search") {
-        res.ctre_time_ms = benchmark_ctre_ipv4(text, test.iterations);
-      }
-#endif
-    } else {
-      res.amarantine_time_ms = benchmark_amarantine_match(test.pattern, text, test.iterations);
-#ifdef USE_STD_REGEX
-      res.std_time_ms = benchmark_std_match(test.pattern, text, test.iterations);
-#endif
-#ifdef HAVE_RE2
-      res.re2_time_ms = benchmark_re2_match(test.pattern, text, test.iterations);
-#endif
-#ifdef HAVE_PCRE2
-      res.pcre2_time_ms = benchmark_pcre2_match(test.pattern, text, test.iterations);
-#endif
-#ifdef HAVE_CTRE
-      // CTRE for match operations - select based on test name
-      if (test.name == "Literal match") {
-        res.ctre_time_ms = benchmark_ctre_literal_match(text, test.iterations);
-      } else if (test.name == "Digit match") {
-        res.ctre_time_ms = benchmark_ctre_digit_match(text, test.iterations);
-      } else if (test.name == "Word match") {
-        res.ctre_time_ms = benchmark_ctre_word_match(text, test.iterations);
-      } else if (test.name == "Character class") {
-        res.ctre_time_ms = benchmark_ctre_char_class(text, test.iterations);
-      } else if (test.name == "Negated class") {
-        res.ctre_time_ms = benchmark_ctre_negated_class(text, test.iterations);
-      } else if (test.name == "Hex color") {
-        res.ctre_time_ms = benchmark_ctre_hex_color(text, test.iterations);
-      } else if (test.name == "IPv4") {
-        res.ctre_time_ms = benchmark_ctre_ipv4(text, test.iterations);
-      } else if (test.name == "Date format") {
-        res.ctre_time_ms = benchmark_ctre_date_format(text, test.iterations);
+  // Other libraries relative to Amarantine (>1 means Amarantine is faster)
+  std::cout << "\n=== Speedup of Amarantine ===\n";
+  for (const auto& test : tests) {
+    const bench::Result* ours = harness.find(slug(test.name) + "/amarantine");
+    if (!ours)
+      continue;
+    std::cout << "  " << std::setw(30) << std::left << test.name << std::right;
+    for (const char* lib : {"std", "re2", "pcre2", "ctre"}) {
+      const bench::Result* other = harness.find(slug(test.name) + "/" + lib);
+      if (other && ours->medianNs > 0) {
+        std::cout << " | " << lib << ": " << std::fixed << std::setprecision(2)
+                  << other->medianNs / ours->medianNs << "x";
       }
-#endif
     }
+    std::cout << "\n";
+  }
 
-    if (res.amarantine_time_ms >= 0) {
-      res.print();
-    }
+  // Cost of latency recording, see Regex::enableMetrics()
+  std::cout << "\n=== Metrics Overhead (enableMetrics) ===\n";
+  for (const auto& test : tests) {
+    const bench::Result* off = harness.find(slug(test.name) + "/amarantine");
+    const bench::Result* on = harness.find(slug(test.name) + "/amarantine+metrics");
+    if (!off || !on)
+      continue;
+    double overhead = on->medianNs - off->medianNs;
+    std::cout << "  " << std::setw(30) << std::left << test.name << std::right << std::fixed
+              << std::setprecision(1) << " | off: " << std::setw(10) << off->medianNs << " ns"
+              << " | on: " << std::setw(10) << on->medianNs << " ns"
+              << " | overhead: " << std::setw(8) << overhead << " ns ("
+              << (off->medianNs > 0 ? overhead * 100 / off->medianNs : 0) << "%)\n";
   }
 
   std::cout << "\n========================================\n";
   std::cout << "Benchmark completed!\n";
   std::cout << "========================================\n";
-
-  return 0;
+  return status;
 }
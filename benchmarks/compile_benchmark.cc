@@ -0,0 +1,295 @@
+// compile_benchmark.cc - Pattern compilation throughput for Amarantine
+//
+// Measures how fast patterns go from source text to bytecode, which bounds
+// rule-reload latency. Every workload is registered with the harness in
+// bench_harness.h once per stage, as "<workload>/<stage>":
+//   tokenize - Lexer::tokenize (reference only; the parser now reads tokens lazily)
+//   parse    - Parser::parse into an ASTArena
+//   compile  - Compiler::compile from a prebuilt AST
+//   total    - Regex construction end to end
+// One iteration handles every pattern of the workload. After the harness
+// table comes a per-pattern summary: time, patterns/sec, program bytes and
+// heap allocations, counted by the operator new replacement in
+// alloc_count.h. Run with --help for filtering, JSON output and baseline
+// comparison; an optional CORPUS_SIZE sets the size of the rule corpus.
+#include "amaranth/amaranth.h"
+
+#ifndef AMARANTH_COUNT_ALLOCATIONS
+#define AMARANTH_COUNT_ALLOCATIONS 1
+#endif
+#include "bench_harness.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace amaranth;
+
+// ============================================================================
+// Workloads
+// ============================================================================
+struct Workload {
+  std::string name;  // Case name prefix
+  std::vector<std::string> patterns;
+};
+
+// Literal of `size` characters
+Workload literal_workload(size_t size) {
+  std::string pattern;
+  for (size_t i = 0; i < size; ++i) {
+    pattern += static_cast<char>('a' + i % 26);
+  }
+  return {"literal_" + std::to_string(size), {pattern}};
+}
+
+// `groups` capture groups separated by literals
+Workload group_workload(int groups) {
+  std::string pattern;
+  for (int i = 0; i < groups; ++i) {
+    pattern += R"((\d+)-)";
+  }
+  return {"groups_" + std::to_string(groups), {pattern}};
+}
+
+// Alternation of `width` keywords
+Workload alternation_workload(int width) {
+  std::string pattern;
+  for (int i = 0; i < width; ++i) {
+    if (i > 0)
+      pattern += '|';
+    pattern += "kw" + std::to_string(i) + "_tok";
+  }
+  return {"alternation_" + std::to_string(width), {pattern}};
+}
+
+// A deterministic corpus of rules shaped like production extraction and
+// classification rules. The seed is fixed so every run compiles the same set.
+Workload rule_corpus(size_t count) {
+  static const char* words[] = {"error",  "warn",    "fatal", "panic",   "timeout", "denied",
+                                "user",   "session", "token", "request", "upload",  "login",
+                                "logout", "cache",   "proxy", "gateway", "retry",   "abort"};
+  static const char* fields[] = {"id", "uid", "host", "path", "status", "bytes", "ref", "agent"};
+  const size_t num_words = sizeof(words) / sizeof(words[0]);
+  const size_t num_fields = sizeof(fields) / sizeof(fields[0]);
+
+  std::mt19937 gen(20240115);
+  auto pick = [&](size_t n) { return static_cast<size_t>(gen() % n); };
+
+  Workload w{"rule_corpus", {}};
+  w.patterns.reserve(count);
+  for (size_t i = 0; i < count; ++i) {
+    std::string p;
+    switch (pick(8)) {
+      case 0: {  // Keyword classification
+        p = "(?:";
+        size_t n = 2 + pick(10);
+        for (size_t k = 0; k < n; ++k) {
+          if (k > 0)
+            p += '|';
+          p += words[pick(num_words)];
+        }
+        p += ")";
+        break;
+      }
+      case 1:  // key=value extraction
+        p = std::string(fields[pick(num_fields)]) + R"(=([-\w.]+))";
+        break;
+      case 2:
+        p = R"((\d+)\.(\d+)\.(\d+)\.(\d+))";
+        break;
+      case 3:
+        p = R"([-\w.+]+@[-\w]+\.[a-z]+)";
+        break;
+      case 4:
+        p = R"((\d{4})-(\d{2})-(\d{2})T(\d{2}):(\d{2}):(\d{2}))";
+        break;
+      case 5:
+        p = std::string("/api/v\\d+/") + words[pick(num_words)] + R"(/(\d+)(?:/[a-z]+)*)";
+        break;
+      case 6:
+        p = R"("(GET|POST|PUT|DELETE)\s/[^\s"]*\sHTTP/1\.[01]"\s(\d+))";
+        break;
+      default:
+        p = std::string(words[pick(num_words)]) + R"(\s*[:=]\s*([^\r\n;]+);?)";
+        break;
+    }
+    w.patterns.push_back(p);
+  }
+  return w;
+}
+
+// ============================================================================
+// Registration
+// ============================================================================
+const char* const STAGES[] = {"tokenize", "parse", "compile", "total"};
+
+// A workload with the ASTs the compile stage starts from
+struct Prepared {
+  Workload workload;
+  std::vector<ASTArena> arenas;
+  std::vector<NodeId> roots;
+  std::vector<int> captures;
+  size_t chars = 0;
+  size_t programBytes = 0;
+
+  explicit Prepared(Workload w)
+      : workload(std::move(w)),
+        arenas(workload.patterns.size()),
+        roots(workload.patterns.size()),
+        captures(workload.patterns.size()) {
+    for (size_t i = 0; i < workload.patterns.size(); ++i) {
+      const std::string& p = workload.patterns[i];
+      chars += p.length();
+      Parser parser(p, arenas[i]);
+      roots[i] = parser.parse();
+      captures[i] = parser.numCaptures();
+      Compiler compiler;
+      programBytes +=
+          compiler.compile(arenas[i], roots[i], captures[i]).size() * sizeof(Instruction);
+    }
+  }
+};
+
+void add_stages(bench::Harness& h, const Prepared& w) {
+  const std::vector<std::string>& patterns = w.workload.patterns;
+  const std::string& name = w.workload.name;
+  h.add(
+      name + "/tokenize",
+      [&patterns]() {
+        size_t tokens = 0;
+        for (const auto& p : patterns) {
+          Lexer lexer(p);
+          tokens += lexer.tokenize().size();
+        }
+        return tokens;
+      },
+      w.chars);
+  h.add(
+      name + "/parse",
+      [&patterns]() {
+        size_t nodes = 0;
+        for (const auto& p : patterns) {
+          ASTArena arena;
+          arena.reserve(p.length());
+          Parser parser(p, arena);
+          parser.parse();
+          nodes += arena.size();
+        }
+        return nodes;
+      },
+      w.chars);
+  h.add(
+      name + "/compile",
+      [&w]() {
+        size_t size = 0;
+        for (size_t i = 0; i < w.arenas.size(); ++i) {
+          Compiler compiler;
+          size += compiler.compile(w.arenas[i], w.roots[i], w.captures[i]).size();
+        }
+        return size;
+      },
+      w.chars);
+  h.add(
+      name + "/total",
+      [&patterns]() {
+        size_t compiled = 0;
+        for (const auto& p : patterns) {
+          Regex re(p);
+          compiled += re.isCompiled();
+        }
+        return compiled;
+      },
+      w.chars);
+}
+
+// The harness figures are per iteration; this divides them by the number of
+// patterns in the workload
+void print_per_pattern(const bench::Harness& h, const std::vector<Prepared>& prepared) {
+  std::printf("\nPer pattern\n");
+  std::printf("%-28s %8s %10s %12s %10s %8s %10s\n", "benchmark", "chars", "program B", "time",
+              "pat/s", "allocs", "alloc B");
+  for (const Prepared& w : prepared) {
+    double n = static_cast<double>(w.workload.patterns.size());
+    for (const char* stage : STAGES) {
+      const bench::Result* r = h.find(w.workload.name + "/" + stage);
+      if (!r)
+        continue;
+      double ns = r->medianNs / n;
+      std::printf("%-28s %8.1f %10.1f %12s %10.0f %8.1f %10.0f\n", r->name.c_str(), w.chars / n,
+                  w.programBytes / n, bench::formatNs(ns).c_str(), ns > 0 ? 1e9 / ns : 0,
+                  r->allocations / n, r->allocatedBytes / n);
+    }
+  }
+}
+
+static void usage(const char* argv0) {
+  std::cerr << "usage: " << argv0 << " [CORPUS_SIZE > 0] [harness options]\n";
+}
+
+int main(int argc, char* argv[]) {
+  size_t corpus_size = 3000;
+  // Arguments left for bench::Harness
+  std::vector<char*> rest = {argv[0]};
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--help") == 0 || std::strcmp(argv[i], "-h") == 0) {
+      usage(argv[0]);
+      rest.push_back(argv[i]);
+    } else if (argv[i][0] != '-') {
+      corpus_size = std::strtoul(argv[i], nullptr, 10);
+      if (corpus_size == 0) {
+        usage(argv[0]);
+        return 2;
+      }
+    } else {
+      rest.push_back(argv[i]);
+    }
+  }
+  bench::Harness harness(static_cast<int>(rest.size()), rest.data());
+  bool summary = harness.options().compareBase.empty() && !harness.options().list &&
+                 !harness.options().latency;
+
+  std::vector<Workload> workloads;
+  for (size_t size : {16, 64, 256, 1024, 4096}) {
+    workloads.push_back(literal_workload(size));
+  }
+  for (int groups : {1, 4, 16, 64, 200}) {
+    workloads.push_back(group_workload(groups));
+  }
+  for (int width : {2, 8, 32, 128, 512}) {
+    workloads.push_back(alternation_workload(width));
+  }
+  workloads.push_back(rule_corpus(corpus_size));
+
+  if (summary) {
+    std::cout << "========================================\n";
+    std::cout << "  Amarantine Compile Benchmark\n";
+    std::cout << "========================================\n\n";
+  }
+
+  // The registered cases refer to these, so they must not move
+  std::vector<Prepared> prepared;
+  prepared.reserve(workloads.size());
+  for (auto& w : workloads) {
+    bool wanted = false;
+    for (const char* stage : STAGES)
+      wanted = wanted || harness.selected(w.name + "/" + stage);
+    if (!wanted)
+      continue;
+    prepared.emplace_back(std::move(w));
+    add_stages(harness, prepared.back());
+  }
+
+  int status = harness.run();
+  if (!summary)
+    return status;
+  print_per_pattern(harness, prepared);
+
+  std::cout << "\n========================================\n";
+  std::cout << "Benchmark completed!\n";
+  std::cout << "========================================\n";
+  return status;
+}
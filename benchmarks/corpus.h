@@ -0,0 +1,190 @@
+// corpus.h - Deterministic haystacks for the Amarantine benchmarks
+//
+// Every generator is driven by a seeded std::mt19937 and only uses its raw
+// output (distributions are implementation-defined), so a given seed and
+// size produce the same bytes on every platform and standard library. That
+// is what lets the corpus benchmark hard-code expected match counts.
+#pragma once
+
+#include <cstdint>
+#include <random>
+#include <string>
+
+namespace corpus {
+
+class Generator {
+ public:
+  explicit Generator(uint32_t seed) : rng_(seed) {}
+
+  size_t below(size_t n) {
+    return static_cast<size_t>(rng_() % n);
+  }
+
+  template <size_t N>
+  const char* pick(const char* const (&items)[N]) {
+    return items[below(N)];
+  }
+
+  std::string digits(size_t minLen, size_t maxLen) {
+    std::string out;
+    size_t len = minLen + below(maxLen - minLen + 1);
+    for (size_t i = 0; i < len; ++i)
+      out += static_cast<char>('0' + below(10));
+    return out;
+  }
+
+  std::string hex(size_t len) {
+    static const char table[] = "0123456789abcdef";
+    std::string out;
+    for (size_t i = 0; i < len; ++i)
+      out += table[below(16)];
+    return out;
+  }
+
+ private:
+  std::mt19937 rng_;
+};
+
+// Combined log format lines as written by Apache and nginx
+inline std::string accessLog(size_t bytes, uint32_t seed = 1) {
+  static const char* const methods[] = {"GET", "GET", "GET", "POST", "PUT", "DELETE", "HEAD"};
+  static const char* const paths[] = {"/",               "/index.html",    "/api/v1/users",
+                                      "/api/v1/orders",  "/static/app.js", "/login",
+                                      "/search",         "/img/logo.png"};
+  static const char* const statuses[] = {"200", "200", "200", "200", "304", "404", "500", "301"};
+  static const char* const agents[] = {
+      "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 Chrome/120.0 Safari/537.36",
+      "Mozilla/5.0 (Windows NT 10.0; Win64; x64) Gecko/20100101 Firefox/121.0",
+      "curl/8.4.0", "Googlebot/2.1 (+http://www.google.com/bot.html)"};
+  static const char* const months[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                       "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+  Generator g(seed);
+  std::string out;
+  while (out.size() < bytes) {
+    out += std::to_string(1 + g.below(254)) + "." + std::to_string(g.below(256)) + "." +
+           std::to_string(g.below(256)) + "." + std::to_string(1 + g.below(254));
+    out += " - - [" + std::to_string(10 + g.below(18)) + "/" + g.pick(months) + "/2024:";
+    out += std::to_string(10 + g.below(14)) + ":" + std::to_string(10 + g.below(50)) + ":" +
+           std::to_string(10 + g.below(50)) + " +0000] \"";
+    out += std::string(g.pick(methods)) + " " + g.pick(paths);
+    if (g.below(3) == 0)
+      out += "?id=" + g.digits(1, 6);
+    out += " HTTP/1.1\" " + std::string(g.pick(statuses)) + " " + g.digits(2, 6);
+    out += " \"-\" \"" + std::string(g.pick(agents)) + "\"\n";
+  }
+  return out;
+}
+
+// One JSON object per line, as emitted by structured loggers
+inline std::string jsonLines(size_t bytes, uint32_t seed = 2) {
+  static const char* const users[] = {"alice", "bob", "carol", "dave", "erin", "frank", "grace"};
+  static const char* const levels[] = {"info", "info", "info", "warn", "error", "debug"};
+  static const char* const tags[] = {"auth", "db", "cache", "http", "queue", "billing"};
+  Generator g(seed);
+  std::string out;
+  while (out.size() < bytes) {
+    out += "{\"id\":" + g.digits(1, 9) + ",\"level\":\"" + g.pick(levels) + "\",\"user\":\"" +
+           g.pick(users) + "\",\"trace\":\"" + g.hex(16) + "\",\"latency_ms\":" + g.digits(1, 4) +
+           "." + g.digits(1, 3) + ",\"ok\":" + (g.below(5) ? "true" : "false") + ",\"tags\":[";
+    size_t n = g.below(4);
+    for (size_t i = 0; i < n; ++i)
+      out += std::string(i ? "," : "") + "\"" + g.pick(tags) + "\"";
+    out += "]}\n";
+  }
+  return out;
+}
+
+// C-like source code assembled from statement templates
+inline std::string sourceCode(size_t bytes, uint32_t seed = 3) {
+  static const char* const types[] = {"int", "size_t", "uint32_t", "double", "char*", "bool"};
+  static const char* const names[] = {"count", "index", "buffer", "length", "result", "offset",
+                                      "total", "value", "node",   "cursor"};
+  static const char* const calls[] = {"memcpy", "strlen", "malloc", "free", "printf", "assert"};
+  Generator g(seed);
+  std::string out;
+  while (out.size() < bytes) {
+    std::string fn = std::string(g.pick(names)) + "_" + g.pick(names);
+    out += "static " + std::string(g.pick(types)) + " " + fn + "(" + g.pick(types) + " " +
+           g.pick(names) + ") {\n";
+    size_t statements = 2 + g.below(6);
+    for (size_t i = 0; i < statements; ++i) {
+      switch (g.below(5)) {
+        case 0:
+          out += "  " + std::string(g.pick(types)) + " " + g.pick(names) + " = " + g.digits(1, 4) +
+                 ";\n";
+          break;
+        case 1:
+          out += "  for (int i = 0; i < " + std::string(g.pick(names)) + "; ++i) {\n    " +
+                 g.pick(names) + " += i;\n  }\n";
+          break;
+        case 2:
+          out += "  if (" + std::string(g.pick(names)) + " == NULL) {\n    return -1;\n  }\n";
+          break;
+        case 3:
+          out += "  " + std::string(g.pick(calls)) + "(" + g.pick(names) + ");  // " +
+                 g.pick(names) + "\n";
+          break;
+        default:
+          out += "  while (" + std::string(g.pick(names)) + " > 0x" + g.hex(4) + ") " +
+                 g.pick(names) + "--;\n";
+          break;
+      }
+    }
+    out += "  return " + std::string(g.pick(names)) + ";\n}\n\n";
+  }
+  return out;
+}
+
+// English-like prose: sentences of common words with occasional names
+inline std::string prose(size_t bytes, uint32_t seed = 4) {
+  static const char* const words[] = {
+      "the",    "of",    "and",    "to",      "a",      "in",     "that",   "it",    "was",
+      "he",     "for",   "on",     "are",     "as",     "with",   "his",    "they",  "at",
+      "be",     "this",  "from",   "have",    "or",     "by",     "one",    "had",   "not",
+      "but",    "what",  "all",    "were",    "when",   "we",     "there",  "can",   "an",
+      "your",   "which", "their",  "said",    "if",     "do",     "will",   "each",  "about",
+      "how",    "up",    "out",    "them",    "then",   "she",    "many",   "some",  "so",
+      "these",  "would", "other",  "into",    "has",    "more",   "her",    "two",   "like",
+      "him",    "see",   "time",   "could",   "no",     "make",   "than",   "first", "been",
+      "river",  "light", "garden", "morning", "window", "letter", "silence", "road", "winter"};
+  static const char* const names[] = {"Holmes", "Watson", "Elizabeth", "Darcy", "Ishmael"};
+  Generator g(seed);
+  std::string out;
+  while (out.size() < bytes) {
+    size_t length = 6 + g.below(14);
+    for (size_t i = 0; i < length; ++i) {
+      std::string word = g.below(25) == 0 ? g.pick(names) : g.pick(words);
+      if (i == 0 && word[0] >= 'a' && word[0] <= 'z')
+        word[0] = static_cast<char>(word[0] - 'a' + 'A');
+      out += (i ? " " : "") + word;
+      if (i + 1 < length && g.below(9) == 0)
+        out += ",";
+    }
+    out += g.below(8) == 0 ? "?\n" : ". ";
+  }
+  return out;
+}
+
+// Random bytes with short printable runs, like an executable or archive.
+// Every 4096 bytes carries one "MAGIC" marker at a random offset.
+inline std::string binaryBlob(size_t bytes, uint32_t seed = 5) {
+  Generator g(seed);
+  std::string out;
+  out.reserve(bytes);
+  while (out.size() < bytes) {
+    if (g.below(8) == 0) {
+      size_t run = 3 + g.below(12);
+      for (size_t i = 0; i < run; ++i)
+        out += static_cast<char>('a' + g.below(26));
+    } else {
+      out += static_cast<char>(g.below(256));
+    }
+  }
+  out.resize(bytes);
+  for (size_t block = 0; block + 4096 <= bytes; block += 4096) {
+    out.replace(block + g.below(4096 - 5), 5, "MAGIC");
+  }
+  return out;
+}
+
+}  // namespace corpus
@@ -0,0 +1,193 @@
+// corpus_benchmark.cc - Match counting over realistic, reproducible haystacks
+//
+// Each workload is a (pattern, haystack, expected count) triple: the number
+// of non-overlapping matches a leftmost-first scan finds. Haystacks come
+// from the seeded generators in corpus.h, so counts are fixed and every
+// engine is checked against them before it is timed; a wrong count is
+// reported as a MISMATCH and makes the run exit 1. Workloads cover literal,
+// class-heavy, capture-heavy, alternation-heavy and no-match searches over
+// access logs, JSON lines, source code, prose and binary data. Cases are
+// named "<corpus>/<workload>/<engine>"; see bench_harness.h for options.
+#include "amaranth/amaranth.h"
+
+#include "bench_harness.h"
+#include "corpus.h"
+
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#define USE_STD_REGEX 1
+#ifdef USE_STD_REGEX
+#include <regex>
+#endif
+
+#ifdef HAVE_RE2
+#include <re2/re2.h>
+#endif
+
+#ifdef HAVE_PCRE2
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+#endif
+
+using namespace amaranth;
+
+// Size of every haystack
+static const size_t CORPUS_BYTES = 64 * 1024;
+
+struct Workload {
+  const char* corpus;
+  const char* name;
+  const char* kind;  // literal, class, capture, alternation or no-match
+  const char* pattern;
+  size_t expected;
+};
+
+// Patterns avoid literal spaces and '.', which engines treat differently
+// (free-spacing and newline handling), so every engine agrees on the count
+static const Workload WORKLOADS[] = {
+    {"log", "literal", "literal", "Mozilla", 228},
+    {"log", "ipv4", "capture", R"((\d+)\.(\d+)\.(\d+)\.(\d+))", 464},
+    {"log", "method", "alternation", R"("(GET|POST|PUT|DELETE|HEAD)\s)", 464},
+    {"log", "not-found", "literal", R"("\s404\s)", 68},
+    {"json", "key-number", "capture", R"re("(\w+)":(\d+))re", 1094},
+    {"json", "trace-id", "class", R"([0-9a-f]{16})", 547},
+    {"json", "level", "alternation", R"re("(info|warn|error|debug)")re", 547},
+    {"code", "keyword", "alternation", "for|while|if|return|static", 1635},
+    {"code", "identifier", "class", "[A-Za-z_][A-Za-z0-9_]*", 7541},
+    {"code", "hex-literal", "class", "0x[0-9a-f]+", 257},
+    {"prose", "word", "class", "[A-Za-z]+", 13416},
+    {"prose", "name", "alternation", "Holmes|Watson|Elizabeth|Darcy|Ishmael", 531},
+    {"prose", "capitalized", "class", "[A-Z][a-z]+", 1550},
+    {"prose", "absent", "no-match", "zebra", 0},
+    {"binary", "magic", "literal", "MAGIC", 16},
+    {"binary", "text-run", "class", "[a-z]{8}", 2757},
+    {"binary", "absent", "no-match", "QQQQQ", 0},
+};
+
+static const std::string& haystack(const std::string& corpus) {
+  static std::map<std::string, std::string> cache;
+  auto it = cache.find(corpus);
+  if (it != cache.end())
+    return it->second;
+  std::string text;
+  if (corpus == "log")
+    text = corpus::accessLog(CORPUS_BYTES);
+  else if (corpus == "json")
+    text = corpus::jsonLines(CORPUS_BYTES);
+  else if (corpus == "code")
+    text = corpus::sourceCode(CORPUS_BYTES);
+  else if (corpus == "prose")
+    text = corpus::prose(CORPUS_BYTES);
+  else
+    text = corpus::binaryBlob(CORPUS_BYTES);
+  return cache.emplace(corpus, std::move(text)).first->second;
+}
+
+// ============================================================================
+// Counting per engine
+// ============================================================================
+static size_t mismatches = 0;
+
+// Run `count` once to check it, then register it for timing
+template <typename Count>
+void add(bench::Harness& h, const Workload& w, const char* engine, Count count) {
+  std::string name = std::string(w.corpus) + "/" + w.name + "/" + engine;
+  if (!h.selected(name))
+    return;
+  size_t got = count();
+  if (got != w.expected) {
+    std::cout << "MISMATCH " << name << ": expected " << w.expected << ", got " << got << "\n";
+    ++mismatches;
+  }
+  h.add(name, count, haystack(w.corpus).size());
+}
+
+void add_amarantine(bench::Harness& h, const Workload& w, const std::string& text) {
+  for (Engine engine : {Engine::BACKTRACKING, Engine::LINEAR}) {
+    auto re = std::make_shared<Regex>(w.pattern);
+    re->setEngine(engine);
+    add(h, w, engine == Engine::LINEAR ? "amarantine-linear" : "amarantine",
+        [re, &text]() { return re->searchAll(text).size(); });
+  }
+}
+
+#ifdef USE_STD_REGEX
+void add_std(bench::Harness& h, const Workload& w, const std::string& text) {
+  auto re = std::make_shared<std::regex>(w.pattern);
+  add(h, w, "std", [re, &text]() {
+    return static_cast<size_t>(
+        std::distance(std::sregex_iterator(text.begin(), text.end(), *re), std::sregex_iterator()));
+  });
+}
+#endif
+
+#ifdef HAVE_RE2
+void add_re2(bench::Harness& h, const Workload& w, const std::string& text) {
+  auto re = std::make_shared<RE2>(w.pattern, RE2::Quiet);
+  if (!re->ok())
+    return;
+  add(h, w, "re2", [re, &text]() {
+    re2::StringPiece input(text);
+    size_t n = 0;
+    while (RE2::FindAndConsume(&input, *re))
+      ++n;
+    return n;
+  });
+}
+#endif
+
+#ifdef HAVE_PCRE2
+void add_pcre2(bench::Harness& h, const Workload& w, const std::string& text) {
+  int errorcode;
+  PCRE2_SIZE erroroffset;
+  pcre2_code* code = pcre2_compile(reinterpret_cast<PCRE2_SPTR>(w.pattern), PCRE2_ZERO_TERMINATED,
+                                   0, &errorcode, &erroroffset, NULL);
+  if (!code)
+    return;
+  std::shared_ptr<pcre2_code> re(code, pcre2_code_free);
+  std::shared_ptr<pcre2_match_data> data(pcre2_match_data_create_from_pattern(code, NULL),
+                                         pcre2_match_data_free);
+  add(h, w, "pcre2", [re, data, &text]() {
+    size_t n = 0;
+    PCRE2_SIZE offset = 0;
+    while (offset <= text.size() &&
+           pcre2_match(re.get(), reinterpret_cast<PCRE2_SPTR>(text.data()), text.size(), offset, 0,
+                       data.get(), NULL) > 0) {
+      PCRE2_SIZE* ovector = pcre2_get_ovector_pointer(data.get());
+      ++n;
+      offset = ovector[1] > ovector[0] ? ovector[1] : ovector[0] + 1;
+    }
+    return n;
+  });
+}
+#endif
+
+int main(int argc, char* argv[]) {
+  bench::Harness harness(argc, argv);
+
+  for (const Workload& w : WORKLOADS) {
+    const std::string& text = haystack(w.corpus);
+    add_amarantine(harness, w, text);
+#ifdef USE_STD_REGEX
+    add_std(harness, w, text);
+#endif
+#ifdef HAVE_RE2
+    add_re2(harness, w, text);
+#endif
+#ifdef HAVE_PCRE2
+    add_pcre2(harness, w, text);
+#endif
+  }
+
+  int status = harness.run();
+  if (mismatches) {
+    std::cout << "\n" << mismatches << " engine(s) returned the wrong match count\n";
+    return 1;
+  }
+  return status;
+}
@@ -0,0 +1,551 @@
+// perf_fuzzer.cc - Search for inputs that make a pattern slow
+//
+// The objective is the instruction count MatchStats reports for one search,
+// divided by the input length: a rule that needs thousands of instructions
+// per byte on some input is a backtracking cliff an attacker can find too.
+//
+// Offline (the default build) the program is its own fuzzer. Per rule it
+// keeps a small population of inputs and mutates them (byte edits, repeating
+// a slice, splicing two inputs, and with --mutate-patterns the pattern
+// itself), keeping whatever scores higher, for --iterations rounds or
+// --seconds, whichever ends first:
+//   perf_fuzzer [--rules=FILE] [--engine=auto|backtracking|linear]
+//               [--iterations=N] [--seconds=S] [--max-len=N] [--seed=N]
+//               [--mutate-patterns] [--save=FILE]
+// --save appends the worst input of every rule to FILE. Saved cases are
+// regression benchmarks:
+//   perf_fuzzer --replay=FILE [--check] [harness options]
+// re-counts the instructions of each case, exits 1 when one needs more than
+// 10% over what was recorded, and unless --check is given times them with
+// bench::Harness (so --json, --baseline and --filter work as usual).
+//
+// Built with -DAMARANTH_LIBFUZZER=ON (clang) the same objective drives
+// libFuzzer: its log2 bucket is reported through extra coverage counters, so
+// libFuzzer keeps inputs that reach a new level of slowness, and an input
+// over AMARANTH_FUZZ_MAX_COST instructions per byte (default 5000) aborts,
+// which makes libFuzzer save it as a crash. Rules come from the file named
+// by AMARANTH_FUZZ_RULES, one per line, or the built-in set; with
+// AMARANTH_FUZZ_PATTERNS=1 each input is "pattern\0subject" instead.
+#include "amaranth/amaranth.h"
+
+#ifndef AMARANTH_LIBFUZZER
+#include "bench_harness.h"
+#endif
+#include "corpus.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace amaranth;
+
+// Validation and log rules of the kind services run on untrusted input,
+// including well-known cliffs
+static const char* const DEFAULT_RULES[] = {
+    R"((\d+)\.(\d+)\.(\d+)\.(\d+))",
+    R"("(GET|POST|PUT|DELETE|HEAD)\s)",
+    R"(/api/v1/(\w+))",
+    R"([\w.+\-]+@[\w.\-]+\.[a-zA-Z]{2,})",
+    R"(^([a-zA-Z0-9_.+\-])+@(([a-zA-Z0-9\-])+\.)+([a-zA-Z0-9]{2,4})+$)",
+    R"(^(\w+\s?)*$)",
+    R"(^(\d+|\d+\.\d+)*x$)",
+    R"(<(\w+)(\s\w+="[^"]*")*>)",
+    R"(^(/[\w.\-]+)+/?$)",
+    R"(key=(.*),(.*)$)",
+};
+
+// Instructions per search are capped so one cliff cannot stall the run
+static const uint64_t MAX_STEPS = 1 << 20;
+
+struct Score {
+  uint64_t instructions = 0;
+  bool capped = false;  // Hit MAX_STEPS; the real cost is higher
+
+  double perByte(size_t length) const {
+    return static_cast<double>(instructions) / static_cast<double>(length + 1);
+  }
+};
+
+static Score evaluate(Regex& re, const std::string& input) {
+  MatchStats stats;
+  MatchOptions options;
+  options.stats = &stats;
+  options.maxSteps = MAX_STEPS;
+  MatchResult result;
+  Score score;
+  score.capped = re.search(input, result, options) == MatchStatus::BUDGET_EXCEEDED;
+  score.instructions = stats.instructions;
+  return score;
+}
+
+// Compiled patterns by source; nullptr for ones that do not compile
+class PatternCache {
+ public:
+  explicit PatternCache(Engine engine) : engine_(engine) {}
+
+  Regex* get(const std::string& pattern) {
+    auto it = cache_.find(pattern);
+    if (it != cache_.end())
+      return it->second.get();
+    if (cache_.size() > 4096)
+      cache_.clear();
+    std::unique_ptr<Regex> re;
+    try {
+      re = std::make_unique<Regex>(pattern);
+      re->setEngine(engine_);
+    } catch (const RegexError&) {
+    }
+    return cache_.emplace(pattern, std::move(re)).first->second.get();
+  }
+
+ private:
+  Engine engine_;
+  std::map<std::string, std::unique_ptr<Regex>> cache_;
+};
+
+static std::vector<std::string> readRules(const char* path) {
+  std::vector<std::string> rules;
+  if (!path) {
+    rules.assign(std::begin(DEFAULT_RULES), std::end(DEFAULT_RULES));
+    return rules;
+  }
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line))
+    if (!line.empty() && line[0] != '#')
+      rules.push_back(line);
+  return rules;
+}
+
+// ============================================================================
+// libFuzzer target
+// ============================================================================
+#ifdef AMARANTH_LIBFUZZER
+
+// One counter per log2 bucket of instructions per byte; libFuzzer treats a
+// counter that becomes non-zero as new coverage
+__attribute__((used, section("__libfuzzer_extra_counters"))) static uint8_t g_costLevels[64];
+
+static std::vector<std::string> g_rules;
+static std::unique_ptr<PatternCache> g_patterns;
+static double g_maxCost = 5000;
+static bool g_fuzzPatterns = false;
+
+static void report(const std::string& pattern, const std::string& input, const Score& score) {
+  double cost = score.perByte(input.size());
+  g_costLevels[std::min<size_t>(63, static_cast<size_t>(std::log2(cost + 1) * 2))] = 1;
+  if (cost > g_maxCost || score.capped) {
+    std::fprintf(stderr, "slow input: /%s/ costs %.0f instructions per byte over %zu bytes\n",
+                 pattern.c_str(), cost, input.size());
+    std::abort();
+  }
+}
+
+extern "C" int LLVMFuzzerInitialize(int*, char***) {
+  g_rules = readRules(std::getenv("AMARANTH_FUZZ_RULES"));
+  g_patterns = std::make_unique<PatternCache>(Engine::AUTO);
+  if (const char* v = std::getenv("AMARANTH_FUZZ_MAX_COST"))
+    g_maxCost = std::atof(v);
+  if (const char* v = std::getenv("AMARANTH_FUZZ_PATTERNS"))
+    g_fuzzPatterns = std::atoi(v) != 0;
+  return 0;
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size) {
+  std::string bytes(reinterpret_cast<const char*>(data), size);
+  if (g_fuzzPatterns) {
+    size_t nul = bytes.find('\0');
+    if (nul == std::string::npos)
+      return 0;
+    std::string pattern = bytes.substr(0, nul);
+    std::string input = bytes.substr(nul + 1);
+    if (Regex* re = g_patterns->get(pattern))
+      report(pattern, input, evaluate(*re, input));
+    return 0;
+  }
+  for (const std::string& rule : g_rules)
+    if (Regex* re = g_patterns->get(rule))
+      report(rule, bytes, evaluate(*re, bytes));
+  return 0;
+}
+
+#else
+
+// ============================================================================
+// Offline fuzzer
+// ============================================================================
+struct Options {
+  const char* rulesPath = nullptr;
+  Engine engine = Engine::AUTO;
+  uint64_t iterations = 20000;  // Per rule
+  double seconds = 5;           // Per rule, whichever runs out first
+  size_t maxLen = 256;
+  uint32_t seed = 1;
+  bool mutatePatterns = false;
+  std::string savePath;
+  std::string replayPath;
+  bool check = false;
+};
+
+struct Candidate {
+  std::string pattern;
+  std::string input;
+  Score score;
+  double cost = 0;        // Instructions per byte
+  int patternEdits = 0;   // Mutations applied to the rule to get `pattern`
+};
+
+class Fuzzer {
+ public:
+  Fuzzer(const Options& options, PatternCache& patterns)
+      : options_(options), patterns_(patterns), random_(options.seed) {}
+
+  // Best input found for `rule`, which must compile. Stops early once an
+  // input hits MAX_STEPS, since nothing can score higher.
+  Candidate run(const std::string& rule) {
+    population_.clear();
+    alphabet_ = alphabetOf(rule);
+    for (const std::string& seed : {std::string(), alphabet_, rule})
+      consider(rule, 0, seed.substr(0, options_.maxLen));
+    auto deadline = std::chrono::steady_clock::now() +
+                    std::chrono::duration<double>(options_.seconds);
+    for (uint64_t i = 0; i < options_.iterations && !population_.front().score.capped; ++i) {
+      if (i % 64 == 0 && std::chrono::steady_clock::now() > deadline)
+        break;
+      const Candidate& parent = population_[random_.below(population_.size())];
+      std::string pattern = parent.pattern;
+      int edits = parent.patternEdits;
+      std::string input = parent.input;
+      // A few edits away from the rule at most; further out any pattern can
+      // be made slow, which says nothing about the rule
+      if (options_.mutatePatterns && edits < MAX_PATTERN_EDITS && random_.below(5) == 0) {
+        pattern = mutatePattern(pattern);
+        ++edits;
+      }
+      for (size_t n = 1 + random_.below(3); n > 0; --n)
+        mutate(input);
+      if (input.size() > options_.maxLen)
+        input.resize(options_.maxLen);
+      consider(pattern, edits, input);
+    }
+    return population_.front();
+  }
+
+ private:
+  static const size_t POPULATION = 16;
+  static const int MAX_PATTERN_EDITS = 2;
+
+  // Keep the candidate if it beats the weakest one; the population stays
+  // sorted, best first
+  void consider(const std::string& pattern, int edits, const std::string& input) {
+    Regex* re = patterns_.get(pattern);
+    if (!re)
+      return;
+    Candidate c{pattern, input, evaluate(*re, input), 0, edits};
+    c.cost = c.score.perByte(input.size());
+    if (population_.size() == POPULATION) {
+      if (c.cost <= population_.back().cost)
+        return;
+      population_.pop_back();
+    }
+    auto at = std::upper_bound(
+        population_.begin(), population_.end(), c,
+        [](const Candidate& a, const Candidate& b) { return a.cost > b.cost; });
+    population_.insert(at, std::move(c));
+  }
+
+  // Literal bytes of the pattern plus a few separators; class members the
+  // pattern only names (\d, a-z) come in through the range ends
+  static std::string alphabetOf(const std::string& pattern) {
+    std::string out;
+    for (char c : pattern + "a0 _-.@/!\n")
+      if (out.find(c) == std::string::npos && !std::strchr("()[]{}*+?|^$\\", c))
+        out += c;
+    return out;
+  }
+
+  char randomByte() {
+    if (random_.below(8) == 0)
+      return static_cast<char>(random_.below(256));
+    return alphabet_[random_.below(alphabet_.size())];
+  }
+
+  void mutate(std::string& s) {
+    size_t at = s.empty() ? 0 : random_.below(s.size() + 1);
+    switch (random_.below(s.empty() ? 1 : 6)) {
+      case 0:  // Insert a byte
+        s.insert(s.begin() + at, randomByte());
+        break;
+      case 1:  // Replace a byte
+        s[std::min(at, s.size() - 1)] = randomByte();
+        break;
+      case 2:  // Erase a short slice
+        s.erase(std::min(at, s.size() - 1), 1 + random_.below(4));
+        break;
+      case 3: {  // Repeat a slice, the usual way to pump a cliff
+        size_t begin = random_.below(s.size());
+        size_t len = 1 + random_.below(std::min<size_t>(8, s.size() - begin));
+        std::string slice = s.substr(begin, len);
+        for (size_t n = 1 + random_.below(16); n > 0; --n)
+          s.insert(begin, slice);
+        break;
+      }
+      case 4: {  // Splice in part of another input
+        const std::string& other = population_[random_.below(population_.size())].input;
+        if (!other.empty()) {
+          size_t begin = random_.below(other.size());
+          s.insert(at, other.substr(begin, 1 + random_.below(other.size() - begin)));
+        }
+        break;
+      }
+      default:  // Append a byte, since many cliffs fail on the last one
+        s += randomByte();
+        break;
+    }
+  }
+
+  // Edits that tend to introduce ambiguity; callers drop results that do not
+  // compile
+  std::string mutatePattern(std::string p) {
+    size_t at = random_.below(p.size() + 1);
+    switch (random_.below(4)) {
+      case 0:
+        p.insert(at, random_.below(2) ? "+" : "*");
+        break;
+      case 1: {  // Wrap a slice in a repeated group
+        size_t len = random_.below(p.size() - std::min(at, p.size()) + 1);
+        p = p.substr(0, at) + "(" + p.substr(at, len) + ")+" + p.substr(at + len);
+        break;
+      }
+      case 2: {  // Add an alternative that overlaps the start of the pattern
+        size_t len = 1 + random_.below(std::min<size_t>(4, p.size() + 1));
+        p = "(" + p + "|" + p.substr(0, len) + ")";
+        break;
+      }
+      default: {  // Repeat a slice, as in \d+ -> \d+\d+
+        size_t len = 1 + random_.below(std::min<size_t>(6, p.size() - std::min(at, p.size()) + 1));
+        p.insert(at, p.substr(at, len));
+        break;
+      }
+    }
+    return p;
+  }
+
+  const Options& options_;
+  PatternCache& patterns_;
+  corpus::Generator random_;
+  std::string alphabet_;
+  std::vector<Candidate> population_;
+};
+
+// ============================================================================
+// Saved cases
+// ============================================================================
+
+// Control and non-ASCII bytes become \xHH so each case stays on one line and
+// patterns stay readable; a backslash is only escaped (as \x5c) when an 'x'
+// follows it
+static std::string escape(const std::string& s) {
+  std::string out;
+  for (size_t i = 0; i < s.size(); ++i) {
+    unsigned char c = static_cast<unsigned char>(s[i]);
+    if (c < 0x20 || c >= 0x7f || (c == '\\' && i + 1 < s.size() && s[i + 1] == 'x')) {
+      char buf[8];
+      std::snprintf(buf, sizeof(buf), "\\x%02x", c);
+      out += buf;
+    } else {
+      out += static_cast<char>(c);
+    }
+  }
+  return out;
+}
+
+static std::string unescape(const std::string& s) {
+  std::string out;
+  for (size_t i = 0; i < s.size(); ++i) {
+    if (s[i] == '\\' && i + 3 < s.size() && s[i + 1] == 'x' && std::isxdigit(s[i + 2]) &&
+        std::isxdigit(s[i + 3])) {
+      out += static_cast<char>(std::strtol(s.substr(i + 2, 2).c_str(), nullptr, 16));
+      i += 3;
+    } else {
+      out += s[i];
+    }
+  }
+  return out;
+}
+
+// One case per line: instructions<TAB>pattern<TAB>input
+static void save(const std::string& path, const std::vector<Candidate>& cases) {
+  std::ofstream out(path, std::ios::app);
+  for (const Candidate& c : cases)
+    if (c.score.instructions > 0)
+      out << c.score.instructions << "\t" << escape(c.pattern) << "\t" << escape(c.input) << "\n";
+}
+
+static std::vector<Candidate> load(const std::string& path) {
+  std::vector<Candidate> cases;
+  std::ifstream in(path);
+  std::string line;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#')
+      continue;
+    size_t tab1 = line.find('\t');
+    size_t tab2 = tab1 == std::string::npos ? tab1 : line.find('\t', tab1 + 1);
+    if (tab2 == std::string::npos)
+      continue;
+    Candidate c;
+    c.score.instructions = std::strtoull(line.c_str(), nullptr, 10);
+    c.pattern = unescape(line.substr(tab1 + 1, tab2 - tab1 - 1));
+    c.input = unescape(line.substr(tab2 + 1));
+    cases.push_back(c);
+  }
+  return cases;
+}
+
+// Re-count every saved case, then time them unless `check`
+static int replay(const Options& options, PatternCache& patterns, int argc, char* argv[]) {
+  std::vector<Candidate> cases = load(options.replayPath);
+  if (cases.empty()) {
+    std::cerr << "error: no cases in " << options.replayPath << "\n";
+    return 2;
+  }
+  int regressions = 0;
+  std::printf("%-6s %8s %12s %12s  %s\n", "case", "bytes", "recorded", "now", "pattern");
+  for (size_t i = 0; i < cases.size(); ++i) {
+    const Candidate& c = cases[i];
+    Regex* re = patterns.get(c.pattern);
+    uint64_t now = re ? evaluate(*re, c.input).instructions : 0;
+    bool regressed = now > c.score.instructions + c.score.instructions / 10;
+    std::printf("%-6zu %8zu %12llu %12llu  /%s/%s\n", i, c.input.size(),
+                static_cast<unsigned long long>(c.score.instructions),
+                static_cast<unsigned long long>(now), c.pattern.c_str(),
+                regressed ? "  REGRESSION" : "");
+    regressions += regressed;
+  }
+  if (options.check)
+    return regressions ? 1 : 0;
+
+  std::printf("\n");
+  bench::Harness harness(argc, argv);
+  for (size_t i = 0; i < cases.size(); ++i) {
+    Regex* re = patterns.get(cases[i].pattern);
+    if (!re)
+      continue;
+    const std::string& input = cases[i].input;
+    harness.add(
+        "slow/" + std::to_string(i),
+        [re, &input]() {
+          MatchOptions limits;
+          limits.maxSteps = MAX_STEPS;
+          MatchResult result;
+          return re->search(input, result, limits);
+        },
+        input.size());
+  }
+  int status = harness.run();
+  return regressions ? 1 : status;
+}
+
+static void usage(const char* argv0) {
+  std::cerr << "usage: " << argv0
+            << " [--rules=FILE] [--engine=auto|backtracking|linear] [--iterations=N]\n"
+            << "       [--seconds=S] [--max-len=N] [--seed=N] [--mutate-patterns] [--save=FILE]\n"
+            << "       " << argv0 << " --replay=FILE [--check] [harness options]\n";
+}
+
+int main(int argc, char* argv[]) {
+  Options options;
+  // Arguments left for bench::Harness in --replay mode
+  std::vector<char*> rest = {argv[0]};
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto value = [&](const char* flag) -> const char* {
+      size_t len = std::strlen(flag);
+      if (arg.compare(0, len, flag) == 0 && arg.size() > len && arg[len] == '=')
+        return argv[i] + len + 1;
+      return nullptr;
+    };
+    if (const char* v = value("--rules")) {
+      options.rulesPath = v;
+    } else if (const char* v = value("--engine")) {
+      std::string name = v;
+      if (name == "backtracking") {
+        options.engine = Engine::BACKTRACKING;
+      } else if (name == "linear") {
+        options.engine = Engine::LINEAR;
+      } else if (name != "auto") {
+        usage(argv[0]);
+        return 2;
+      }
+    } else if (const char* v = value("--iterations")) {
+      options.iterations = std::strtoull(v, nullptr, 10);
+    } else if (const char* v = value("--seconds")) {
+      options.seconds = std::max(0.01, std::atof(v));
+    } else if (const char* v = value("--max-len")) {
+      options.maxLen = std::max<size_t>(1, std::strtoull(v, nullptr, 10));
+    } else if (const char* v = value("--seed")) {
+      options.seed = static_cast<uint32_t>(std::strtoul(v, nullptr, 10));
+    } else if (arg == "--mutate-patterns") {
+      options.mutatePatterns = true;
+    } else if (const char* v = value("--save")) {
+      options.savePath = v;
+    } else if (const char* v = value("--replay")) {
+      options.replayPath = v;
+    } else if (arg == "--check") {
+      options.check = true;
+    } else if (arg == "--help" || arg == "-h") {
+      usage(argv[0]);
+      return 0;
+    } else {
+      rest.push_back(argv[i]);
+    }
+  }
+
+  PatternCache patterns(options.engine);
+  if (!options.replayPath.empty())
+    return replay(options, patterns, static_cast<int>(rest.size()), rest.data());
+  if (rest.size() > 1) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  std::vector<std::string> rules = readRules(options.rulesPath);
+  std::printf("Up to %llu iterations or %.1f s per rule, inputs up to %zu bytes\n\n",
+              static_cast<unsigned long long>(options.iterations), options.seconds,
+              options.maxLen);
+  std::printf("%12s %8s %12s  %s\n", "instr/byte", "bytes", "instructions", "pattern");
+  Fuzzer fuzzer(options, patterns);
+  std::vector<Candidate> worst;
+  for (const std::string& rule : rules) {
+    if (!patterns.get(rule)) {
+      std::printf("%12s %8s %12s  /%s/\n", "-", "-", "invalid", rule.c_str());
+      continue;
+    }
+    Candidate c = fuzzer.run(rule);
+    std::printf("%12.1f %8zu %11llu%s  /%s/\n", c.cost, c.input.size(),
+                static_cast<unsigned long long>(c.score.instructions), c.score.capped ? "+" : " ",
+                c.pattern.c_str());
+    std::fflush(stdout);
+    worst.push_back(std::move(c));
+  }
+  if (!options.savePath.empty()) {
+    save(options.savePath, worst);
+    std::cout << "\nWorst cases appended to " << options.savePath << "\n";
+  }
+  return 0;
+}
+
+#endif
@@ -0,0 +1,398 @@
+// redos_benchmark.cc - Worst-case latency on catastrophic backtracking patterns
+//
+// Every case is a pattern known to blow up a backtracking matcher, searched
+// in a text of n pumped characters for growing n. Per engine the benchmark
+// prints the time-vs-length curve and fits its growth order, choosing
+// whichever of O(n^k) and O(c^n) fits the points better. A curve stops
+// where one call takes longer than --budget milliseconds (the forced
+// backtracking engine is cut off through MatchOptions::deadline) or where
+// PCRE2 gives up with its match limit.
+//
+// Each case also states the order Amarantine must stay within in its
+// default mode and on the linear engine; exceeding it makes the run exit 1,
+// so a change that brings catastrophic backtracking back fails here.
+// std::regex is left out: it recurses per character and overflows the stack
+// on the larger inputs instead of finishing.
+#include "amaranth/amaranth.h"
+
+#include "bench_harness.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef HAVE_RE2
+#include <re2/re2.h>
+#endif
+
+#ifdef HAVE_PCRE2
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+#endif
+
+using namespace amaranth;
+
+struct Case {
+  const char* name;
+  const char* pattern;  // "N" inside braces is replaced by n, e.g. "a{N}"
+  const char* pump;     // Repeated n times
+  const char* suffix;   // Appended after the pump so the search fails late
+  double maxOrder;      // Largest polynomial order allowed for Amarantine
+  size_t maxN;          // Largest n for this case, or 0 for --max-n
+};
+
+static const Case CASES[] = {
+    {"nested-quantifier", "(a+)+$", "a", "!", 1.5, 0},
+    {"overlapping-alternation", "(a|a)*b", "a", "", 1.5, 0},
+    {"repeated-dot-star", "(.*a){20}$", "a", "!", 1.5, 0},
+    {"nested-optional", "(a?){N}a{N}", "a", "", 2.5, 512},  // The program grows with n
+    {"adjacent-stars", "a*a*b", "a", "", 1.5, 0},
+    {"linear-control", R"(\w+@)", "word ", "", 1.5, 0},
+};
+
+struct Options {
+  std::vector<std::string> filters;
+  std::string jsonPath;
+  double budgetMs = 200;
+  double minTimeMs = 2;
+  size_t maxN = 1 << 14;
+};
+
+// One point of a curve
+struct Point {
+  size_t n;
+  double ns;
+};
+
+struct Curve {
+  std::string engine;
+  std::vector<Point> points;
+  std::string stop;  // Why the curve ended early: "budget" or "match limit"
+  std::string order;
+  double exponent = 0;  // Fitted polynomial order, or INFINITY for exponential growth
+};
+
+// Searches once and reports false when the engine gave up (deadline or limit)
+using Search = std::function<bool(const std::string& text)>;
+using EngineFactory = std::function<Search(const std::string& pattern, const Options& options)>;
+
+// ============================================================================
+// Growth order fitting
+// ============================================================================
+
+// Least squares fit of y = a + b * x; returns b and the residual sum of squares
+static void fitLine(const std::vector<double>& x, const std::vector<double>& y, double& slope,
+                    double& residual) {
+  double n = static_cast<double>(x.size());
+  double sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (size_t i = 0; i < x.size(); ++i) {
+    sx += x[i];
+    sy += y[i];
+    sxx += x[i] * x[i];
+    sxy += x[i] * y[i];
+  }
+  double denominator = n * sxx - sx * sx;
+  slope = denominator != 0 ? (n * sxy - sx * sy) / denominator : 0;
+  double intercept = (sy - slope * sx) / n;
+  residual = 0;
+  for (size_t i = 0; i < x.size(); ++i) {
+    double e = y[i] - (intercept + slope * x[i]);
+    residual += e * e;
+  }
+}
+
+// Fit the upper half of the curve, where fixed per-call costs no longer
+// dominate, to both O(n^k) (log t linear in log n) and O(c^n) (log t linear
+// in n) and keep the better model
+static void fitOrder(Curve& curve) {
+  const auto& points = curve.points;
+  size_t first = points.size() > 6 ? points.size() / 2 : 0;
+  if (points.size() - first < 3) {
+    curve.order = "-";
+    return;
+  }
+  std::vector<double> logN, n, logT;
+  for (size_t i = first; i < points.size(); ++i) {
+    logN.push_back(std::log(static_cast<double>(points[i].n)));
+    n.push_back(static_cast<double>(points[i].n));
+    logT.push_back(std::log(std::max(points[i].ns, 1.0)));
+  }
+  double k, polyResidual, rate, expResidual;
+  fitLine(logN, logT, k, polyResidual);
+  fitLine(n, logT, rate, expResidual);
+
+  char buf[32];
+  if (expResidual < polyResidual && k > 2.5) {
+    curve.exponent = INFINITY;
+    std::snprintf(buf, sizeof(buf), "O(%.2f^n)", std::exp(rate));
+  } else {
+    curve.exponent = k;
+    std::snprintf(buf, sizeof(buf), "O(n^%.1f)", k);
+  }
+  curve.order = buf;
+}
+
+// ============================================================================
+// Measurement
+// ============================================================================
+static std::string expand(const std::string& pattern, size_t n) {
+  std::string out;
+  for (size_t i = 0; i < pattern.size(); ++i) {
+    if (pattern[i] == 'N' && i > 0 && pattern[i - 1] == '{')
+      out += std::to_string(n);
+    else
+      out += pattern[i];
+  }
+  return out;
+}
+
+static Curve measure(const Case& c, const std::string& engineName, const EngineFactory& engine,
+                     const Options& options) {
+  Curve curve;
+  curve.engine = engineName;
+  bool scaled = std::strstr(c.pattern, "{N}") != nullptr;
+  size_t maxN = c.maxN ? std::min(c.maxN, options.maxN) : options.maxN;
+  Search search;
+  // n grows by sqrt(2) so exponential curves still get several points
+  for (double x = 8; x <= static_cast<double>(maxN); x *= std::sqrt(2.0)) {
+    size_t n = static_cast<size_t>(x);
+    if (!search || scaled)
+      search = engine(expand(c.pattern, n), options);
+    if (!search)
+      break;  // The library rejected the pattern
+    std::string text;
+    for (size_t i = 0; i < n; ++i)
+      text += c.pump;
+    text += c.suffix;
+
+    // A first timed call decides whether this size is still in budget
+    auto start = std::chrono::steady_clock::now();
+    bool finished = search(text);
+    double ns =
+        std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    if (!finished || ns > options.budgetMs * 1e6) {
+      curve.stop = finished || engineName.rfind("amarantine", 0) == 0 ? "budget" : "match limit";
+      break;
+    }
+
+    // Then batches of at least --min-time each; keep the median per call
+    uint64_t iterations =
+        std::max<uint64_t>(1, static_cast<uint64_t>(options.minTimeMs * 1e6 / ns));
+    std::vector<double> samples;
+    for (int s = 0; s < 5; ++s) {
+      start = std::chrono::steady_clock::now();
+      for (uint64_t i = 0; i < iterations; ++i)
+        bench::doNotOptimize(search(text));
+      samples.push_back(
+          std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start)
+              .count() /
+          iterations);
+    }
+    curve.points.push_back({n, bench::median(samples)});
+  }
+  fitOrder(curve);
+  return curve;
+}
+
+// ============================================================================
+// Engines
+// ============================================================================
+static EngineFactory amarantine(Engine choice) {
+  return [choice](const std::string& pattern, const Options& options) -> Search {
+    auto re = std::make_shared<Regex>(pattern);
+    re->setEngine(choice);
+    double budgetMs = options.budgetMs;
+    return [re, budgetMs](const std::string& text) {
+      MatchOptions limits;
+      limits.deadline = std::chrono::steady_clock::now() +
+                        std::chrono::microseconds(static_cast<int64_t>(budgetMs * 1000));
+      MatchResult result;
+      MatchStatus status = re->search(text, result, limits);
+      return status == MatchStatus::MATCHED || status == MatchStatus::NO_MATCH;
+    };
+  };
+}
+
+#ifdef HAVE_RE2
+static Search re2Search(const std::string& pattern, const Options&) {
+  auto re = std::make_shared<RE2>(pattern, RE2::Quiet);
+  if (!re->ok())
+    return nullptr;
+  return [re](const std::string& text) {
+    bench::doNotOptimize(RE2::PartialMatch(text, *re));
+    return true;
+  };
+}
+#endif
+
+#ifdef HAVE_PCRE2
+static Search pcre2Search(const std::string& pattern, const Options&) {
+  int errorcode;
+  PCRE2_SIZE erroroffset;
+  pcre2_code* code = pcre2_compile(reinterpret_cast<PCRE2_SPTR>(pattern.c_str()),
+                                   PCRE2_ZERO_TERMINATED, 0, &errorcode, &erroroffset, NULL);
+  if (!code)
+    return nullptr;
+  std::shared_ptr<pcre2_code> re(code, pcre2_code_free);
+  std::shared_ptr<pcre2_match_data> data(pcre2_match_data_create_from_pattern(code, NULL),
+                                         pcre2_match_data_free);
+  return [re, data](const std::string& text) {
+    int rc = pcre2_match(re.get(), reinterpret_cast<PCRE2_SPTR>(text.data()), text.size(), 0, 0,
+                         data.get(), NULL);
+    return rc >= 0 || rc == PCRE2_ERROR_NOMATCH;
+  };
+}
+#endif
+
+// ============================================================================
+// Output
+// ============================================================================
+static void printCase(const Case& c, const std::vector<Curve>& curves) {
+  std::printf("\n%s: /%s/ over \"%s\" x n + \"%s\"\n", c.name, c.pattern, c.pump, c.suffix);
+  std::printf("%8s", "n");
+  for (const auto& curve : curves)
+    std::printf(" %18s", curve.engine.c_str());
+  std::printf("\n");
+
+  std::vector<size_t> sizes;
+  for (const auto& curve : curves)
+    for (const auto& p : curve.points)
+      if (std::find(sizes.begin(), sizes.end(), p.n) == sizes.end())
+        sizes.push_back(p.n);
+  std::sort(sizes.begin(), sizes.end());
+  for (size_t n : sizes) {
+    std::printf("%8zu", n);
+    for (const auto& curve : curves) {
+      std::string cell = "";
+      for (const auto& p : curve.points)
+        if (p.n == n)
+          cell = bench::formatNs(p.ns);
+      std::printf(" %18s", cell.c_str());
+    }
+    std::printf("\n");
+  }
+  std::printf("%8s", "order");
+  for (const auto& curve : curves)
+    std::printf(" %18s", curve.order.c_str());
+  std::printf("\n%8s", "stopped");
+  for (const auto& curve : curves)
+    std::printf(" %18s", curve.stop.empty() ? "-" : curve.stop.c_str());
+  std::printf("\n");
+}
+
+static std::string toJson(const std::vector<std::pair<const Case*, std::vector<Curve>>>& all) {
+  std::ostringstream out;
+  out.precision(6);
+  out << "{\n  \"curves\": [";
+  bool firstCurve = true;
+  for (const auto& entry : all) {
+    for (const Curve& curve : entry.second) {
+      out << (firstCurve ? "" : ",") << "\n    {\"case\": " << bench::jsonString(entry.first->name)
+          << ", \"pattern\": " << bench::jsonString(entry.first->pattern)
+          << ", \"engine\": " << bench::jsonString(curve.engine)
+          << ", \"order\": " << bench::jsonString(curve.order)
+          << ", \"stopped\": " << bench::jsonString(curve.stop) << ", \"points\": [";
+      for (size_t i = 0; i < curve.points.size(); ++i)
+        out << (i ? ", " : "") << "[" << curve.points[i].n << ", " << curve.points[i].ns << "]";
+      out << "]}";
+      firstCurve = false;
+    }
+  }
+  out << "\n  ]\n}\n";
+  return out.str();
+}
+
+static void usage(const char* argv0) {
+  std::cerr << "usage: " << argv0
+            << " [--filter=a,b] [--budget=MS] [--min-time=MS] [--max-n=N] [--json=FILE]\n";
+}
+
+int main(int argc, char* argv[]) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto value = [&](const char* flag) -> const char* {
+      size_t len = std::strlen(flag);
+      if (arg.compare(0, len, flag) == 0 && arg.size() > len && arg[len] == '=')
+        return argv[i] + len + 1;
+      return nullptr;
+    };
+    if (const char* v = value("--filter")) {
+      std::stringstream list(v);
+      std::string item;
+      while (std::getline(list, item, ','))
+        if (!item.empty())
+          options.filters.push_back(item);
+    } else if (const char* v = value("--json")) {
+      options.jsonPath = v;
+    } else if (const char* v = value("--budget")) {
+      options.budgetMs = std::max(1.0, std::atof(v));
+    } else if (const char* v = value("--min-time")) {
+      options.minTimeMs = std::max(0.1, std::atof(v));
+    } else if (const char* v = value("--max-n")) {
+      options.maxN = std::max<size_t>(16, std::strtoull(v, nullptr, 10));
+    } else if (arg == "--help" || arg == "-h") {
+      usage(argv[0]);
+      return 0;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  std::vector<std::pair<std::string, EngineFactory>> engines = {
+      {"amarantine", amarantine(Engine::AUTO)},
+      {"amarantine-bt", amarantine(Engine::BACKTRACKING)},
+      {"amarantine-linear", amarantine(Engine::LINEAR)},
+#ifdef HAVE_RE2
+      {"re2", re2Search},
+#endif
+#ifdef HAVE_PCRE2
+      {"pcre2", pcre2Search},
+#endif
+  };
+
+  std::cout << "Worst-case search time vs input length (budget " << options.budgetMs
+            << " ms per call)\n";
+  std::vector<std::pair<const Case*, std::vector<Curve>>> all;
+  int failures = 0;
+  for (const Case& c : CASES) {
+    bool selected = options.filters.empty();
+    for (const auto& f : options.filters)
+      selected = selected || std::string(c.name).find(f) != std::string::npos;
+    if (!selected)
+      continue;
+    std::vector<Curve> curves;
+    for (const auto& engine : engines)
+      curves.push_back(measure(c, engine.first, engine.second, options));
+    printCase(c, curves);
+    // Amarantine's default mode and linear engine must not regress
+    for (const Curve& curve : curves) {
+      if (curve.engine == "amarantine-bt" || curve.engine.rfind("amarantine", 0) != 0)
+        continue;
+      if (curve.exponent > c.maxOrder || !curve.stop.empty()) {
+        std::printf("REGRESSION %s/%s: %s, allowed O(n^%.1f)\n", c.name, curve.engine.c_str(),
+                    curve.stop.empty() ? curve.order.c_str() : "over budget", c.maxOrder);
+        ++failures;
+      }
+    }
+    all.emplace_back(&c, std::move(curves));
+  }
+
+  if (!options.jsonPath.empty()) {
+    std::ofstream out(options.jsonPath);
+    out << toJson(all);
+    std::cout << "\nResults written to " << options.jsonPath << "\n";
+  }
+  return failures ? 1 : 0;
+}
@@ -0,0 +1,187 @@
+// replay_benchmark.cc - Re-run a workload captured with WorkloadRecorder
+//
+// Usage: replay_benchmark FILE [--by-pattern] [harness options]
+// Compiles every recorded pattern with its flags and replays the recorded
+// calls in order, on each engine configuration:
+//   replay/amarantine         - AUTO, the default
+//   replay/amarantine-bt      - backtracking only
+//   replay/amarantine-linear  - linear engine only
+// Throughput is over the input windows of all calls, so runs of two builds
+// on the same capture (--json, then --baseline or --compare) compare them on
+// real traffic. All configurations must find the same number of matches;
+// a difference is reported as a MISMATCH and makes the run exit 1.
+// --by-pattern first prints each pattern's share of the replay time.
+#include "amaranth/amaranth.h"
+
+#include "bench_harness.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace amaranth;
+
+class Replayer {
+ public:
+  Replayer(const RecordedWorkload& workload, Engine engine) : workload_(workload) {
+    for (const RecordedPattern& p : workload.patterns) {
+      std::unique_ptr<Regex> re;
+      try {
+        re = std::make_unique<Regex>(p.pattern, static_cast<Regex::CompileFlag>(p.flags));
+        re->setEngine(engine);
+      } catch (const RegexError&) {
+      }
+      regexes_.push_back(std::move(re));
+    }
+  }
+
+  // Replays every call; returns the matches found
+  size_t run() {
+    size_t matches = 0;
+    for (const RecordedCall& c : workload_.calls)
+      matches += call(c);
+    return matches;
+  }
+
+  size_t call(const RecordedCall& c) {
+    Regex* re = regexes_[c.pattern].get();
+    if (!re)
+      return 0;
+    const std::string& text = workload_.texts[c.text];
+    switch (c.api) {
+      case RecordedApi::MATCH:
+        return re->match(text, result_, c.start, c.end) ? 1 : 0;
+      case RecordedApi::SEARCH:
+        return re->search(text, result_, c.start, c.end) ? 1 : 0;
+      default:
+        return re->searchAll(text, c.start, c.end).size();
+    }
+  }
+
+  size_t invalid() const {
+    return static_cast<size_t>(std::count(regexes_.begin(), regexes_.end(), nullptr));
+  }
+
+ private:
+  const RecordedWorkload& workload_;
+  std::vector<std::unique_ptr<Regex>> regexes_;  // Null where the pattern does not compile
+  MatchResult result_;
+};
+
+static size_t windowBytes(const RecordedWorkload& workload, const RecordedCall& c) {
+  size_t size = workload.texts[c.text].size();
+  size_t end = std::min(c.end, size);
+  return c.start < end ? end - c.start : 0;
+}
+
+// Time spent per pattern over one replay with the default engine
+static void printByPattern(const RecordedWorkload& workload) {
+  Replayer replayer(workload, Engine::AUTO);
+  replayer.run();  // Warm up
+  std::vector<double> ns(workload.patterns.size());
+  std::vector<size_t> calls(workload.patterns.size());
+  double total = 0;
+  for (const RecordedCall& c : workload.calls) {
+    auto start = std::chrono::steady_clock::now();
+    bench::doNotOptimize(replayer.call(c));
+    double elapsed =
+        std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+    ns[c.pattern] += elapsed;
+    total += elapsed;
+    ++calls[c.pattern];
+  }
+  std::vector<size_t> order(workload.patterns.size());
+  for (size_t i = 0; i < order.size(); ++i)
+    order[i] = i;
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return ns[a] > ns[b]; });
+  std::printf("%8s %10s %12s  %s\n", "time", "calls", "per call", "pattern");
+  for (size_t i : order) {
+    std::printf("%7.1f%% %10zu %12s  /%s/\n", total > 0 ? ns[i] * 100 / total : 0, calls[i],
+                bench::formatNs(calls[i] ? ns[i] / calls[i] : 0).c_str(),
+                workload.patterns[i].pattern.c_str());
+  }
+  std::printf("\n");
+}
+
+static void usage(const char* argv0) {
+  std::cerr << "usage: " << argv0 << " FILE [--by-pattern] [harness options]\n";
+}
+
+int main(int argc, char* argv[]) {
+  std::string path;
+  bool byPattern = false;
+  // Arguments left for bench::Harness
+  std::vector<char*> rest = {argv[0]};
+  for (int i = 1; i < argc; ++i) {
+    if (std::strcmp(argv[i], "--by-pattern") == 0) {
+      byPattern = true;
+    } else if (std::strcmp(argv[i], "--help") == 0 || std::strcmp(argv[i], "-h") == 0) {
+      usage(argv[0]);
+      return 0;
+    } else if (argv[i][0] != '-' && path.empty()) {
+      path = argv[i];
+    } else {
+      rest.push_back(argv[i]);
+    }
+  }
+  if (path.empty()) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  RecordedWorkload workload;
+  std::string error;
+  if (!readWorkload(path, workload, error)) {
+    std::cerr << "error: " << error << "\n";
+    return 2;
+  }
+  size_t bytes = 0;
+  size_t apis[3] = {0, 0, 0};
+  for (const RecordedCall& c : workload.calls) {
+    bytes += windowBytes(workload, c);
+    ++apis[static_cast<int>(c.api)];
+  }
+  bench::Harness harness(static_cast<int>(rest.size()), rest.data());
+  std::printf("%zu calls (%zu match, %zu search, %zu searchAll) on %zu patterns, %zu bytes\n\n",
+              workload.calls.size(), apis[0], apis[1], apis[2], workload.patterns.size(), bytes);
+  if (workload.calls.empty())
+    return 0;
+  if (byPattern)
+    printByPattern(workload);
+
+  struct Config {
+    const char* name;
+    Engine engine;
+  };
+  static const Config CONFIGS[] = {
+      {"replay/amarantine", Engine::AUTO},
+      {"replay/amarantine-bt", Engine::BACKTRACKING},
+      {"replay/amarantine-linear", Engine::LINEAR},
+  };
+  int mismatches = 0;
+  size_t expected = SIZE_MAX;
+  for (const Config& config : CONFIGS) {
+    if (!harness.selected(config.name))
+      continue;
+    auto replayer = std::make_shared<Replayer>(workload, config.engine);
+    if (config.engine == Engine::AUTO && replayer->invalid())
+      std::printf("%zu pattern(s) no longer compile; their calls are skipped\n\n",
+                  replayer->invalid());
+    size_t matches = replayer->run();
+    if (expected == SIZE_MAX) {
+      expected = matches;
+    } else if (matches != expected) {
+      std::printf("MISMATCH %s: %zu matches, expected %zu\n", config.name, matches, expected);
+      ++mismatches;
+    }
+    harness.add(config.name, [replayer]() { return replayer->run(); }, bytes);
+  }
+
+  int status = harness.run();
+  return mismatches ? 1 : status;
+}
@@ -0,0 +1,189 @@
+// scaling_benchmark.cc - Matching throughput on 1..N threads
+//
+// Every thread scans access log lines against the same rule set of
+// patterns, searching each line with each rule, for --duration
+// milliseconds. Three setups are compared at every thread count:
+//   shared         - all threads use one set of Regex objects
+//   copies         - each thread matches with its own copy of the set
+//   shared+metrics - shared, with Regex::enableMetrics() recording
+// Throughput is input bytes per second across all threads; efficiency is
+// throughput divided by thread count times the single-thread throughput,
+// so 100% is perfect scaling. Shared setups falling behind copies point at
+// contention or false sharing inside Regex (scratch, counters, metrics).
+#include "amaranth/amaranth.h"
+
+#include "corpus.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace amaranth;
+
+// Rules a log pipeline might run on every line
+static const char* const RULES[] = {
+    R"((\d+)\.(\d+)\.(\d+)\.(\d+))",
+    R"("(GET|POST|PUT|DELETE|HEAD)\s)",
+    R"(\s(404|500)\s)",
+    R"(/api/v1/(\w+))",
+    R"(\?id=(\d+))",
+    R"(Googlebot|curl)",
+    R"(Firefox/(\d+))",
+    R"(:(\d+):(\d+):(\d+)\s)",
+};
+
+enum class Setup { SHARED, COPIES, SHARED_METRICS };
+
+static const char* setupName(Setup setup) {
+  switch (setup) {
+    case Setup::SHARED:
+      return "shared";
+    case Setup::COPIES:
+      return "copies";
+    default:
+      return "shared+metrics";
+  }
+}
+
+struct Options {
+  int maxThreads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+  double durationMs = 300;
+  size_t corpusBytes = 1 << 20;
+};
+
+static std::vector<std::string> splitLines(const std::string& text) {
+  std::vector<std::string> lines;
+  size_t begin = 0;
+  while (begin < text.size()) {
+    size_t end = text.find('\n', begin);
+    if (end == std::string::npos)
+      end = text.size();
+    lines.push_back(text.substr(begin, end - begin));
+    begin = end + 1;
+  }
+  return lines;
+}
+
+// Bytes per second scanned by `threads` threads in `setup`
+static double run(Setup setup, int threads, const std::vector<std::string>& lines,
+                  const Options& options) {
+  std::vector<Regex> shared;
+  for (const char* rule : RULES) {
+    shared.emplace_back(rule);
+    shared.back().enableMetrics(setup == Setup::SHARED_METRICS);
+  }
+
+  std::atomic<int> ready{0};
+  std::atomic<bool> go{false};
+  std::atomic<bool> stop{false};
+  std::vector<uint64_t> bytes(threads, 0);
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; ++t) {
+    pool.emplace_back([&, t] {
+      std::vector<Regex> copies;
+      if (setup == Setup::COPIES)
+        copies = shared;
+      std::vector<Regex>& rules = setup == Setup::COPIES ? copies : shared;
+      MatchResult result;
+      // Start each thread elsewhere in the log so they do not read in lockstep
+      size_t line = lines.size() * t / threads;
+      uint64_t scanned = 0;
+      ready.fetch_add(1);
+      while (!go.load(std::memory_order_acquire))
+        std::this_thread::yield();
+      while (!stop.load(std::memory_order_relaxed)) {
+        for (int batch = 0; batch < 64; ++batch) {
+          const std::string& text = lines[line];
+          for (Regex& rule : rules)
+            rule.search(text, result);
+          scanned += text.size();
+          if (++line == lines.size())
+            line = 0;
+        }
+      }
+      // Written once at the end, so the counters themselves cause no sharing
+      bytes[t] = scanned;
+    });
+  }
+
+  while (ready.load() < threads)
+    std::this_thread::yield();
+  auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(options.durationMs));
+  stop.store(true);
+  for (auto& th : pool)
+    th.join();
+  double seconds =
+      std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  uint64_t total = 0;
+  for (uint64_t b : bytes)
+    total += b;
+  return total / seconds;
+}
+
+static void usage(const char* argv0) {
+  std::cerr << "usage: " << argv0 << " [--threads=N] [--duration=MS] [--corpus-bytes=N]\n";
+}
+
+int main(int argc, char* argv[]) {
+  Options options;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    auto value = [&](const char* flag) -> const char* {
+      size_t len = std::strlen(flag);
+      if (arg.compare(0, len, flag) == 0 && arg.size() > len && arg[len] == '=')
+        return argv[i] + len + 1;
+      return nullptr;
+    };
+    if (const char* v = value("--threads")) {
+      options.maxThreads = std::max(1, std::atoi(v));
+    } else if (const char* v = value("--duration")) {
+      options.durationMs = std::max(10.0, std::atof(v));
+    } else if (const char* v = value("--corpus-bytes")) {
+      options.corpusBytes = std::max<size_t>(4096, std::strtoull(v, nullptr, 10));
+    } else if (arg == "--help" || arg == "-h") {
+      usage(argv[0]);
+      return 0;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  std::vector<std::string> lines = splitLines(corpus::accessLog(options.corpusBytes));
+
+  // 1, 2, 4, ... up to and including the maximum
+  std::vector<int> counts;
+  for (int n = 1; n < options.maxThreads; n *= 2)
+    counts.push_back(n);
+  counts.push_back(options.maxThreads);
+
+  std::printf("%zu rules over %zu log lines, %.0f ms per point, %u hardware threads\n\n",
+              std::size(RULES), lines.size(), options.durationMs,
+              std::thread::hardware_concurrency());
+  std::printf("%8s %16s %12s %10s %12s\n", "threads", "setup", "MB/s", "speedup", "efficiency");
+  for (Setup setup : {Setup::SHARED, Setup::COPIES, Setup::SHARED_METRICS}) {
+    double single = 0;
+    for (int threads : counts) {
+      double rate = run(setup, threads, lines, options);
+      if (threads == 1)
+        single = rate;
+      double speedup = single > 0 ? rate / single : 0;
+      std::printf("%8d %16s %12.1f %9.2fx %11.1f%%\n", threads, setupName(setup), rate / 1e6,
+                  speedup, speedup / threads * 100);
+      std::fflush(stdout);
+    }
+  }
+  return 0;
+}
@@ -2,14 +2,26 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
 #include <cstdint>
+#include <cstdio>
 #include <cstring>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 namespace amaranth {
 
 // Amarantine - Named after the mythical flower that never fades
@@ -50,7 +62,7 @@ struct MatchResult {
   bool matched;
   size_t position;
   std::string matched_text;
-  std::vector<Match> captures;
+  std::vector<Match> captures;  // Group n at [n - 1], numbered by '(' in pattern order
 
   size_t length() const {
     return matched_text.length();
@@ -85,19 +97,28 @@ struct MatchResult {
 // Virtual Machine Instruction Set
 // ============================================================================
 enum class Opcode : uint8_t {
-  CHAR,          // Match literal character
-  ANY,           // Match any character
-  RANGE,         // Match character in range [min,max]
-  CLASS,         // Match character class
-  NOT_CLASS,     // Match negated character class
-  CLASS_PRED,    // Match using predicate function (for chars >= 64)
-  JUMP,          // Unconditional jump
-  SPLIT,         // Split (fork) to two paths
-  SAVE,          // Save capture group position
-  MATCH,         // Success/accept state
-  ANCHOR_START,  // Anchor at start
-  ANCHOR_END,    // Anchor at end
-  BACKREF,       // Backreference to capture group
+  CHAR,               // Match literal character
+  ANY,                // Match any character
+  RANGE,              // Match character in range [min,max]
+  CLASS,              // Match character class
+  NOT_CLASS,          // Match negated character class
+  CLASS_PRED,         // Match using predicate function (for chars >= 64)
+  JUMP,               // Unconditional jump
+  SPLIT,              // Split (fork) to two paths
+  SAVE,               // Save capture group position
+  MATCH,              // Success/accept state
+  ANCHOR_START,       // Anchor at start
+  ANCHOR_END,         // Anchor at end
+  BACKREF,            // Backreference to capture group
+  LINE_START,         // Anchor at start or after '\n' (MULTILINE '^')
+  LINE_END,           // Anchor at end or before '\n' (MULTILINE '$')
+  ANY_NO_NL,          // Match any character but '\n' ('.' without DOTALL)
+  WORD_BOUNDARY,      // \b: word character on exactly one side
+  NOT_WORD_BOUNDARY,  // \B: word characters on both sides or neither
+  LOOKAHEAD,          // (?=...): sub-program at operand matches here
+  NEG_LOOKAHEAD,      // (?!...): sub-program at operand does not match here
+  LOOKBEHIND,         // (?<=...): reversed sub-program at operand matches backward from here
+  NEG_LOOKBEHIND,     // (?<!...): reversed sub-program at operand does not match here
 };
 
 #pragma pack(push, 1)
@@ -119,6 +140,26 @@ struct Instruction {
 
   Instruction() : opcode(Opcode::CHAR), operand(0), ch(0) {}
 
+  // Whether this consuming instruction accepts byte `c`; false for anything
+  // that does not consume (defined after CharClass)
+  bool accepts(char c) const;
+
+  // Whether this instruction reads one byte, i.e. one accepts() handles
+  bool consumes() const {
+    switch (opcode) {
+      case Opcode::CHAR:
+      case Opcode::ANY:
+      case Opcode::ANY_NO_NL:
+      case Opcode::RANGE:
+      case Opcode::CLASS:
+      case Opcode::NOT_CLASS:
+      case Opcode::CLASS_PRED:
+        return true;
+      default:
+        return false;
+    }
+  }
+
   static Instruction Char(char c, uint32_t next = 1) {
     Instruction inst;
     inst.opcode = Opcode::CHAR;
@@ -185,6 +226,53 @@ struct Instruction {
     return inst;
   }
 
+  static Instruction LineStart() {
+    Instruction inst;
+    inst.opcode = Opcode::LINE_START;
+    return inst;
+  }
+
+  static Instruction LineEnd() {
+    Instruction inst;
+    inst.opcode = Opcode::LINE_END;
+    return inst;
+  }
+
+  static Instruction WordBoundary(bool negated = false) {
+    Instruction inst;
+    inst.opcode = negated ? Opcode::NOT_WORD_BOUNDARY : Opcode::WORD_BOUNDARY;
+    return inst;
+  }
+
+  // Sub-program start and memo slot are filled in once the sub-program is
+  // placed, see Compiler
+  static Instruction Lookahead(bool negated = false) {
+    Instruction inst;
+    inst.opcode = negated ? Opcode::NEG_LOOKAHEAD : Opcode::LOOKAHEAD;
+    inst.operand = 0;
+    inst.charset_low = 0;
+    inst.charset_high = 0;
+    return inst;
+  }
+
+  // charset_high is the body's width when it is a straight run of single-byte
+  // tests, checked without the simulation, and 0 otherwise
+  static Instruction Lookbehind(bool negated = false) {
+    Instruction inst;
+    inst.opcode = negated ? Opcode::NEG_LOOKBEHIND : Opcode::LOOKBEHIND;
+    inst.operand = 0;
+    inst.charset_low = 0;
+    inst.charset_high = 0;
+    return inst;
+  }
+
+  static Instruction AnyNoNewline(uint32_t next = 1) {
+    Instruction inst;
+    inst.opcode = Opcode::ANY_NO_NL;
+    inst.operand = next;
+    return inst;
+  }
+
   static Instruction Class(uint64_t classbits_low, uint32_t next = 1) {
     Instruction inst;
     inst.opcode = Opcode::CLASS;
@@ -246,6 +334,129 @@ enum ClassType : int { CLASS_DIGIT = 0, CLASS_WORD = 1, CLASS_SPACE = 2 };
 static constexpr size_t MAX_INSTRUCTIONS = 16384;
 static constexpr size_t MAX_CAPTURES = 32;
 static constexpr size_t VM_STACK_SIZE = 65536;
+static constexpr size_t MAX_NESTING_DEPTH = 250;  // Same default as PCRE2's parens limit
+static constexpr uint64_t LIMIT_POLL_INTERVAL = 1024;  // Steps between deadline/cancel checks
+static constexpr uint64_t FALLBACK_BACKTRACKS_PER_BYTE = 32;  // Backtracks per input byte before
+static constexpr uint64_t FALLBACK_MIN_BACKTRACKS = 10000;    // AUTO leaves the backtracker
+
+// ============================================================================
+// Execution Limits
+// ============================================================================
+// Outcome of a match or search run under MatchOptions
+enum class MatchStatus : uint8_t {
+  NO_MATCH,
+  MATCHED,
+  BUDGET_EXCEEDED,    // More than MatchOptions::maxSteps instructions executed
+  STACK_EXHAUSTED,    // Backtrack stack reached MatchOptions::maxBacktrackDepth
+  DEADLINE_EXCEEDED,  // MatchOptions::deadline passed
+  CANCELLED,          // MatchOptions::cancel was triggered
+  BACKTRACK_LIMIT     // VM::setBacktrackLimit reached; Regex reruns these on the linear engine
+};
+
+// Flag that another thread can raise to stop a running match
+class CancellationToken {
+ public:
+  void cancel() {
+    cancelled_.store(true, std::memory_order_relaxed);
+  }
+  void reset() {
+    cancelled_.store(false, std::memory_order_relaxed);
+  }
+  bool isCancelled() const {
+    return cancelled_.load(std::memory_order_relaxed);
+  }
+
+ private:
+  std::atomic<bool> cancelled_{false};
+};
+
+// Counters of what a call did, for finding out which patterns are expensive
+// and why. Calls add to the counters instead of resetting them, so one
+// MatchStats can total a batch of calls; reset() it for per-call numbers.
+// The counting code lives in separate engine instantiations, so calls that
+// do not ask for stats run exactly the code they ran before.
+struct MatchStats {
+  uint64_t instructions = 0;         // Instructions dispatched, by either engine
+  uint64_t backtrackPushes = 0;      // Choice points saved by the backtracker
+  uint64_t maxBacktrackDepth = 0;    // Deepest the backtrack stack got
+  uint64_t startPositions = 0;       // Positions a match was attempted from
+  uint64_t prefilterCandidates = 0;  // Positions the first-byte prefilter let through
+  uint64_t bytesScanned = 0;         // Input from the call's start to the furthest position reached
+  uint64_t fallbacks = 0;            // Calls rerun on the linear engine
+
+  void reset() {
+    *this = MatchStats();
+  }
+};
+
+// Per-instruction counters of one compiled program, indexed by pc, for
+// finding the quantifier or alternation a workload spends its time in. Calls
+// add to it like they do to MatchStats, so it should only ever be used with
+// one pattern. disassemble() prints it next to the program listing.
+struct ProgramProfile {
+  std::vector<uint64_t> hits;    // Times the instruction ran
+  std::vector<uint64_t> fails;   // Times it rejected the input and its path died
+  std::vector<uint64_t> pushes;  // Alternatives a SPLIT saved for later
+
+  void fit(size_t programSize) {
+    if (hits.size() < programSize) {
+      hits.resize(programSize);
+      fails.resize(programSize);
+      pushes.resize(programSize);
+    }
+  }
+
+  void reset() {
+    std::fill(hits.begin(), hits.end(), 0);
+    std::fill(fails.begin(), fails.end(), 0);
+    std::fill(pushes.begin(), pushes.end(), 0);
+  }
+};
+
+// Per-call limits for untrusted patterns or input. The budget covers the whole
+// call: a search spends from it across every start position it tries. One step
+// is one VM instruction dispatched, so time spent re-running paths after a
+// backtrack is charged too. The deadline and cancellation token are polled
+// every LIMIT_POLL_INTERVAL steps to keep the clock off the hot path.
+struct MatchOptions {
+  uint64_t maxSteps = 0;  // 0 = unlimited
+  size_t maxBacktrackDepth = VM_STACK_SIZE;
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+  const CancellationToken* cancel = nullptr;
+  MatchStats* stats = nullptr;        // Collect counters for this call
+  ProgramProfile* profile = nullptr;  // Collect per-instruction counters for this call
+};
+
+// Limit bookkeeping of one checked call. Both engines use it, and a call that
+// moves from one engine to the other carries its spent steps over, so the
+// budget still covers the whole call.
+struct StepLimiter {
+  const MatchOptions* options = nullptr;
+  uint64_t steps = 0;
+  uint64_t checkAt = 0;  // Step count at which check() runs next
+
+  void begin(const MatchOptions& o, uint64_t spent = 0) {
+    options = &o;
+    steps = spent;
+    checkAt = spent + 1;  // Catch an expired deadline or early cancel before any work
+  }
+
+  // Returns NO_MATCH while the call may continue
+  MatchStatus check() {
+    const MatchOptions& o = *options;
+    if (o.maxSteps != 0 && steps > o.maxSteps)
+      return MatchStatus::BUDGET_EXCEEDED;
+    if (o.cancel && o.cancel->isCancelled())
+      return MatchStatus::CANCELLED;
+    if (o.deadline != std::chrono::steady_clock::time_point::max() &&
+        std::chrono::steady_clock::now() >= o.deadline)
+      return MatchStatus::DEADLINE_EXCEEDED;
+    checkAt = steps + LIMIT_POLL_INTERVAL;
+    if (o.maxSteps != 0 && checkAt > o.maxSteps + 1)
+      checkAt = o.maxSteps + 1;
+    return MatchStatus::NO_MATCH;
+  }
+};
 
 // ============================================================================
 // Character Classes with Bitsets
@@ -257,6 +468,19 @@ class CharClass {
       (1ULL << '0') | (1ULL << '1') | (1ULL << '2') | (1ULL << '3') | (1ULL << '4') |
       (1ULL << '5') | (1ULL << '6') | (1ULL << '7') | (1ULL << '8') | (1ULL << '9');
 
+  // Word characters 64-127: 'A'-'Z', '_' and 'a'-'z' (bit i is char 64+i);
+  // the digits in 0-63 are DIGIT_MASK
+  static constexpr uint64_t WORD_MASK_HIGH = (((1ULL << 26) - 1) << ('A' - 64)) |
+                                             (1ULL << ('_' - 64)) |
+                                             (((1ULL << 26) - 1) << ('a' - 64));
+
+  // Letters of a 64-127 mask, 'A'-'Z' at bits 1-26 and 'a'-'z' 32 bits
+  // above, with each one's other case added
+  static constexpr uint64_t UPPER_MASK_HIGH = ((1ULL << 26) - 1) << ('A' - 64);
+  static constexpr uint64_t foldCase(uint64_t high) {
+    return high | ((high & UPPER_MASK_HIGH) << 32) | ((high >> 32) & UPPER_MASK_HIGH);
+  }
+
   // Space: space (32), tab (9), \f (12), \r (13), \n (10), \v (11)
   static constexpr uint64_t SPACE_MASK = (1ULL << ' ') | (1ULL << '\t') | (1ULL << '\f') |
                                          (1ULL << '\r') | (1ULL << '\n') | (1ULL << '\v');
@@ -326,6 +550,138 @@ class CharClass {
   }
 };
 
+inline bool Instruction::accepts(char c) const {
+  switch (opcode) {
+    case Opcode::CHAR:
+      return c == ch;
+    case Opcode::ANY:
+      return true;
+    case Opcode::ANY_NO_NL:
+      return c != '\n';
+    case Opcode::RANGE:
+      return c >= lo && c <= hi;
+    case Opcode::CLASS:
+      return CharClass::inClassExt(charset_low, charset_high, c);
+    case Opcode::NOT_CLASS:
+      return !CharClass::inClassExt(charset_low, charset_high, c);
+    case Opcode::CLASS_PRED: {
+      bool matched = false;
+      switch (class_type & 0x0F) {
+        case CLASS_DIGIT:
+          matched = CharClass::isDigit(c);
+          break;
+        case CLASS_WORD:
+          matched = CharClass::isWordChar(c);
+          break;
+        case CLASS_SPACE:
+          matched = CharClass::isSpace(c);
+          break;
+      }
+      return matched != ((class_type & 0x10) != 0);
+    }
+    default:
+      return false;
+  }
+}
+
+// MULTILINE anchors. Like '^' and '$' they see the whole text, not just the
+// window being matched
+inline bool atLineStart(const std::string& text, size_t pos) {
+  return pos == 0 || text[pos - 1] == '\n';
+}
+
+inline bool atLineEnd(const std::string& text, size_t pos) {
+  return pos == text.length() || text[pos] == '\n';
+}
+
+// Word bytes for \b and \B, one lookup per side instead of the range tests
+// of CharClass::isWord
+struct WordTable {
+  bool word[256];
+
+  constexpr WordTable() : word() {
+    for (int c = 0; c < 256; ++c) {
+      word[c] = (c >= '0' && c <= '9') || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z') ||
+                c == '_';
+    }
+  }
+};
+
+inline constexpr WordTable WORD_TABLE;
+
+inline bool atWordBoundary(const std::string& text, size_t pos) {
+  bool before = pos > 0 && WORD_TABLE.word[static_cast<uint8_t>(text[pos - 1])];
+  bool after = pos < text.length() && WORD_TABLE.word[static_cast<uint8_t>(text[pos])];
+  return before != after;
+}
+
+// 256-bit set of byte values, used by the analyzers to reason about which
+// characters a piece of a pattern can consume
+struct ByteSet {
+  uint64_t bits[4] = {0, 0, 0, 0};
+
+  void set(uint8_t c) {
+    bits[c >> 6] |= 1ULL << (c & 63);
+  }
+  bool test(uint8_t c) const {
+    return (bits[c >> 6] >> (c & 63)) & 1;
+  }
+  void reset(uint8_t c) {
+    bits[c >> 6] &= ~(1ULL << (c & 63));
+  }
+  void setAll() {
+    bits[0] = bits[1] = bits[2] = bits[3] = ~0ULL;
+  }
+  bool any() const {
+    return (bits[0] | bits[1] | bits[2] | bits[3]) != 0;
+  }
+  bool subsetOf(const ByteSet& other) const {
+    for (int i = 0; i < 4; ++i) {
+      if (bits[i] & ~other.bits[i])
+        return false;
+    }
+    return true;
+  }
+  ByteSet& operator|=(const ByteSet& other) {
+    for (int i = 0; i < 4; ++i) {
+      bits[i] |= other.bits[i];
+    }
+    return *this;
+  }
+  ByteSet operator&(const ByteSet& other) const {
+    ByteSet r;
+    for (int i = 0; i < 4; ++i) {
+      r.bits[i] = bits[i] & other.bits[i];
+    }
+    return r;
+  }
+  ByteSet operator~() const {
+    ByteSet r;
+    for (int i = 0; i < 4; ++i) {
+      r.bits[i] = ~bits[i];
+    }
+    return r;
+  }
+
+  // A representative member, preferring letters and digits so generated
+  // strings stay readable. Returns -1 for the empty set.
+  int pick() const {
+    for (int c = 0; c < 256; ++c) {
+      if (test(c) && CharClass::isWord(static_cast<char>(c)))
+        return c;
+    }
+    for (int c = 33; c < 127; ++c) {
+      if (test(c))
+        return c;
+    }
+    for (int c = 0; c < 256; ++c) {
+      if (test(c))
+        return c;
+    }
+    return -1;
+  }
+};
+
 // ============================================================================
 // Lexer - Tokenizer for Regex Patterns
 // ============================================================================
@@ -363,23 +719,21 @@ class Lexer {
  public:
   explicit Lexer(const std::string& pattern) : pattern_(pattern), pos_(0) {}
 
+  // Materialize the whole token stream. The parser does not need this: it
+  // pulls one token at a time through next().
   std::vector<Token> tokenize() {
     std::vector<Token> tokens;
     tokens.reserve(pattern_.length());
 
-    while (pos_ < pattern_.length()) {
-      Token tok = nextToken();
+    for (Token tok = next(); tok.type != TokenType::UNKNOWN; tok = next()) {
       tokens.push_back(tok);
     }
 
     return tokens;
   }
 
- private:
-  const std::string& pattern_;
-  size_t pos_;
-
-  Token nextToken() {
+  // Return the next token, or UNKNOWN once the pattern is exhausted
+  Token next() {
     if (pos_ >= pattern_.length()) {
       return Token(TokenType::UNKNOWN, 0, pos_);
     }
@@ -426,17 +780,21 @@ class Lexer {
         throw RegexError("Incomplete escape sequence", position);
       }
       default:
-        if (c == ' ' || c == '\t') {
-          return nextToken();  // Skip whitespace
-        }
         return Token(TokenType::LITERAL, c, position);
     }
   }
+
+ private:
+  const std::string& pattern_;
+  size_t pos_;
 };
 
 // ============================================================================
 // AST Nodes
 // ============================================================================
+// Nodes live in an ASTArena and refer to each other by index
+using NodeId = uint32_t;
+
 struct ASTNode {
   enum class Type {
     LITERAL,
@@ -448,6 +806,10 @@ struct ASTNode {
     NOT_CLASS,
     ANCHOR_START,
     ANCHOR_END,
+    WORD_BOUNDARY,
+    NOT_WORD_BOUNDARY,
+    LOOKAHEAD,
+    LOOKBEHIND,
     GROUP,
     BACKREF
   };
@@ -460,76 +822,204 @@ struct ASTNode {
   uint32_t minRepeat = 0;
   uint32_t maxRepeat = 0;
   bool greedy = true;
+  bool multiline = false;  // ANCHOR_START/ANCHOR_END: also match at line breaks
+  bool dotAll = false;     // DOT: also matches '\n'
+  bool negated = false;    // LOOKAHEAD/LOOKBEHIND: holds when the body does not match
   int groupIndex = -1;
+  uint32_t position = 0;  // Offset of the node's first token in the pattern
 
-  std::vector<std::unique_ptr<ASTNode>> children;
+  // Children are the range [firstChild, firstChild + numChildren) of the
+  // arena's child list
+  uint32_t firstChild = 0;
+  uint32_t numChildren = 0;
 
   explicit ASTNode(Type t) : type(t) {}
+};
 
-  static std::unique_ptr<ASTNode> Literal(char c) {
-    auto node = std::make_unique<ASTNode>(Type::LITERAL);
-    node->ch = c;
-    return node;
+// Bump arena owning every node of one compile session. Nodes are appended to a
+// single vector and children are stored as contiguous index ranges, so building
+// a tree costs a couple of amortized vector appends and the whole tree is freed
+// at once when the arena goes away.
+class ASTArena {
+ public:
+  // Reserve enough room that parsing a pattern of this length never
+  // reallocates. Each node comes from its own pattern character (an atom, a
+  // quantifier, or the '|' or ')' ending a CONCAT), except a group's
+  // ALTERNATE, which shares its '(', and the root's CONCAT and ALTERNATE.
+  // That is at most 2 * length + 2 nodes, each a child at most once.
+  void reserve(size_t patternLength) {
+    nodes_.reserve(2 * patternLength + 2);
+    children_.reserve(2 * patternLength + 2);
   }
 
-  static std::unique_ptr<ASTNode> Dot() {
-    return std::make_unique<ASTNode>(Type::DOT);
+  void clear() {
+    nodes_.clear();
+    children_.clear();
   }
 
-  static std::unique_ptr<ASTNode> Concat(std::unique_ptr<ASTNode> left,
-                                         std::unique_ptr<ASTNode> right) {
-    auto node = std::make_unique<ASTNode>(Type::CONCAT);
-    node->children.push_back(std::move(left));
-    node->children.push_back(std::move(right));
-    return node;
+  size_t size() const {
+    return nodes_.size();
   }
 
-  static std::unique_ptr<ASTNode> Alternate(std::unique_ptr<ASTNode> left,
-                                            std::unique_ptr<ASTNode> right) {
-    auto node = std::make_unique<ASTNode>(Type::ALTERNATE);
-    node->children.push_back(std::move(left));
-    node->children.push_back(std::move(right));
-    return node;
+  ASTNode& operator[](NodeId id) {
+    return nodes_[id];
+  }
+  const ASTNode& operator[](NodeId id) const {
+    return nodes_[id];
   }
 
-  static std::unique_ptr<ASTNode> Repeat(std::unique_ptr<ASTNode> child, uint32_t min, uint32_t max,
-                                         bool g = true) {
-    auto node = std::make_unique<ASTNode>(Type::REPEAT);
-    node->children.push_back(std::move(child));
-    node->minRepeat = min;
-    node->maxRepeat = max;
-    node->greedy = g;
-    return node;
+  NodeId child(NodeId id, uint32_t idx) const {
+    return children_[nodes_[id].firstChild + idx];
   }
 
-  static std::unique_ptr<ASTNode> Group(std::unique_ptr<ASTNode> child, int idx) {
-    auto node = std::make_unique<ASTNode>(Type::GROUP);
-    node->groupIndex = idx;
-    node->children.push_back(std::move(child));
-    return node;
+  NodeId add(ASTNode::Type type) {
+    nodes_.emplace_back(type);
+    return static_cast<NodeId>(nodes_.size() - 1);
   }
 
-  static std::unique_ptr<ASTNode> Backref(int group) {
-    auto node = std::make_unique<ASTNode>(Type::BACKREF);
-    node->groupIndex = group;
-    return node;
+  NodeId Literal(char c) {
+    NodeId id = add(ASTNode::Type::LITERAL);
+    nodes_[id].ch = c;
+    return id;
+  }
+
+  NodeId Dot(bool dotAll = false) {
+    NodeId id = add(ASTNode::Type::DOT);
+    nodes_[id].dotAll = dotAll;
+    return id;
+  }
+
+  NodeId Anchor(ASTNode::Type type, bool multiline = false) {
+    NodeId id = add(type);
+    nodes_[id].multiline = multiline;
+    return id;
+  }
+
+  NodeId Concat(const NodeId* items, uint32_t count) {
+    return withChildren(add(ASTNode::Type::CONCAT), items, count);
+  }
+
+  NodeId Alternate(const NodeId* items, uint32_t count) {
+    return withChildren(add(ASTNode::Type::ALTERNATE), items, count);
+  }
+
+  NodeId Repeat(NodeId child, uint32_t min, uint32_t max, bool g = true) {
+    NodeId id = withChildren(add(ASTNode::Type::REPEAT), &child, 1);
+    nodes_[id].minRepeat = min;
+    nodes_[id].maxRepeat = max;
+    nodes_[id].greedy = g;
+    return id;
+  }
+
+  NodeId Group(NodeId child, int idx) {
+    NodeId id = withChildren(add(ASTNode::Type::GROUP), &child, 1);
+    nodes_[id].groupIndex = idx;
+    return id;
+  }
+
+  NodeId Lookaround(ASTNode::Type type, NodeId body, bool negated) {
+    NodeId id = withChildren(add(type), &body, 1);
+    nodes_[id].negated = negated;
+    return id;
+  }
+
+  NodeId Backref(int group) {
+    NodeId id = add(ASTNode::Type::BACKREF);
+    nodes_[id].groupIndex = group;
+    return id;
+  }
+
+ private:
+  std::vector<ASTNode> nodes_;
+  std::vector<NodeId> children_;
+
+  NodeId withChildren(NodeId id, const NodeId* items, uint32_t count) {
+    nodes_[id].firstChild = static_cast<uint32_t>(children_.size());
+    nodes_[id].numChildren = count;
+    nodes_[id].position = nodes_[items[0]].position;
+    children_.insert(children_.end(), items, items + count);
+    return id;
   }
 };
 
 // ============================================================================
-// Parser - Recursive Descent Parser
+// Parser - Iterative Parser over a Lazy Token Stream
 // ============================================================================
+// Pattern-wide modes from Regex::CompileFlag. Inline modifiers change them
+// for the rest of the enclosing group, (?i), or for one group, (?i:...).
+struct ParserOptions {
+  bool ignoreCase = false;  // Letters match either case, (?i)
+  bool multiline = false;   // '^' and '$' also match at line breaks, (?m)
+  bool dotAll = false;      // '.' also matches '\n', (?s)
+};
+
 class Parser {
  public:
-  explicit Parser(const std::vector<Token>& tokens) : tokens_(tokens) {}
+  Parser(const std::string& pattern, ASTArena& arena, ParserOptions options = ParserOptions())
+      : lexer_(pattern),
+        arena_(arena),
+        lookahead_(lexer_.next()),
+        initial_(options),
+        options_(options) {}
 
-  std::unique_ptr<ASTNode> parse() {
+  // Grammar:
+  // alternation ::= concatenation ('|' concatenation)*
+  // concatenation ::= quantifier+
+  // quantifier ::= atom [?*+|{n,m}]
+  // atom ::= literal | '.' | '(' group ')' | '[' class ']' | escape
+  // group ::= ['?' modifiers ':'] alternation | '?' modifiers | '?' ['<'] [=!] alternation
+  // modifiers ::= [ims]* ['-' [ims]*]
+  // class ::= char [- char] ...
+  //
+  // Groups are tracked on an explicit frame stack instead of recursion, so
+  // nesting depth is bounded by MAX_NESTING_DEPTH rather than the native stack.
+  NodeId parse() {
     currentCapture_ = 0;
-    auto result = parseAlternation();
-    if (pos_ < tokens_.size()) {
-      throw RegexError("Unexpected tokens at end of pattern", tokens_[pos_].position);
+    options_ = initial_;
+    frames_.clear();
+    frames_.push_back({GroupKind::ROOT, -1, 0, 0, 0, options_});
+
+    while (true) {
+      switch (peek().type) {
+        case TokenType::UNKNOWN:  // End of pattern
+          if (frames_.size() > 1) {
+            const Frame& open = frames_.back();
+            const char* message = "Expected ')' to close lookaround";
+            if (open.kind == GroupKind::CAPTURE) {
+              message = "Expected ')' to close group";
+            } else if (open.kind == GroupKind::NON_CAPTURE) {
+              message = "Expected ')' to close non-capturing group";
+            }
+            throw RegexError(message, open.position);
+          }
+          return closeGroup(peek().position);
+
+        case TokenType::PIPE:
+          closeAlternative(consume().position);
+          break;
+
+        case TokenType::LPAREN:
+          openGroup(consume().position);
+          break;
+
+        case TokenType::RPAREN: {
+          if (frames_.size() == 1) {
+            throw RegexError("Unexpected tokens at end of pattern", peek().position);
+          }
+          NodeId group = closeGroup(consume().position);
+          items_.push_back(parseQuantifier(group));
+          break;
+        }
+
+        default: {
+          size_t position = peek().position;
+          NodeId atom = parseAtom();
+          arena_[atom].position = static_cast<uint32_t>(position);
+          items_.push_back(parseQuantifier(atom));
+          break;
+        }
+      }
     }
-    return result;
   }
 
   int numCaptures() const {
@@ -537,72 +1027,158 @@ class Parser {
   }
 
  private:
-  const std::vector<Token>& tokens_;
-  size_t pos_ = 0;
+  enum class GroupKind : uint8_t {
+    ROOT,
+    CAPTURE,
+    NON_CAPTURE,
+    LOOKAHEAD,
+    NEG_LOOKAHEAD,
+    LOOKBEHIND,
+    NEG_LOOKBEHIND
+  };
+
+  // One open group. Its operands sit above the enclosing group's in items_
+  // and alts_, so closing a group only ever pops from the top of both stacks.
+  struct Frame {
+    GroupKind kind;
+    int groupIndex;
+    size_t position;  // Offset of the opening '('
+    size_t itemBase;  // Start of the current alternative's operands in items_
+    size_t altBase;   // Start of the finished alternatives in alts_
+    ParserOptions outer;  // Modes to restore when the group closes
+  };
+
+  Lexer lexer_;
+  ASTArena& arena_;
+  Token lookahead_;
+  ParserOptions initial_;
+  ParserOptions options_;  // Modes in effect at the current token
   int currentCapture_ = 0;
+  std::vector<Frame> frames_;
+  std::vector<NodeId> items_;  // Operands of the CONCATs under construction
+  std::vector<NodeId> alts_;   // Operands of the ALTERNATEs under construction
 
-  Token peek() const {
-    return (pos_ < tokens_.size()) ? tokens_[pos_] : Token(TokenType::UNKNOWN);
+  const Token& peek() const {
+    return lookahead_;
   }
 
   Token consume() {
-    return (pos_ < tokens_.size()) ? tokens_[pos_++] : Token(TokenType::UNKNOWN);
+    Token t = lookahead_;
+    if (t.type != TokenType::UNKNOWN) {
+      lookahead_ = lexer_.next();
+    }
+    return t;
   }
 
   bool match(TokenType type) {
     if (peek().type == type) {
-      ++pos_;
+      consume();
       return true;
     }
     return false;
   }
 
-  // Grammar:
-  // alternation ::= concatenation ('|' concatenation)*
-  // concatenation ::= quantifier+
-  // quantifier ::= atom [?*+|{n,m}]
-  // atom ::= literal | '.' | '(' group ')' | '[' class ']' | escape
-  // group ::= alternation
-  // class ::= char [- char] ...
-
-  std::unique_ptr<ASTNode> parseAlternation() {
-    auto left = parseConcatenation();
-    while (match(TokenType::PIPE)) {
-      auto right = parseConcatenation();
-      left = ASTNode::Alternate(std::move(left), std::move(right));
+  void openGroup(size_t position) {
+    if (frames_.size() > MAX_NESTING_DEPTH) {
+      throw RegexError("Groups nested too deeply", position);
+    }
+    GroupKind kind = GroupKind::CAPTURE;
+    int groupIndex = -1;
+    ParserOptions outer = options_;
+    // Non-capturing group (?:...), optionally with modifiers as in (?i:...),
+    // or modifiers alone as in (?i)
+    if (peek().type == TokenType::QUESTION) {
+      consume();
+      bool behind = peek().type == TokenType::LITERAL && peek().value == '<';
+      if (behind) {
+        consume();
+      }
+      if (peek().type == TokenType::LITERAL && (peek().value == '=' || peek().value == '!')) {
+        bool negated = consume().value == '!';
+        if (behind) {
+          kind = negated ? GroupKind::NEG_LOOKBEHIND : GroupKind::LOOKBEHIND;
+        } else {
+          kind = negated ? GroupKind::NEG_LOOKAHEAD : GroupKind::LOOKAHEAD;
+        }
+        frames_.push_back({kind, groupIndex, position, items_.size(), alts_.size(), outer});
+        return;
+      }
+      if (behind) {
+        throw RegexError("Invalid group modifier", position);
+      }
+      bool on = true;
+      while (true) {
+        const Token& t = peek();
+        if (t.type == TokenType::RANGE && on) {
+          on = false;
+        } else if (t.type == TokenType::LITERAL && t.value == 'i') {
+          options_.ignoreCase = on;
+        } else if (t.type == TokenType::LITERAL && t.value == 'm') {
+          options_.multiline = on;
+        } else if (t.type == TokenType::LITERAL && t.value == 's') {
+          options_.dotAll = on;
+        } else {
+          break;
+        }
+        consume();
+      }
+      if (match(TokenType::RPAREN)) {
+        return;  // Applies to the rest of the enclosing group
+      }
+      if (peek().type != TokenType::LITERAL || peek().value != ':') {
+        throw RegexError("Invalid group modifier", position);
+      }
+      consume();
+      kind = GroupKind::NON_CAPTURE;
+    } else {
+      groupIndex = ++currentCapture_;
     }
-    return left;
+    frames_.push_back({kind, groupIndex, position, items_.size(), alts_.size(), outer});
   }
 
-  std::unique_ptr<ASTNode> parseConcatenation() {
-    auto left = parseQuantifier();
-    while (isQuantifierStart()) {
-      auto right = parseQuantifier();
-      left = ASTNode::Concat(std::move(left), std::move(right));
+  // Finish the current alternative of the innermost group
+  void closeAlternative(size_t position) {
+    Frame& frame = frames_.back();
+    if (items_.size() == frame.itemBase) {
+      throw RegexError("Unexpected token", position);
     }
-    return left;
+    alts_.push_back(reduce(items_, frame.itemBase, ASTNode::Type::CONCAT));
   }
 
-  bool isQuantifierStart() {
-    Token t = peek();
-    switch (t.type) {
-      case TokenType::LITERAL:
-      case TokenType::RANGE:  // '-' can have quantifiers
-      case TokenType::DOT:
-      case TokenType::LPAREN:
-      case TokenType::LBRACKET:
-      case TokenType::ESCAPE:
-      case TokenType::CARET:
-      case TokenType::DOLLAR:
-        return true;
-      default:
-        return false;
+  // Finish the innermost group and return the node that replaces it
+  NodeId closeGroup(size_t position) {
+    closeAlternative(position);
+    Frame frame = frames_.back();
+    frames_.pop_back();
+    options_ = frame.outer;
+    NodeId node = reduce(alts_, frame.altBase, ASTNode::Type::ALTERNATE);
+    if (frame.kind == GroupKind::CAPTURE) {
+      node = arena_.Group(node, frame.groupIndex);
+      arena_[node].position = static_cast<uint32_t>(frame.position);
+    } else if (frame.kind != GroupKind::ROOT && frame.kind != GroupKind::NON_CAPTURE) {
+      bool behind = frame.kind == GroupKind::LOOKBEHIND || frame.kind == GroupKind::NEG_LOOKBEHIND;
+      node = arena_.Lookaround(behind ? ASTNode::Type::LOOKBEHIND : ASTNode::Type::LOOKAHEAD,
+                               node,
+                               frame.kind == GroupKind::NEG_LOOKAHEAD ||
+                                   frame.kind == GroupKind::NEG_LOOKBEHIND);
+      arena_[node].position = static_cast<uint32_t>(frame.position);
     }
+    return node;
   }
 
-  std::unique_ptr<ASTNode> parseQuantifier() {
-    auto atom = parseAtom();
+  // Turn stack[base, end) into one n-ary node (or the lone operand)
+  NodeId reduce(std::vector<NodeId>& stack, size_t base, ASTNode::Type type) {
+    uint32_t count = static_cast<uint32_t>(stack.size() - base);
+    NodeId node = stack[base];
+    if (count > 1) {
+      node = type == ASTNode::Type::CONCAT ? arena_.Concat(&stack[base], count)
+                                           : arena_.Alternate(&stack[base], count);
+    }
+    stack.resize(base);
+    return node;
+  }
 
+  NodeId parseQuantifier(NodeId atom) {
     Token t = peek();
     uint32_t min = 0, max = 0;
     bool hasQuant = false;
@@ -632,7 +1208,8 @@ class Parser {
         min = parseNumber();
         max = min;
         if (match(TokenType::COMMA)) {
-          max = parseNumber();
+          // {n,} has no upper bound
+          max = peek().type == TokenType::RBRACE ? UINT32_MAX : parseNumber();
         }
         if (!match(TokenType::RBRACE)) {
           throw RegexError("Expected '}' after quantifier", t.position);
@@ -644,7 +1221,20 @@ class Parser {
     }
 
     if (hasQuant) {
-      return ASTNode::Repeat(std::move(atom), min, max, greedy);
+      if (max < min) {
+        throw RegexError("Quantifier range out of order", t.position);
+      }
+      // A trailing '?' makes the quantifier lazy
+      if (match(TokenType::QUESTION)) {
+        greedy = false;
+      }
+      // Repeating an assertion tests the same position again, so it is
+      // either the assertion itself or, when optional, always true
+      if (arena_[atom].type == ASTNode::Type::LOOKAHEAD ||
+          arena_[atom].type == ASTNode::Type::LOOKBEHIND) {
+        return min == 0 ? arena_.Repeat(atom, 0, 1, greedy) : atom;
+      }
+      return arena_.Repeat(atom, min, max, greedy);
     }
     return atom;
   }
@@ -658,68 +1248,24 @@ class Parser {
     return result;
   }
 
-  std::unique_ptr<ASTNode> parseAtom() {
+  NodeId parseAtom() {
     Token t = consume();
 
     switch (t.type) {
       case TokenType::LITERAL:
-        return ASTNode::Literal(t.value);
+        return literal(t.value);
 
       case TokenType::RANGE:  // '-' outside of character class
-        return ASTNode::Literal('-');
+        return arena_.Literal('-');
 
       case TokenType::COMMA:  // ',' outside of quantifier
-        return ASTNode::Literal(',');
+        return arena_.Literal(',');
 
       case TokenType::DOT:
-        return ASTNode::Dot();
-
-      case TokenType::LPAREN:
-        // Check for non-capturing group (?:...)
-        if (peek().type == TokenType::LITERAL && peek().value == '?') {
-          consume();
-          if (peek().type == TokenType::LITERAL && peek().value == ':') {
-            consume();
-            auto node = parseAlternation();
-            if (!match(TokenType::RPAREN)) {
-              throw RegexError("Expected ')' to close non-capturing group", t.position);
-            }
-            return node;
-          }
-          throw RegexError("Invalid group modifier", t.position);
-        }
-
-        // Check for positive lookahead (?=...)
-        if (peek().type == TokenType::LITERAL && peek().value == '=') {
-          consume();
-          auto node = parseAlternation();
-          if (!match(TokenType::RPAREN)) {
-            throw RegexError("Expected ')' to close lookahead", t.position);
-          }
-          return node;
-        }
-
-        // Check for negative lookahead (?!...)
-        if (peek().type == TokenType::LITERAL && peek().value == '!') {
-          consume();
-          auto node = parseAlternation();
-          if (!match(TokenType::RPAREN)) {
-            throw RegexError("Expected ')' to close lookahead", t.position);
-          }
-          return node;
-        }
-
-        ++currentCapture_;
-        {
-          auto node = parseAlternation();
-          if (!match(TokenType::RPAREN)) {
-            throw RegexError("Expected ')' to close group", t.position);
-          }
-          return ASTNode::Group(std::move(node), currentCapture_);
-        }
+        return arena_.Dot(options_.dotAll);
 
       case TokenType::LBRACKET: {
-        auto classNode = parseCharacterClass();
+        NodeId classNode = parseCharacterClass();
         if (!match(TokenType::RBRACKET)) {
           throw RegexError("Expected ']' to close character class", t.position);
         }
@@ -732,25 +1278,21 @@ class Parser {
 
       case TokenType::BACKREF: {
         uint32_t group = parseNumber();
-        return ASTNode::Backref(group);
+        return arena_.Backref(group);
       }
 
-      case TokenType::CARET: {
-        auto node = std::make_unique<ASTNode>(ASTNode::Type::ANCHOR_START);
-        return node;
-      }
+      case TokenType::CARET:
+        return arena_.Anchor(ASTNode::Type::ANCHOR_START, options_.multiline);
 
-      case TokenType::DOLLAR: {
-        auto node = std::make_unique<ASTNode>(ASTNode::Type::ANCHOR_END);
-        return node;
-      }
+      case TokenType::DOLLAR:
+        return arena_.Anchor(ASTNode::Type::ANCHOR_END, options_.multiline);
 
       default:
         throw RegexError("Unexpected token", t.position);
     }
   }
 
-  std::unique_ptr<ASTNode> parseCharacterClass() {
+  NodeId parseCharacterClass() {
     bool negated = false;
     uint64_t low_mask = 0;   // Characters 0-63
     uint64_t high_mask = 0;  // Characters 64-127
@@ -765,19 +1307,24 @@ class Parser {
         char esc = consume().value;
         uint64_t bits = 0;
         uint64_t bits_high = 0;
-        if (esc == 'd')
+        // Class shorthands and their complements over 0-127
+        if (esc == 'd') {
           bits = CharClass::DIGIT_MASK;
-        else if (esc == 'D')
+        } else if (esc == 'D') {
+          bits = ~CharClass::DIGIT_MASK;
+          bits_high = ~0ULL;
+        } else if (esc == 'w') {
           bits = CharClass::DIGIT_MASK;
-        else if (esc == 'w')
-          bits = 0ULL;  // Will use function
-        else if (esc == 'W')
-          bits = 0ULL;
-        else if (esc == 's')
+          bits_high = CharClass::WORD_MASK_HIGH;
+        } else if (esc == 'W') {
+          bits = ~CharClass::DIGIT_MASK;
+          bits_high = ~CharClass::WORD_MASK_HIGH;
+        } else if (esc == 's') {
           bits = CharClass::SPACE_MASK;
-        else if (esc == 'S')
-          bits = CharClass::SPACE_MASK;
-        else if (esc == 't')
+        } else if (esc == 'S') {
+          bits = ~CharClass::SPACE_MASK;
+          bits_high = ~0ULL;
+        } else if (esc == 't')
           bits = (1ULL << '\t');
         else if (esc == 'r')
           bits = (1ULL << '\r');
@@ -807,20 +1354,19 @@ class Parser {
           else if (static_cast<uint8_t>(esc) < 128)
             bits_high = (1ULL << (static_cast<uint8_t>(esc) - 64));
         }
-        if (negated) {
-          low_mask |= bits;
-          high_mask |= bits_high;
-        } else {
-          low_mask |= bits;
-          high_mask |= bits_high;
-        }
+        low_mask |= bits;
+        high_mask |= bits_high;
         continue;
       } else {
         char c = consume().value;
         uint8_t uc = static_cast<uint8_t>(c);
         if (peek().type == TokenType::RANGE) {
           consume();
-          char end_char = consume().value;
+          // A '-' right before ']' is a literal
+          if (peek().type == TokenType::RBRACKET) {
+            low_mask |= 1ULL << '-';
+          }
+          char end_char = peek().type == TokenType::RBRACKET ? c : consume().value;
           for (int i = c; i <= end_char; ++i) {
             uc = static_cast<uint8_t>(i);
             if (uc < 64)
@@ -837,64 +1383,77 @@ class Parser {
       }
     }
 
-    auto node =
-        std::make_unique<ASTNode>(negated ? ASTNode::Type::NOT_CLASS : ASTNode::Type::CLASS);
+    if (options_.ignoreCase) {
+      high_mask = CharClass::foldCase(high_mask);
+    }
+    NodeId node = arena_.add(negated ? ASTNode::Type::NOT_CLASS : ASTNode::Type::CLASS);
     // For negated class, store the EXCLUDED characters, engine will handle NOT
-    node->classbits = low_mask;
-    node->classbits_high = high_mask;
+    arena_[node].classbits = low_mask;
+    arena_[node].classbits_high = high_mask;
     return node;
   }
 
-  std::unique_ptr<ASTNode> parseEscape(const Token& escTok) {
+  NodeId parseEscape(const Token& escTok) {
     char esc = escTok.value;  // The escaped character is already in the token!
 
     switch (esc) {
       case 'd': {
-        auto node = std::make_unique<ASTNode>(ASTNode::Type::CLASS);
-        node->class_type = CLASS_DIGIT;
+        NodeId node = arena_.add(ASTNode::Type::CLASS);
+        arena_[node].class_type = CLASS_DIGIT;
         return node;
       }
       case 'D': {
-        auto node = std::make_unique<ASTNode>(ASTNode::Type::NOT_CLASS);
-        node->class_type = CLASS_DIGIT;
+        NodeId node = arena_.add(ASTNode::Type::NOT_CLASS);
+        arena_[node].class_type = CLASS_DIGIT;
         return node;
       }
       case 'w': {
-        auto node = std::make_unique<ASTNode>(ASTNode::Type::CLASS);
-        node->class_type = CLASS_WORD;
+        NodeId node = arena_.add(ASTNode::Type::CLASS);
+        arena_[node].class_type = CLASS_WORD;
         return node;
       }
       case 'W': {
-        auto node = std::make_unique<ASTNode>(ASTNode::Type::NOT_CLASS);
-        node->class_type = CLASS_WORD;
+        NodeId node = arena_.add(ASTNode::Type::NOT_CLASS);
+        arena_[node].class_type = CLASS_WORD;
         return node;
       }
       case 's': {
-        auto node = std::make_unique<ASTNode>(ASTNode::Type::CLASS);
-        node->class_type = CLASS_SPACE;
+        NodeId node = arena_.add(ASTNode::Type::CLASS);
+        arena_[node].class_type = CLASS_SPACE;
         return node;
       }
       case 'S': {
-        auto node = std::make_unique<ASTNode>(ASTNode::Type::NOT_CLASS);
-        node->class_type = CLASS_SPACE;
+        NodeId node = arena_.add(ASTNode::Type::NOT_CLASS);
+        arena_[node].class_type = CLASS_SPACE;
         return node;
       }
       case 'b':
-      case 'B':  // Word boundary - not implemented yet, treat as literal 'b'
-        return ASTNode::Literal('b');
+        return arena_.add(ASTNode::Type::WORD_BOUNDARY);
+      case 'B':
+        return arena_.add(ASTNode::Type::NOT_WORD_BOUNDARY);
       case 't':
-        return ASTNode::Literal('\t');
+        return arena_.Literal('\t');
       case 'r':
-        return ASTNode::Literal('\r');
+        return arena_.Literal('\r');
       case 'n':
-        return ASTNode::Literal('\n');
+        return arena_.Literal('\n');
       case 'f':
-        return ASTNode::Literal('\f');
+        return arena_.Literal('\f');
       case 'v':
-        return ASTNode::Literal('\v');
+        return arena_.Literal('\v');
       default:
-        return ASTNode::Literal(esc);
+        return literal(esc);
+    }
+  }
+
+  // Under ignoreCase a letter becomes the class of both its cases
+  NodeId literal(char c) {
+    if (!options_.ignoreCase || !CharClass::isAlpha(c)) {
+      return arena_.Literal(c);
     }
+    NodeId node = arena_.add(ASTNode::Type::CLASS);
+    arena_[node].classbits_high = CharClass::foldCase(1ULL << (static_cast<uint8_t>(c) - 64));
+    return node;
   }
 
   uint8_t parseHexDigit(char c) {
@@ -907,12 +1466,12 @@ class Parser {
     return 0;
   }
 
-  std::unique_ptr<ASTNode> parseAnchorStart() {
-    return std::make_unique<ASTNode>(ASTNode::Type::ANCHOR_START);
+  NodeId parseAnchorStart() {
+    return arena_.add(ASTNode::Type::ANCHOR_START);
   }
 
-  std::unique_ptr<ASTNode> parseAnchorEnd() {
-    return std::make_unique<ASTNode>(ASTNode::Type::ANCHOR_END);
+  NodeId parseAnchorEnd() {
+    return arena_.add(ASTNode::Type::ANCHOR_END);
   }
 };
 
@@ -923,20 +1482,62 @@ class Compiler {
  public:
   Compiler() : captureCount_(0) {}
 
-  std::vector<Instruction> compile(const std::unique_ptr<ASTNode>& root, int numCaptures) {
+  std::vector<Instruction> compile(const ASTArena& arena, NodeId root, int numCaptures) {
     captureCount_ = numCaptures + 1;
+    arena_ = &arena;
     instructions_.clear();
-    compileNode(root.get());
-    instructions_.push_back(Instruction::Match());
+    sourceMap_.clear();
+    lookarounds_.clear();
+    reverse_ = false;
+    compileNode(root);
+    position_ = NO_SOURCE;
+    emit(Instruction::Match());
+    // Lookaround bodies follow as sub-programs ending in MATCH of their own;
+    // nested ones are queued while their parent's body is compiled. A
+    // lookbehind body is compiled back to front, to run backward from the
+    // position being tested.
+    for (size_t i = 0; i < lookarounds_.size(); ++i) {
+      Instruction& look = instructions_[lookarounds_[i].pc];
+      uint32_t start = static_cast<uint32_t>(instructions_.size());
+      look.operand = start;
+      look.charset_low = i;
+      reverse_ = look.opcode == Opcode::LOOKBEHIND || look.opcode == Opcode::NEG_LOOKBEHIND;
+      compileNode(lookarounds_[i].body);
+      if (reverse_ && std::all_of(instructions_.begin() + start, instructions_.end(),
+                                  [](const Instruction& inst) { return inst.consumes(); })) {
+        instructions_[lookarounds_[i].pc].charset_high = instructions_.size() - start;
+      }
+      position_ = NO_SOURCE;
+      emit(Instruction::Match());
+    }
     return std::move(instructions_);
   }
 
+  // Pattern offset of the node each instruction of the last compile came
+  // from, or NO_SOURCE for the final MATCH
+  const std::vector<uint32_t>& sourceMap() const {
+    return sourceMap_;
+  }
+
+  static constexpr uint32_t NO_SOURCE = UINT32_MAX;
+
  private:
   std::vector<Instruction> instructions_;
+  std::vector<uint32_t> sourceMap_;
+  uint32_t position_ = 0;  // Offset of the node being compiled
+  const ASTArena* arena_ = nullptr;
   int captureCount_;
+  bool reverse_ = false;  // Compiling a lookbehind body: sequences run last to first
+
+  struct PendingLookaround {
+    uint32_t pc;  // The LOOKAHEAD/LOOKBEHIND instruction
+    NodeId body;
+  };
+  std::vector<PendingLookaround> lookarounds_;
 
   void emit(const Instruction& inst) {
     instructions_.push_back(inst);
+    sourceMap_.push_back(position_);
   }
 
   uint32_t emitJump() {
@@ -945,15 +1546,31 @@ class Compiler {
     return pos;
   }
 
+  // SPLIT tries `operand` first: the body for a greedy repeat, the skip for
+  // a lazy one
+  void patchSplit(uint32_t pos, uint32_t body, uint32_t skip, bool greedy) {
+    Instruction& inst = instructions_[pos];
+    inst.operand = greedy ? body : skip;
+    inst.charset = greedy ? skip : body;
+  }
+
+  // Counted repeats copy their body, so a nested count can blow up
+  void checkSize() const {
+    if (instructions_.size() > MAX_INSTRUCTIONS) {
+      throw RegexError("Pattern compiles too large", position_);
+    }
+  }
+
   void patchJump(uint32_t pos, uint32_t target) {
     if (pos < instructions_.size()) {
       ((Instruction&)instructions_[pos]).operand = target;
     }
   }
 
-  void compileNode(ASTNode* node) {
-    if (!node)
-      return;
+  void compileNode(NodeId id) {
+    const ASTNode* node = &(*arena_)[id];
+    uint32_t parentPosition = position_;
+    position_ = node->position;
 
     switch (node->type) {
       case ASTNode::Type::LITERAL:
@@ -961,7 +1578,7 @@ class Compiler {
         break;
 
       case ASTNode::Type::DOT:
-        emit(Instruction::Any());
+        emit(node->dotAll ? Instruction::Any() : Instruction::AnyNoNewline());
         break;
 
       case ASTNode::Type::CLASS: {
@@ -992,97 +1609,108 @@ class Compiler {
       }
 
       case ASTNode::Type::ANCHOR_START:
-        emit(Instruction::AnchorStart());
+        emit(node->multiline ? Instruction::LineStart() : Instruction::AnchorStart());
         break;
 
       case ASTNode::Type::ANCHOR_END:
-        emit(Instruction::AnchorEnd());
+        emit(node->multiline ? Instruction::LineEnd() : Instruction::AnchorEnd());
+        break;
+
+      case ASTNode::Type::WORD_BOUNDARY:
+      case ASTNode::Type::NOT_WORD_BOUNDARY:
+        emit(Instruction::WordBoundary(node->type == ASTNode::Type::NOT_WORD_BOUNDARY));
+        break;
+
+      case ASTNode::Type::LOOKAHEAD:
+      case ASTNode::Type::LOOKBEHIND:
+        lookarounds_.push_back({static_cast<uint32_t>(instructions_.size()), arena_->child(id, 0)});
+        emit(node->type == ASTNode::Type::LOOKAHEAD ? Instruction::Lookahead(node->negated)
+                                                    : Instruction::Lookbehind(node->negated));
         break;
 
       case ASTNode::Type::CONCAT:
-        for (auto& child : node->children) {
-          compileNode(child.get());
+        for (uint32_t i = 0; i < node->numChildren; ++i) {
+          compileNode(arena_->child(id, reverse_ ? node->numChildren - 1 - i : i));
         }
         break;
 
       case ASTNode::Type::ALTERNATE: {
-        if (node->children.size() != 2) {
-          for (auto& child : node->children) {
-            compileNode(child.get());
+        // Chain of SPLITs, one per alternative but the last:
+        //   SPLIT(L0, N1) L0: alt0 JUMP(end) N1: SPLIT(L1, N2) ... Nk: altk end:
+        // Pending JUMPs are threaded through their operands until `end` is known
+        uint32_t pendingJumps = UINT32_MAX;
+        for (uint32_t i = 0; i < node->numChildren; ++i) {
+          bool last = i + 1 == node->numChildren;
+          uint32_t splitPos = instructions_.size();
+          if (!last) {
+            emit(Instruction::Split(0, 0));  // Will patch later
           }
-          break;
+          compileNode(arena_->child(id, i));
+          if (!last) {
+            uint32_t jumpPos = instructions_.size();
+            emit(Instruction::Jump(pendingJumps));
+            pendingJumps = jumpPos;
+            // target1 = this alternative, target2 = after the JUMP
+            ((Instruction&)instructions_[splitPos]).operand = splitPos + 1;
+            ((Instruction&)instructions_[splitPos]).charset = jumpPos + 1;
+          }
+        }
+        // Patch every JUMP to go to end
+        uint32_t end = instructions_.size();
+        while (pendingJumps != UINT32_MAX) {
+          uint32_t next = instructions_[pendingJumps].operand;
+          ((Instruction&)instructions_[pendingJumps]).operand = end;
+          pendingJumps = next;
         }
-        // Emit SPLIT instruction for alternation
-        // SPLIT(target1, target2) where target1 = first alternative, target2 = second alternative
-        uint32_t splitPos = instructions_.size();
-        emit(Instruction::Split(0, 0));        // Will patch later
-        compileNode(node->children[0].get());  // First alternative
-        uint32_t jumpPos = instructions_.size();
-        emit(Instruction::Jump(0));  // Jump over second alternative
-        // Patch SPLIT to point to second alternative
-        ((Instruction&)instructions_[splitPos]).operand =
-            splitPos + 1;  // target1 = next instruction
-        ((Instruction&)instructions_[splitPos]).charset = jumpPos + 1;  // target2 = after the JUMP
-        compileNode(node->children[1].get());                           // Second alternative
-        // Patch JUMP to go to end
-        ((Instruction&)instructions_[jumpPos]).operand = instructions_.size();
         break;
       }
 
       case ASTNode::Type::REPEAT: {
-        auto& child = node->children[0];
+        NodeId child = arena_->child(id, 0);
         uint32_t min = node->minRepeat;
         uint32_t max = node->maxRepeat;
-
-        if (max == UINT32_MAX) {
-          if (min == 0) {
-            // * - zero or more
-            // Structure: SPLIT(body, Skip) ... body ... JUMP(SPLIT)
-            uint32_t splitPos = instructions_.size();
-            emit(Instruction::Split(0, 0));  // Will patch
-            uint32_t bodyStart = splitPos + 1;
-            compileNode(child.get());
-            uint32_t jumpPos = instructions_.size();
-            emit(Instruction::Jump(0));  // JUMP back to SPLIT
-            // Patch SPLIT: target1 = bodyStart, target2 = after JUMP
-            ((Instruction&)instructions_[splitPos]).operand = bodyStart;
-            ((Instruction&)instructions_[splitPos]).charset = jumpPos + 1;
-            // Patch JUMP to go back to SPLIT
-            ((Instruction&)instructions_[jumpPos]).operand = splitPos;
-          } else {
-            // + - one or more
-            // Structure: body ... SPLIT(body, Skip)
-            compileNode(child.get());
-            uint32_t splitPos = instructions_.size();
-            emit(Instruction::Split(0, 0));  // Will patch
-            uint32_t repeatStart = splitPos + 1;
-            compileNode(child.get());
-            uint32_t jumpPos = instructions_.size();
-            emit(Instruction::Jump(0));  // JUMP back to SPLIT
-            // Patch SPLIT: target1 = repeatStart, target2 = after JUMP
-            ((Instruction&)instructions_[splitPos]).operand = repeatStart;
-            ((Instruction&)instructions_[splitPos]).charset = jumpPos + 1;
-            // Patch JUMP to go back to SPLIT
-            ((Instruction&)instructions_[jumpPos]).operand = splitPos;
-          }
-        } else if (max == 1 && min == 0) {
-          // ? - zero or one
-          // Structure: SPLIT(body, Skip) ... body
+        bool greedy = node->greedy;
+
+        // The required copies first: x{2,4} is x x (x (x)?)?. An unbounded
+        // repeat loops over its last required copy, so x{2,} is x x+ and x+
+        // is a single copy of x followed by SPLIT back to it.
+        uint32_t copies = max == UINT32_MAX && min > 0 ? min - 1 : min;
+        for (uint32_t i = 0; i < copies; ++i) {
+          compileNode(child);
+          checkSize();
+        }
+        if (max == UINT32_MAX && min > 0) {
+          // Structure: body ... body ... SPLIT(body, next)
+          uint32_t bodyPos = instructions_.size();
+          compileNode(child);
+          uint32_t splitPos = instructions_.size();
+          emit(Instruction::Split(0, 0));
+          patchSplit(splitPos, bodyPos, splitPos + 1, greedy);
+          checkSize();
+        } else if (max == UINT32_MAX) {
+          // Structure: SPLIT(body, Skip) ... body ... JUMP(SPLIT)
           uint32_t splitPos = instructions_.size();
           emit(Instruction::Split(0, 0));  // Will patch
-          uint32_t bodyStart = splitPos + 1;
-          compileNode(child.get());
-          // Patch SPLIT: target1 = bodyStart, target2 = after body
-          ((Instruction&)instructions_[splitPos]).operand = bodyStart;
-          ((Instruction&)instructions_[splitPos]).charset = instructions_.size();
-        } else if (max == 1) {
-          // Exactly one - just emit body
-          compileNode(child.get());
-        } else {
-          // {n,m} - fixed range
-          // For now, only handle the minimum required
-          for (uint32_t i = 0; i < min; ++i) {
-            compileNode(child.get());
+          compileNode(child);
+          uint32_t jumpPos = instructions_.size();
+          emit(Instruction::Jump(splitPos));  // JUMP back to SPLIT
+          patchSplit(splitPos, splitPos + 1, jumpPos + 1, greedy);
+        } else if (max > min) {
+          // Each optional copy is SPLIT(body, end); they all skip to the same
+          // end, threaded through the SPLITs' charset until it is known
+          uint32_t pendingSplits = UINT32_MAX;
+          for (uint32_t i = min; i < max; ++i) {
+            uint32_t splitPos = instructions_.size();
+            emit(Instruction::Split(splitPos + 1, pendingSplits));
+            pendingSplits = splitPos;
+            compileNode(child);
+            checkSize();
+          }
+          uint32_t end = instructions_.size();
+          while (pendingSplits != UINT32_MAX) {
+            uint32_t next = static_cast<uint32_t>(instructions_[pendingSplits].charset);
+            patchSplit(pendingSplits, pendingSplits + 1, end, greedy);
+            pendingSplits = next;
           }
         }
         break;
@@ -1091,7 +1719,7 @@ class Compiler {
       case ASTNode::Type::GROUP: {
         uint32_t groupIdx = node->groupIndex;
         emit(Instruction::Save(groupIdx * 2));
-        compileNode(node->children[0].get());
+        compileNode(arena_->child(id, 0));
         emit(Instruction::Save(groupIdx * 2 + 1));
         break;
       }
@@ -1101,292 +1729,2820 @@ class Compiler {
         break;
       }
     }
+    position_ = parentPosition;
   }
 };
 
 // ============================================================================
-// Virtual Machine - Non-recursive Execution Engine
+// Pattern Analysis - Static Backtracking Cost
 // ============================================================================
-class VM {
+// Matching engines a caller can ask for. LINEAR is a simulation that never
+// backtracks, so its cost is bounded by program size x input length, but it
+// cannot evaluate backreferences.
+enum class Engine : uint8_t { AUTO, BACKTRACKING, LINEAR };
+
+// Worst-case steps of a failing backtracking match, as a function of the
+// input length n, for a match attempted at one position. An unanchored search
+// tries every position and adds one more factor of n on top.
+enum class Complexity : uint8_t { LINEAR, POLYNOMIAL, EXPONENTIAL };
+
+// One construct that makes backtracking cost grow faster than linear
+struct AnalysisFinding {
+  enum class Kind : uint8_t {
+    NESTED_QUANTIFIER,        // (a+)+ - an unbounded repeat in the tail of another
+    AMBIGUOUS_ALTERNATION,    // (a|a)* - alternatives that match the same text
+    EMPTY_LOOP,               // (a*)* - a loop whose body can match nothing
+    OVERLAPPING_QUANTIFIERS,  // \d+\d+ - adjacent repeats that can trade characters
+    OPTIONAL_RUN,             // (a?){25}a{25} - many optional or ambiguous items in a row
+    LOOKAROUND_SCAN,          // (?=.*c)b - a lookaround body that can read the whole text
+  };
+
+  Kind kind;
+  Complexity complexity;
+  uint32_t degree;  // Exponent for POLYNOMIAL
+  size_t position;  // Offset of the construct in the pattern
+  std::string detail;
+};
+
+// Input shaped prefix + pump x repeat + suffix. The suffix makes the match
+// fail, and every extra pump multiplies the work as reported by the analysis.
+struct AttackInput {
+  std::string prefix;
+  std::string pump;
+  std::string suffix;
+  size_t repeat = 0;
+
+  bool empty() const {
+    return pump.empty();
+  }
+
+  std::string build(size_t n) const {
+    std::string s = prefix;
+    s.reserve(prefix.size() + pump.size() * n + suffix.size());
+    for (size_t i = 0; i < n; ++i) {
+      s += pump;
+    }
+    return s + suffix;
+  }
+
+  std::string str() const {
+    return build(repeat);
+  }
+};
+
+struct PatternAnalysis {
+  Complexity complexity = Complexity::LINEAR;
+  uint32_t degree = 1;
+  Engine recommendedEngine = Engine::BACKTRACKING;
+  AttackInput attack;  // Empty when the complexity is LINEAR
+  std::vector<AnalysisFinding> findings;
+
+  // Shape of the compiled program
+  size_t programSize = 0;
+  uint32_t choicePoints = 0;  // SPLIT instructions
+  uint32_t loopDepth = 0;     // Deepest nesting of backward jumps
+};
+
+// Static analyzer over a parsed pattern. It is a heuristic: it looks for the
+// known shapes of catastrophic backtracking using the first and consumable
+// byte sets of every node, so it can report a cost that a particular input
+// never reaches, but every shape it reports has a generated input that
+// exercises it.
+class PatternAnalyzer {
  public:
-  explicit VM(const std::vector<Instruction>& instructions, int captureCount)
-      : instructions_(instructions), captureCount_(captureCount) {
-    captures_.assign(captureCount * 2, std::string::npos);
-    hasCapture_ = false;
+  PatternAnalyzer(const ASTArena& arena, NodeId root) : arena_(arena), root_(root) {}
+
+  PatternAnalysis analyze(const std::vector<Instruction>& program) {
+    summarize();
+    findings_.clear();
+    attacks_.clear();
+    scan(root_, std::string(), false);
+
+    PatternAnalysis result;
+    size_t worst = findings_.size();
+    for (size_t i = 0; i < findings_.size(); ++i) {
+      if (worst == findings_.size() || worse(findings_[i], findings_[worst])) {
+        worst = i;
+      }
+    }
+    if (worst < findings_.size()) {
+      result.complexity = findings_[worst].complexity;
+      result.degree = findings_[worst].degree;
+      result.attack = attacks_[worst];
+      // The linear engine has no backreferences, so such patterns stay put
+      result.recommendedEngine = hasBackref_ ? Engine::BACKTRACKING : Engine::LINEAR;
+    }
+    result.findings = std::move(findings_);
+
+    // Loop nesting from the program: every backward JUMP or SPLIT closes a
+    // loop
+    result.programSize = program.size();
+    std::vector<int32_t> depth(program.size() + 1, 0);
+    for (size_t pc = 0; pc < program.size(); ++pc) {
+      const Instruction& inst = program[pc];
+      uint32_t back = UINT32_MAX;
+      if (inst.opcode == Opcode::SPLIT) {
+        ++result.choicePoints;
+        back = std::min(inst.operand, static_cast<uint32_t>(inst.charset));
+      } else if (inst.opcode == Opcode::JUMP) {
+        back = inst.operand;
+      }
+      if (back <= pc) {
+        ++depth[back];
+        --depth[pc + 1];
+      }
+    }
+    int32_t open = 0;
+    for (size_t pc = 0; pc < program.size(); ++pc) {
+      open += depth[pc];
+      result.loopDepth = std::max(result.loopDepth, static_cast<uint32_t>(open));
+    }
+    return result;
   }
 
-  // Try to match starting at exactly one position
-  bool executeAt(const std::string& text, size_t pos, MatchResult& result) {
-    const size_t textLen = text.length();
+ private:
+  static constexpr NodeId NONE = UINT32_MAX;
+  static constexpr size_t MAX_SEQUENCE = 1024;      // Items kept when unrolling counted repeats
+  static constexpr size_t MAX_WIDTH = 64;           // Longest fixed-width string compared
+  static constexpr uint32_t MIN_OPTIONAL_RUN = 16;  // Shortest optional run reported (2^16 paths)
+
+  struct Summary {
+    ByteSet first;          // Bytes that can start a match
+    ByteSet chars;          // Bytes that can be consumed anywhere
+    bool nullable = false;  // Can match the empty string
+    bool asserts = false;   // Contains a zero-width test that can fail
+    int32_t width = 0;      // Fixed match length, or -1 when it varies
+  };
 
-    // Reset state
-    captures_.assign(captureCount_ * 2, std::string::npos);
-    backtrackStack_.clear();
-    backtrackStack_.reserve(256);  // Pre-allocate for performance
+  const ASTArena& arena_;
+  NodeId root_;
+  std::vector<Summary> summaries_;
+  std::vector<AnalysisFinding> findings_;
+  std::vector<AttackInput> attacks_;
+  ByteSet allChars_;
+  bool hasBackref_ = false;
+
+  static bool worse(const AnalysisFinding& a, const AnalysisFinding& b) {
+    if (a.complexity != b.complexity)
+      return a.complexity > b.complexity;
+    return a.degree > b.degree;
+  }
 
-    size_t startPos = pos;
-    size_t textPos = startPos;
-    uint32_t pc = 0;
-    bool matched = false;
+  bool canFail(NodeId id) const {
+    return !summaries_[id].nullable || summaries_[id].asserts;
+  }
 
-    captures_[0] = startPos;
+  static ByteSet leafSet(const ASTNode& n) {
+    ByteSet s;
+    if (n.type == ASTNode::Type::LITERAL) {
+      s.set(static_cast<uint8_t>(n.ch));
+      return s;
+    }
+    if (n.type == ASTNode::Type::DOT) {
+      s.setAll();
+      if (!n.dotAll)
+        s.reset('\n');
+      return s;
+    }
+    for (int c = 0; c < 256; ++c) {
+      char ch = static_cast<char>(c);
+      bool in;
+      switch (n.class_type) {
+        case CLASS_DIGIT:
+          in = CharClass::isDigit(ch);
+          break;
+        case CLASS_WORD:
+          in = CharClass::isWordChar(ch);
+          break;
+        case CLASS_SPACE:
+          in = CharClass::isSpace(ch);
+          break;
+        default:
+          in = CharClass::inClassExt(n.classbits, n.classbits_high, ch);
+          break;
+      }
+      if (in != (n.type == ASTNode::Type::NOT_CLASS)) {
+        s.set(static_cast<uint8_t>(c));
+      }
+    }
+    return s;
+  }
 
-    // Main execution loop
-    while (true) {
-      // Execute current instruction path
-      while (pc < instructions_.size() && !matched) {
-        const Instruction& inst = instructions_[pc];
+  // Children are always created before their parents, so one pass in id
+  // order sees every child summary before it is needed
+  void summarize() {
+    summaries_.assign(arena_.size(), Summary());
+    hasBackref_ = false;
+    for (NodeId id = 0; id < arena_.size(); ++id) {
+      const ASTNode& n = arena_[id];
+      Summary& s = summaries_[id];
+      switch (n.type) {
+        case ASTNode::Type::LITERAL:
+        case ASTNode::Type::DOT:
+        case ASTNode::Type::CLASS:
+        case ASTNode::Type::NOT_CLASS:
+          s.first = s.chars = leafSet(n);
+          s.width = 1;
+          break;
 
-        switch (inst.opcode) {
-          case Opcode::CHAR:
-            if (textPos < textLen && text[textPos] == inst.ch) {
-              ++textPos;
-              ++pc;
-            } else {
-              goto fail;
-            }
-            break;
+        case ASTNode::Type::ANCHOR_START:
+        case ASTNode::Type::ANCHOR_END:
+        case ASTNode::Type::WORD_BOUNDARY:
+        case ASTNode::Type::NOT_WORD_BOUNDARY:
+        // Lookaround bodies run on Lookaround's simulation, never backtracked
+        // into; only how far they read is costed, see checkLookaround()
+        case ASTNode::Type::LOOKAHEAD:
+        case ASTNode::Type::LOOKBEHIND:
+          s.nullable = s.asserts = true;
+          break;
 
-          case Opcode::ANY:
-            if (textPos < textLen) {
-              ++textPos;
-              ++pc;
-            } else {
-              goto fail;
-            }
-            break;
+        case ASTNode::Type::BACKREF:
+          s.first.setAll();
+          s.chars.setAll();
+          s.nullable = s.asserts = true;
+          s.width = -1;
+          hasBackref_ = true;
+          break;
 
-          case Opcode::RANGE:
-            if (textPos < textLen && text[textPos] >= inst.lo && text[textPos] <= inst.hi) {
-              ++textPos;
-              ++pc;
-            } else {
-              goto fail;
-            }
-            break;
+        case ASTNode::Type::GROUP:
+          s = summaries_[arena_.child(id, 0)];
+          break;
 
-          case Opcode::CLASS: {
-            if (textPos < textLen &&
-                CharClass::inClassExt(inst.charset_low, inst.charset_high, text[textPos])) {
-              ++textPos;
-              ++pc;
-            } else {
-              goto fail;
-            }
-            break;
+        case ASTNode::Type::CONCAT:
+          s.nullable = true;
+          for (uint32_t i = 0; i < n.numChildren; ++i) {
+            const Summary& c = summaries_[arena_.child(id, i)];
+            if (s.nullable)
+              s.first |= c.first;
+            s.chars |= c.chars;
+            s.nullable = s.nullable && c.nullable;
+            s.asserts = s.asserts || c.asserts;
+            s.width = s.width < 0 || c.width < 0 ? -1 : s.width + c.width;
           }
+          break;
 
-          case Opcode::NOT_CLASS: {
-            if (textPos < textLen &&
-                !CharClass::inClassExt(inst.charset_low, inst.charset_high, text[textPos])) {
-              ++textPos;
-              ++pc;
-            } else {
-              goto fail;
-            }
-            break;
+        case ASTNode::Type::ALTERNATE:
+          for (uint32_t i = 0; i < n.numChildren; ++i) {
+            const Summary& c = summaries_[arena_.child(id, i)];
+            s.first |= c.first;
+            s.chars |= c.chars;
+            s.nullable = s.nullable || c.nullable;
+            s.asserts = s.asserts || c.asserts;
+            s.width = i == 0 || s.width == c.width ? c.width : -1;
           }
+          break;
 
-          case Opcode::CLASS_PRED: {
-            bool pred_matched = false;
-            bool negated = (inst.class_type & 0x10) != 0;
-            int base_type = inst.class_type & 0x0F;
-            char c = textPos < textLen ? text[textPos] : '\0';
-            switch (base_type) {
-              case CLASS_DIGIT:
-                pred_matched = textPos < textLen && CharClass::isDigit(c);
-                break;
-              case CLASS_WORD:
-                pred_matched = textPos < textLen && CharClass::isWordChar(c);
-                break;
-              case CLASS_SPACE:
-                pred_matched = textPos < textLen && CharClass::isSpace(c);
-                break;
-            }
-            if (negated)
-              pred_matched = !pred_matched;
-
-            if (pred_matched) {
-              ++textPos;
-              ++pc;
-            } else {
-              goto fail;
-            }
+        case ASTNode::Type::REPEAT: {
+          const Summary& c = summaries_[arena_.child(id, 0)];
+          if (n.maxRepeat == 0) {
+            s.nullable = true;
             break;
           }
+          s.first = c.first;
+          s.chars = c.chars;
+          s.nullable = n.minRepeat == 0 || c.nullable;
+          s.asserts = c.asserts;
+          bool fixed = c.width >= 0 && n.minRepeat == n.maxRepeat && c.width <= 65536 &&
+                       n.minRepeat <= 65536;
+          s.width = fixed ? c.width * static_cast<int32_t>(n.minRepeat) : -1;
+          break;
+        }
+      }
+    }
+    allChars_ = summaries_[root_].chars;
+  }
 
-          case Opcode::JUMP:
-            pc = inst.operand;
-            break;
+  // Shortest-ish text the node matches, used to reach a construct in attacks
+  std::string sample(NodeId id) const {
+    const ASTNode& n = arena_[id];
+    switch (n.type) {
+      case ASTNode::Type::LITERAL:
+        return std::string(1, n.ch);
+      case ASTNode::Type::DOT:
+      case ASTNode::Type::CLASS:
+      case ASTNode::Type::NOT_CLASS: {
+        int c = summaries_[id].first.pick();
+        return c < 0 ? std::string() : std::string(1, static_cast<char>(c));
+      }
+      case ASTNode::Type::GROUP:
+        return sample(arena_.child(id, 0));
+      case ASTNode::Type::CONCAT: {
+        std::string s;
+        for (uint32_t i = 0; i < n.numChildren; ++i) {
+          s += sample(arena_.child(id, i));
+        }
+        return s;
+      }
+      case ASTNode::Type::ALTERNATE: {
+        std::string best = sample(arena_.child(id, 0));
+        for (uint32_t i = 1; i < n.numChildren; ++i) {
+          std::string s = sample(arena_.child(id, i));
+          if (s.size() < best.size())
+            best = std::move(s);
+        }
+        return best;
+      }
+      case ASTNode::Type::REPEAT: {
+        std::string one = sample(arena_.child(id, 0));
+        std::string s;
+        for (uint32_t i = 0; i < n.minRepeat && s.size() < 65536; ++i) {
+          s += one;
+        }
+        return s;
+      }
+      default:
+        return std::string();
+    }
+  }
 
-          case Opcode::SPLIT: {
-            // inst.operand = target1, inst.charset = target2
-            // Push second alternative onto backtrack stack
-            BacktrackPoint bp;
-            bp.pc = inst.charset;  // target2
-            bp.textPos = textPos;
-            bp.savedCaptures = captures_;
-            backtrackStack_.push_back(bp);
-            // Take first alternative
-            pc = inst.operand;  // target1
-            break;
-          }
+  // A byte outside `avoid` that no part of the pattern can consume, so the
+  // match has to give up once it reaches it; falls back to any byte outside
+  // `avoid`
+  std::string killer(const ByteSet& avoid) const {
+    static const char candidates[] = {'!', '#', '~', '\x01', '\n', '\x7f'};
+    for (char c : candidates) {
+      if (!allChars_.test(static_cast<uint8_t>(c)) && !avoid.test(static_cast<uint8_t>(c)))
+        return std::string(1, c);
+    }
+    int c = (~avoid).pick();
+    return c < 0 ? std::string() : std::string(1, static_cast<char>(c));
+  }
 
-          case Opcode::SAVE: {
-            uint32_t group = inst.operand & 0xFFFF;
-            uint32_t next = inst.operand >> 16;
-            captures_[group] = textPos;
-            // Use next if it's a real jump target, otherwise just advance
-            pc = (next > 0) ? next : (pc + 1);
-            hasCapture_ = true;
-            break;
-          }
+  void addFinding(AnalysisFinding::Kind kind, Complexity complexity, uint32_t degree,
+                  NodeId at, std::string detail, const std::string& prefix,
+                  const std::string& pump) {
+    size_t position = arena_[at].position;
+    for (auto& f : findings_) {
+      if (f.kind == kind && f.position == position) {
+        if (degree > f.degree) {
+          f.degree = degree;
+          f.detail = std::move(detail);
+        }
+        return;
+      }
+    }
+    ByteSet pumpSet;
+    for (char c : pump) {
+      pumpSet.set(static_cast<uint8_t>(c));
+    }
+    AttackInput attack;
+    attack.prefix = prefix;
+    attack.pump = pump;
+    attack.suffix = killer(pumpSet);
+    if (complexity == Complexity::EXPONENTIAL) {
+      attack.repeat = 28;
+    } else {
+      // Enough pumps for about 1e9 steps
+      double n = std::ceil(std::pow(1e9, 1.0 / std::max<uint32_t>(degree, 1)));
+      attack.repeat = static_cast<size_t>(std::min(100000.0, std::max(16.0, n)));
+    }
+    findings_.push_back({kind, complexity, degree, position, std::move(detail)});
+    attacks_.push_back(std::move(attack));
+  }
 
-          case Opcode::MATCH:
-            captures_[1] = textPos;
-            matched = true;
-            break;
+  // `restCanFail` tells whether something after `id` can still reject the
+  // match; without that the first path found succeeds and nothing backtracks
+  void scan(NodeId id, const std::string& prefix, bool restCanFail) {
+    const ASTNode& n = arena_[id];
+    switch (n.type) {
+      case ASTNode::Type::CONCAT: {
+        std::vector<char> failAfter(n.numChildren + 1, restCanFail);
+        for (uint32_t i = n.numChildren; i-- > 0;) {
+          failAfter[i] = failAfter[i + 1] || canFail(arena_.child(id, i));
+        }
+        std::string p = prefix;
+        for (uint32_t i = 0; i < n.numChildren; ++i) {
+          NodeId c = arena_.child(id, i);
+          scan(c, p, failAfter[i + 1]);
+          p += sample(c);
+        }
+        scanSequence(id, prefix, restCanFail);
+        break;
+      }
+      case ASTNode::Type::ALTERNATE:
+        for (uint32_t i = 0; i < n.numChildren; ++i) {
+          scan(arena_.child(id, i), prefix, restCanFail);
+        }
+        break;
+      case ASTNode::Type::GROUP:
+        scan(arena_.child(id, 0), prefix, restCanFail);
+        break;
+      case ASTNode::Type::REPEAT:
+        checkRepeat(id, prefix, restCanFail);
+        if (n.maxRepeat > 1 && n.maxRepeat != UINT32_MAX) {
+          scanSequence(id, prefix, restCanFail);
+        }
+        scan(arena_.child(id, 0), prefix, restCanFail);
+        break;
+      case ASTNode::Type::LOOKAHEAD:
+      case ASTNode::Type::LOOKBEHIND:
+        checkLookaround(id, prefix);
+        break;
+      default:
+        break;
+    }
+  }
 
-          case Opcode::ANCHOR_START: {
-            if (textPos == 0) {
-              ++pc;  // Advance to next instruction
-            } else {
-              goto fail;
-            }
-            break;
-          }
+  void checkRepeat(NodeId id, const std::string& prefix, bool restCanFail) {
+    const ASTNode& n = arena_[id];
+    if (n.maxRepeat <= 1)
+      return;
+    NodeId body = arena_.child(id, 0);
+    const Summary& b = summaries_[body];
+    bool unbounded = n.maxRepeat == UINT32_MAX;
+
+    if (unbounded && b.nullable) {
+      int c = b.chars.pick();
+      addFinding(AnalysisFinding::Kind::EMPTY_LOOP, Complexity::EXPONENTIAL, 0, id,
+                 "loop body can match the empty string", prefix,
+                 std::string(1, c < 0 ? 'a' : static_cast<char>(c)));
+    }
+    if (!restCanFail)
+      return;
 
-          case Opcode::ANCHOR_END: {
-            if (textPos == textLen) {
-              ++pc;  // Advance to next instruction
-            } else {
-              goto fail;
-            }
-            break;
-          }
+    NodeId inner = findTailRepeat(body, b.first);
+    if (inner != NONE) {
+      int c = (summaries_[inner].chars & b.first).pick();
+      if (unbounded) {
+        addFinding(AnalysisFinding::Kind::NESTED_QUANTIFIER, Complexity::EXPONENTIAL, 0, id,
+                   "unbounded repeat nested in a repeat with an overlapping body", prefix,
+                   std::string(1, static_cast<char>(c)));
+      } else {
+        addFinding(AnalysisFinding::Kind::NESTED_QUANTIFIER, Complexity::POLYNOMIAL,
+                   n.maxRepeat, id, "unbounded repeat nested in a counted repeat", prefix,
+                   std::string(1, static_cast<char>(c)));
+      }
+    }
+
+    if (unbounded) {
+      std::string pump;
+      if (ambiguousAlternation(body, pump)) {
+        addFinding(AnalysisFinding::Kind::AMBIGUOUS_ALTERNATION, Complexity::EXPONENTIAL, 0,
+                   id, "alternatives under a repeat can match the same text", prefix, pump);
+      }
+    }
+  }
+
+  // A body with an unbounded repeat can read to the end of the text each
+  // time the lookaround is tested, or back to its start for a lookbehind,
+  // and a search tests it at every position the pattern can start. The pump
+  // is such a start byte that the repeat also consumes. A negative
+  // lookaround needs its body to match at the far end, so the body's text
+  // goes after the pumps, or before them for a lookbehind; otherwise the
+  // suffix is a byte the body cannot use.
+  void checkLookaround(NodeId id, const std::string& prefix) {
+    const ASTNode& n = arena_[id];
+    NodeId body = arena_.child(id, 0);
+    NodeId run = findUnbounded(body);
+    if (run == NONE)
+      return;
+    bool behind = n.type == ASTNode::Type::LOOKBEHIND;
+    ByteSet starts = summaries_[run].chars & summaries_[root_].first;
+    int c = (starts.any() ? starts : summaries_[run].chars).pick();
+    size_t before = findings_.size();
+    addFinding(AnalysisFinding::Kind::LOOKAROUND_SCAN, Complexity::POLYNOMIAL, 2, id,
+               behind ? "lookbehind body with an unbounded repeat can read back to the start"
+                        " of the text"
+                      : "lookahead body with an unbounded repeat can read to the end of the text",
+               n.negated && behind ? prefix + sample(body) : prefix,
+               std::string(1, static_cast<char>(c)));
+    if (findings_.size() > before && !(n.negated && behind))
+      attacks_.back().suffix = n.negated ? sample(body) : killer(summaries_[body].chars);
+  }
+
+  // An unbounded repeat that consumes bytes, outside any nested lookaround
+  NodeId findUnbounded(NodeId id) const {
+    const ASTNode& n = arena_[id];
+    switch (n.type) {
+      case ASTNode::Type::GROUP:
+      case ASTNode::Type::CONCAT:
+      case ASTNode::Type::ALTERNATE:
+        for (uint32_t i = 0; i < n.numChildren; ++i) {
+          NodeId r = findUnbounded(arena_.child(id, i));
+          if (r != NONE)
+            return r;
+        }
+        return NONE;
+      case ASTNode::Type::REPEAT:
+        if (n.maxRepeat == UINT32_MAX && summaries_[id].chars.any())
+          return id;
+        return findUnbounded(arena_.child(id, 0));
+      default:
+        return NONE;
+    }
+  }
+
+  // An unbounded repeat that can end the body and also consume bytes the
+  // next iteration starts with, so every split of a run between the two
+  // loops is a separate path
+  NodeId findTailRepeat(NodeId id, const ByteSet& restart) const {
+    const ASTNode& n = arena_[id];
+    switch (n.type) {
+      case ASTNode::Type::GROUP:
+        return findTailRepeat(arena_.child(id, 0), restart);
+      case ASTNode::Type::CONCAT:
+        for (uint32_t i = n.numChildren; i-- > 0;) {
+          NodeId c = arena_.child(id, i);
+          NodeId r = findTailRepeat(c, restart);
+          if (r != NONE)
+            return r;
+          if (!summaries_[c].nullable)
+            break;
+        }
+        return NONE;
+      case ASTNode::Type::ALTERNATE:
+        for (uint32_t i = 0; i < n.numChildren; ++i) {
+          NodeId r = findTailRepeat(arena_.child(id, i), restart);
+          if (r != NONE)
+            return r;
+        }
+        return NONE;
+      case ASTNode::Type::REPEAT:
+        if (n.maxRepeat == UINT32_MAX && (summaries_[id].chars & restart).any())
+          return id;
+        return n.maxRepeat > 1 ? findTailRepeat(arena_.child(id, 0), restart) : NONE;
+      default:
+        return NONE;
+    }
+  }
+
+  // Per-position byte sets of a fixed-width node, up to MAX_WIDTH positions
+  void positionSets(NodeId id, std::vector<ByteSet>& out) const {
+    const ASTNode& n = arena_[id];
+    if (out.size() >= MAX_WIDTH)
+      return;
+    switch (n.type) {
+      case ASTNode::Type::LITERAL:
+      case ASTNode::Type::DOT:
+      case ASTNode::Type::CLASS:
+      case ASTNode::Type::NOT_CLASS:
+        out.push_back(summaries_[id].first);
+        break;
+      case ASTNode::Type::GROUP:
+        positionSets(arena_.child(id, 0), out);
+        break;
+      case ASTNode::Type::CONCAT:
+        for (uint32_t i = 0; i < n.numChildren; ++i) {
+          positionSets(arena_.child(id, i), out);
+        }
+        break;
+      case ASTNode::Type::REPEAT:
+        for (uint32_t i = 0; i < n.minRepeat && out.size() < MAX_WIDTH; ++i) {
+          positionSets(arena_.child(id, 0), out);
+        }
+        break;
+      case ASTNode::Type::ALTERNATE: {
+        size_t base = out.size();
+        positionSets(arena_.child(id, 0), out);
+        for (uint32_t i = 1; i < n.numChildren; ++i) {
+          std::vector<ByteSet> alt;
+          positionSets(arena_.child(id, i), alt);
+          for (size_t k = 0; k < alt.size() && base + k < out.size(); ++k) {
+            out[base + k] |= alt[k];
+          }
+        }
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
+  // Two alternatives overlap when some text matches both, or one matches a
+  // prefix of the other; fixed-width alternatives are compared position by
+  // position, the rest by their first bytes
+  bool overlap(NodeId a, NodeId b, std::string& pump) const {
+    const Summary& sa = summaries_[a];
+    const Summary& sb = summaries_[b];
+    ByteSet common = sa.first & sb.first;
+    if (!common.any())
+      return false;
+    if (sa.width > 0 && sb.width > 0) {
+      std::vector<ByteSet> pa, pb;
+      positionSets(a, pa);
+      positionSets(b, pb);
+      std::string s;
+      for (size_t k = 0; k < pa.size() && k < pb.size(); ++k) {
+        int c = (pa[k] & pb[k]).pick();
+        if (c < 0)
+          return false;
+        s += static_cast<char>(c);
+      }
+      pump = s;
+      return true;
+    }
+    pump = std::string(1, static_cast<char>(common.pick()));
+    return true;
+  }
+
+  bool ambiguousAlternation(NodeId id, std::string& pump) const {
+    while (arena_[id].type == ASTNode::Type::GROUP) {
+      id = arena_.child(id, 0);
+    }
+    const ASTNode& n = arena_[id];
+    if (n.type != ASTNode::Type::ALTERNATE)
+      return false;
+    // Wide keyword lists are checked against their first 256 entries only
+    uint32_t count = std::min<uint32_t>(n.numChildren, 256);
+    for (uint32_t i = 0; i < count; ++i) {
+      for (uint32_t j = i + 1; j < count; ++j) {
+        if (overlap(arena_.child(id, i), arena_.child(id, j), pump))
+          return true;
+      }
+    }
+    return false;
+  }
+
+  struct SequenceItem {
+    NodeId node;
+    bool loop;  // Unbounded repeat
+  };
+
+  // Concatenation flattened through groups, with counted repeats unrolled
+  void flatten(NodeId id, std::vector<SequenceItem>& items) const {
+    if (items.size() >= MAX_SEQUENCE)
+      return;
+    const ASTNode& n = arena_[id];
+    switch (n.type) {
+      case ASTNode::Type::GROUP:
+        flatten(arena_.child(id, 0), items);
+        break;
+      case ASTNode::Type::CONCAT:
+        for (uint32_t i = 0; i < n.numChildren; ++i) {
+          flatten(arena_.child(id, i), items);
+        }
+        break;
+      case ASTNode::Type::REPEAT:
+        if (n.maxRepeat == UINT32_MAX) {
+          items.push_back({id, true});
+        } else if (n.maxRepeat > 1) {
+          for (uint32_t i = 0; i < n.maxRepeat && items.size() < MAX_SEQUENCE; ++i) {
+            flatten(arena_.child(id, 0), items);
+          }
+        } else {
+          items.push_back({id, false});
+        }
+        break;
+      default:
+        items.push_back({id, false});
+        break;
+    }
+  }
+
+  // Runs of k unbounded repeats that can hand characters to each other, with
+  // anything between them absorbable by the repeat before, cost n^k to fail
+  void scanSequence(NodeId id, const std::string& prefix, bool restCanFail) {
+    std::vector<SequenceItem> items;
+    flatten(id, items);
+    std::vector<char> failAfter(items.size() + 1, restCanFail);
+    for (size_t i = items.size(); i-- > 0;) {
+      failAfter[i] = failAfter[i + 1] || canFail(items[i].node);
+    }
+
+    uint32_t chain = 0, best = 0;
+    size_t start = 0, bestStart = 0, bestEnd = 0;
+    const ByteSet* prev = nullptr;
+    for (size_t i = 0; i < items.size(); ++i) {
+      const Summary& s = summaries_[items[i].node];
+      if (items[i].loop) {
+        if (prev && (*prev & s.chars).any()) {
+          ++chain;
+        } else {
+          chain = 1;
+          start = i;
+        }
+        prev = &s.chars;
+        if (chain >= 2 && chain > best && failAfter[i + 1]) {
+          best = chain;
+          bestStart = start;
+          bestEnd = i;
+        }
+      } else if (prev && !s.nullable && !s.chars.subsetOf(*prev)) {
+        prev = nullptr;
+        chain = 0;
+      }
+    }
+    scanOptionalRuns(items, failAfter, prefix);
+    if (best < 2)
+      return;
+
+    std::string p = prefix;
+    for (size_t i = 0; i < bestStart; ++i) {
+      p += sample(items[i].node);
+    }
+    // Pumping the separators (the 'b' of a.*b.*c) gives every loop a place
+    // to stop, which is what multiplies the paths
+    ByteSet shared =
+        summaries_[items[bestStart].node].chars & summaries_[items[bestEnd].node].chars;
+    ByteSet separators;
+    for (size_t i = bestStart; i <= bestEnd; ++i) {
+      if (!items[i].loop && !summaries_[items[i].node].nullable)
+        separators |= summaries_[items[i].node].first;
+    }
+    int c = (shared & separators).pick();
+    if (c < 0)
+      c = shared.pick();
+    addFinding(AnalysisFinding::Kind::OVERLAPPING_QUANTIFIERS, Complexity::POLYNOMIAL, best,
+               items[bestStart].node,
+               std::to_string(best) + " adjacent repeats can trade characters", p,
+               std::string(1, static_cast<char>(c)));
+  }
+
+  // Optional items (a?) and ambiguous alternations (a|aa) are choice points
+  // even without a loop. A run of k of them that can trade characters, as a
+  // counted repeat of one unrolls to, has up to 2^k ways to split the same
+  // text. That is a constant per start, so short runs are left alone.
+  void scanOptionalRuns(const std::vector<SequenceItem>& items, const std::vector<char>& failAfter,
+                        const std::string& prefix) {
+    uint32_t run = 0, best = 0;
+    size_t start = 0, bestStart = 0;
+    ByteSet runChars;
+    for (size_t i = 0; i < items.size(); ++i) {
+      const Summary& s = summaries_[items[i].node];
+      std::string pump;
+      bool choice = !items[i].loop && ((s.nullable && s.chars.any()) ||
+                                       ambiguousAlternation(items[i].node, pump));
+      if (choice) {
+        if (run > 0 && (runChars & s.chars).any()) {
+          ++run;
+        } else {
+          run = 1;
+          start = i;
+          runChars = ByteSet();
+        }
+        runChars |= s.chars;
+      } else if (run > 0 && !s.nullable && !s.chars.subsetOf(runChars)) {
+        run = 0;
+      }
+      if (run > best && failAfter[i + 1]) {
+        best = run;
+        bestStart = start;
+      }
+    }
+    if (best < MIN_OPTIONAL_RUN)
+      return;
+
+    std::string p = prefix;
+    for (size_t i = 0; i < bestStart; ++i) {
+      p += sample(items[i].node);
+    }
+    int c = summaries_[items[bestStart].node].chars.pick();
+    addFinding(AnalysisFinding::Kind::OPTIONAL_RUN, Complexity::EXPONENTIAL, 0,
+               items[bestStart].node,
+               std::to_string(best) + " optional or ambiguous items in a row can trade characters",
+               p, std::string(1, static_cast<char>(c)));
+  }
+};
+
+// ============================================================================
+// Search Plan - First-byte Prefilter
+// ============================================================================
+// Where a match can start, worked out once from the program. A search uses it
+// to skip positions whose byte cannot begin a match without setting up an
+// engine run for them.
+struct SearchPlan {
+  ByteSet first;              // Bytes a match can start with
+  bool matchesEmpty = false;  // MATCH or $ reachable without consuming: no filtering
+  bool anchorAtZero = false;  // Some path starts with ^, so offset 0 is a candidate
+  bool anchored = false;      // Every path starts with ^: offset 0 is the only candidate
+  bool lineStart = false;     // Some path starts with (?m)^, so line starts are candidates
+  bool lineAnchored = false;  // Every path starts with ^ or (?m)^: only line starts are
+  bool wordBoundary = false;  // Every path starts with \b: candidates must be at a boundary
+  int singleByte = -1;        // The only member of `first`, scanned for with memchr
+  int foldedByte = -1;        // Lowercase letter when `first` is exactly its two cases
+
+  static SearchPlan build(const std::vector<Instruction>& program) {
+    SearchPlan plan;
+    bool consumes = false;
+    std::vector<bool> visited(program.size(), false);
+    std::vector<uint32_t> stack = {0};
+    while (!stack.empty()) {
+      uint32_t pc = stack.back();
+      stack.pop_back();
+      while (pc < program.size() && !visited[pc]) {
+        visited[pc] = true;
+        const Instruction& inst = program[pc];
+        switch (inst.opcode) {
+          case Opcode::JUMP:
+            pc = inst.operand;
+            continue;
+          case Opcode::SPLIT:
+            stack.push_back(static_cast<uint32_t>(inst.charset));
+            pc = inst.operand;
+            continue;
+          case Opcode::SAVE:
+            pc = (inst.operand >> 16) > 0 ? (inst.operand >> 16) : pc + 1;
+            continue;
+          case Opcode::WORD_BOUNDARY:
+          case Opcode::NOT_WORD_BOUNDARY:
+            ++pc;  // Checked per candidate below, if at all
+            continue;
+          case Opcode::LOOKAHEAD:
+          case Opcode::NEG_LOOKAHEAD:
+          case Opcode::LOOKBEHIND:
+          case Opcode::NEG_LOOKBEHIND:
+            ++pc;  // Only narrows what follows, so skipping it keeps `first` a superset
+            continue;
+          case Opcode::ANCHOR_START:
+            plan.anchorAtZero = true;  // What follows only matters at offset 0
+            break;
+          case Opcode::LINE_START:
+            plan.lineStart = true;  // Or here, right after a '\n'
+            break;
+          case Opcode::ANCHOR_END:
+          case Opcode::LINE_END:
+          case Opcode::MATCH:
+          case Opcode::BACKREF:
+            plan.matchesEmpty = true;
+            break;
+          default:
+            consumes = true;
+            for (int c = 0; c < 256; ++c) {
+              if (inst.accepts(static_cast<char>(c)))
+                plan.first.set(static_cast<uint8_t>(c));
+            }
+            break;
+        }
+        break;
+      }
+    }
+    plan.anchored = plan.anchorAtZero && !plan.lineStart && !consumes && !plan.matchesEmpty;
+    plan.lineAnchored = plan.lineStart && !consumes && !plan.matchesEmpty;
+    plan.wordBoundary = startsAtWordBoundary(program);
+    int members = 0;
+    for (int c = 0; c < 256; ++c) {
+      if (plan.first.test(static_cast<uint8_t>(c))) {
+        plan.singleByte = c;
+        ++members;
+      }
+    }
+    if (members != 1)
+      plan.singleByte = -1;
+    // A case-insensitive literal start: both cases of one letter
+    for (int c = 'a'; c <= 'z' && members == 2; ++c) {
+      if (plan.first.test(static_cast<uint8_t>(c)) && plan.first.test(static_cast<uint8_t>(c - 32)))
+        plan.foldedByte = c;
+    }
+    return plan;
+  }
+
+  // Whether every path from the start meets \b before anything else
+  static bool startsAtWordBoundary(const std::vector<Instruction>& program) {
+    std::vector<bool> visited(program.size(), false);
+    std::vector<uint32_t> stack = {0};
+    while (!stack.empty()) {
+      uint32_t pc = stack.back();
+      stack.pop_back();
+      while (pc < program.size() && !visited[pc]) {
+        visited[pc] = true;
+        const Instruction& inst = program[pc];
+        if (inst.opcode == Opcode::JUMP) {
+          pc = inst.operand;
+        } else if (inst.opcode == Opcode::SPLIT) {
+          stack.push_back(static_cast<uint32_t>(inst.charset));
+          pc = inst.operand;
+        } else if (inst.opcode == Opcode::SAVE) {
+          pc = (inst.operand >> 16) > 0 ? (inst.operand >> 16) : pc + 1;
+        } else if (inst.opcode == Opcode::WORD_BOUNDARY) {
+          break;
+        } else {
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // Whether a match could start at `pos`
+  bool admits(const std::string& text, size_t pos, size_t end) const {
+    if (wordBoundary && !atWordBoundary(text, pos))
+      return false;
+    if (matchesEmpty || (anchorAtZero && pos == 0) || (lineStart && atLineStart(text, pos)))
+      return true;
+    return pos < end && first.test(static_cast<uint8_t>(text[pos]));
+  }
+
+  // First position in [pos, end] where a match could start, or npos
+  size_t next(const std::string& text, size_t pos, size_t end) const {
+    if (!wordBoundary)
+      return candidate(text, pos, end);
+    // The byte before each candidate settles \b without starting an engine,
+    // so a word-bounded keyword stays on the memchr path
+    for (;;) {
+      size_t hit = candidate(text, pos, end);
+      if (hit == std::string::npos || atWordBoundary(text, hit))
+        return hit;
+      if (hit >= end)
+        return std::string::npos;
+      pos = hit + 1;
+    }
+  }
+
+  // next() without the \b check
+  size_t candidate(const std::string& text, size_t pos, size_t end) const {
+    if (matchesEmpty || (anchorAtZero && pos == 0) || (lineStart && atLineStart(text, pos)))
+      return pos;
+    if (anchored || pos >= end)
+      return std::string::npos;
+    if (lineAnchored) {
+      // Only the byte after a '\n' can start a match
+      const void* hit = std::memchr(text.data() + pos, '\n', end - pos);
+      return hit ? static_cast<const char*>(hit) - text.data() + 1 : std::string::npos;
+    }
+    if (lineStart) {
+      for (; pos < end; ++pos) {
+        if (first.test(static_cast<uint8_t>(text[pos])) || atLineStart(text, pos))
+          return pos;
+      }
+      return atLineStart(text, pos) ? pos : std::string::npos;
+    }
+    if (singleByte >= 0) {
+      const void* hit = std::memchr(text.data() + pos, singleByte, end - pos);
+      return hit ? static_cast<const char*>(hit) - text.data() : std::string::npos;
+    }
+    if (foldedByte >= 0)
+      return findFolded(text.data(), pos, end);
+    for (; pos < end; ++pos) {
+      if (first.test(static_cast<uint8_t>(text[pos])))
+        return pos;
+    }
+    return std::string::npos;
+  }
+
+  // First byte in [pos, end) that equals foldedByte once bit 0x20 is set,
+  // which for a letter is exactly its two cases; 16 bytes at a time on SSE2
+  size_t findFolded(const char* data, size_t pos, size_t end) const {
+    const char lower = static_cast<char>(foldedByte);
+#if defined(__SSE2__)
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    const __m128i needle = _mm_set1_epi8(lower);
+    for (; pos + 16 <= end; pos += 16) {
+      __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + pos));
+      int hits = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(chunk, caseBit), needle));
+      if (hits)
+        return pos + __builtin_ctz(static_cast<unsigned>(hits));
+    }
+#endif
+    for (; pos < end; ++pos) {
+      if ((data[pos] | 0x20) == lower)
+        return pos;
+    }
+    return std::string::npos;
+  }
+};
+
+// The read-only half of a compiled pattern: the program and its SearchPlan.
+// Engines only read it, so every engine instance of a Regex, whichever
+// thread it belongs to, shares one.
+struct CompiledProgram {
+  std::vector<Instruction> instructions;
+  SearchPlan plan;
+
+  explicit CompiledProgram(std::vector<Instruction> program)
+      : instructions(std::move(program)), plan(SearchPlan::build(instructions)) {}
+};
+
+// ============================================================================
+// Lookaround - Memoized Sub-program Evaluation
+// ============================================================================
+// Answers lookahead and lookbehind instructions for both engines. Each body
+// is a sub-program of its own (see Compiler), and whether it matches depends
+// only on the sub-program and the position, so the answer is computed once
+// per (sub-program, position) and reused for the rest of the call, however
+// often backtracking or other threads come back to it. The body runs on a
+// capture-free lockstep simulation, forward for a lookahead and backward over
+// the reversed body for a lookbehind; groups inside are numbered but never
+// capture. A lookbehind body that is a fixed run of single-byte tests, as in
+// (?<=id=), skips all that and compares the bytes before the position
+// directly.
+//
+// Evaluations at different positions also share what they learn about the
+// body's consuming states. When an evaluation fails, every (pc, position) it
+// reached is marked as failing; when one matches, the states on the path to
+// MATCH are marked as matching. A later evaluation drops a failing state and
+// stops at a matching one, so (?=.*c) tested at every position of a text
+// without a 'c' reads the text once, not once per position.
+class Lookaround {
+ public:
+  // Forget the previous call's results and steps; the engines call this on
+  // entry. With `sameText` the results are kept, for a caller that makes
+  // several calls over one unchanged text.
+  void begin(bool sameText = false) {
+    steps_ = 0;
+    if (sameText)
+      return;
+    if (++epoch_ == 0) {
+      for (Entry& e : memo_)
+        e.epoch = 0;
+      std::fill(blockEpochs_.begin(), blockEpochs_.end(), 0);
+      epoch_ = 1;
+    }
+  }
+
+  // Whether `inst`, one of the lookaround opcodes, holds at `pos`. Body
+  // instructions are counted into `profile` when given.
+  bool holds(const std::vector<Instruction>& program, const Instruction& inst,
+             const std::string& text, size_t pos, ProgramProfile* profile = nullptr) {
+    if (bodyStart_ == NO_BODY)
+      bodyStart_ = firstBody(program);
+    profile_ = profile;
+    return evaluate(program, inst, text, pos, 0);
+  }
+
+  // Instructions the simulation dispatched since the last call, which the
+  // engines charge to the step budget and MatchStats::instructions
+  uint64_t takeSteps() {
+    uint64_t n = steps_;
+    steps_ = 0;
+    return n;
+  }
+
+ private:
+  // Direct-mapped per sub-program, so memory stays fixed however long the
+  // text; a collision only costs a re-evaluation
+  static constexpr size_t MEMO_SIZE = 1024;
+  // Positions per block of state marks
+  static constexpr size_t BLOCK = 64;
+  static constexpr uint32_t NO_BODY = UINT32_MAX;
+  static constexpr uint32_t NO_STEP = UINT32_MAX;
+
+  struct Entry {
+    size_t pos = 0;
+    uint32_t epoch = 0;
+    bool matched = false;
+  };
+
+  // Sparse set of pcs, one pair per nesting level of lookaheads. `steps`
+  // holds the trail index of each consuming pc.
+  struct PcSet {
+    std::vector<uint32_t> sparse;
+    std::vector<uint32_t> dense;
+    std::vector<uint32_t> steps;
+    uint32_t size = 0;
+
+    bool insert(uint32_t pc) {
+      uint32_t i = sparse[pc];
+      if (i < size && dense[i] == pc)
+        return false;
+      sparse[pc] = size;
+      dense[size++] = pc;
+      return true;
+    }
+  };
+
+  // A consuming state one evaluation reached, and the one whose byte led to it
+  struct Step {
+    uint32_t pc;
+    uint32_t parent;
+    size_t pos;
+  };
+
+  struct Level {
+    PcSet current;
+    PcSet next;
+    std::vector<uint32_t> stack;
+    std::vector<Step> trail;  // Marked failing or matching once the evaluation ends
+  };
+
+  std::vector<Entry> memo_;
+  uint32_t epoch_ = 0;
+  // Boxed so growing keeps references to the levels, and empty until the
+  // first lookaround, since every engine instance has one
+  std::vector<std::unique_ptr<Level>> levels_;
+  uint64_t steps_ = 0;
+  ProgramProfile* profile_ = nullptr;
+
+  // Marks of the consuming states, one bit per (pc, position) in each of
+  // fails_ and matches_: a word per sub-program pc for every BLOCK
+  // positions. A block is cleared when a call first touches it, so a call
+  // pays only for the positions its lookarounds reach.
+  uint32_t bodyStart_ = NO_BODY;  // Sub-programs fill the program from here on
+  std::vector<uint32_t> blockEpochs_;
+  std::vector<uint64_t> fails_;
+  std::vector<uint64_t> matches_;
+
+  static uint32_t firstBody(const std::vector<Instruction>& program) {
+    uint32_t first = static_cast<uint32_t>(program.size());
+    for (const Instruction& inst : program) {
+      if (inst.opcode == Opcode::LOOKAHEAD || inst.opcode == Opcode::NEG_LOOKAHEAD ||
+          inst.opcode == Opcode::LOOKBEHIND || inst.opcode == Opcode::NEG_LOOKBEHIND)
+        first = std::min(first, inst.operand);
+    }
+    return first;
+  }
+
+  void count(uint32_t pc) {
+    ++steps_;
+    if (profile_)
+      ++profile_->hits[pc];
+  }
+
+  // Index into fails_ and matches_ of the word holding (pc, pos)
+  size_t markWord(const std::vector<Instruction>& program, uint32_t pc, size_t pos) {
+    size_t pcs = program.size() - bodyStart_;
+    size_t block = pos / BLOCK;
+    if (block >= blockEpochs_.size()) {
+      blockEpochs_.resize(block + 1, 0);
+      fails_.resize(blockEpochs_.size() * pcs);
+      matches_.resize(blockEpochs_.size() * pcs);
+    }
+    size_t base = block * pcs;
+    if (blockEpochs_[block] != epoch_) {
+      std::fill(fails_.begin() + base, fails_.begin() + base + pcs, 0);
+      std::fill(matches_.begin() + base, matches_.begin() + base + pcs, 0);
+      blockEpochs_[block] = epoch_;
+    }
+    return base + (pc - bodyStart_);
+  }
+
+  void mark(std::vector<uint64_t>& marks, const std::vector<Instruction>& program,
+            const Step& step) {
+    marks[markWord(program, step.pc, step.pos)] |= uint64_t(1) << (step.pos % BLOCK);
+  }
+
+  bool evaluate(const std::vector<Instruction>& program, const Instruction& inst,
+                const std::string& text, size_t pos, size_t depth) {
+    bool behind = inst.opcode == Opcode::LOOKBEHIND || inst.opcode == Opcode::NEG_LOOKBEHIND;
+    bool positive = inst.opcode == Opcode::LOOKAHEAD || inst.opcode == Opcode::LOOKBEHIND;
+    if (behind && inst.charset_high != 0)
+      return matchesBefore(program, inst, text, pos) == positive;
+    return matches(program, inst, text, pos, behind, depth) == positive;
+  }
+
+  // Fixed-width lookbehind: the reversed body's i-th test against the i-th
+  // byte back from `pos`
+  bool matchesBefore(const std::vector<Instruction>& program, const Instruction& inst,
+                     const std::string& text, size_t pos) {
+    size_t width = static_cast<size_t>(inst.charset_high);
+    if (pos < width)
+      return false;
+    for (size_t i = 0; i < width; ++i) {
+      count(static_cast<uint32_t>(inst.operand + i));
+      if (!program[inst.operand + i].accepts(text[pos - 1 - i]))
+        return false;
+    }
+    return true;
+  }
+
+  bool matches(const std::vector<Instruction>& program, const Instruction& inst,
+               const std::string& text, size_t pos, bool backward, size_t depth) {
+    size_t slot = static_cast<size_t>(inst.charset_low);
+    if (memo_.size() < (slot + 1) * MEMO_SIZE)
+      memo_.resize((slot + 1) * MEMO_SIZE);
+    Entry& e = memo_[slot * MEMO_SIZE + pos % MEMO_SIZE];
+    if (e.epoch == epoch_ && e.pos == pos)
+      return e.matched;
+    bool matched = simulate(program, inst.operand, text, pos, backward, depth);
+    // The simulation may have resized memo_, so look the entry up again
+    Entry& fresh = memo_[slot * MEMO_SIZE + pos % MEMO_SIZE];
+    fresh.pos = pos;
+    fresh.epoch = epoch_;
+    fresh.matched = matched;
+    return matched;
+  }
+
+  // Whether the sub-program at `start` matches text beginning at `pos`, or
+  // ending there when running `backward`. Any match will do, so there is no
+  // priority order to keep.
+  bool simulate(const std::vector<Instruction>& program, uint32_t start,
+                const std::string& text, size_t pos, bool backward, size_t depth) {
+    while (levels_.size() <= depth)
+      levels_.push_back(std::make_unique<Level>());
+    Level& level = *levels_[depth];
+    for (PcSet* set : {&level.current, &level.next}) {
+      set->sparse.resize(program.size());
+      set->dense.resize(program.size());
+      set->steps.resize(program.size());
+      set->size = 0;
+    }
+    level.trail.clear();
+    bool matched = closure(program, level, level.current, start, NO_STEP, text, pos, depth);
+    while (!matched && level.current.size > 0 && (backward ? pos > 0 : pos < text.length())) {
+      char c = backward ? text[pos - 1] : text[pos];
+      pos = backward ? pos - 1 : pos + 1;
+      level.next.size = 0;
+      for (uint32_t i = 0; i < level.current.size; ++i) {
+        uint32_t pc = level.current.dense[i];
+        if (!program[pc].accepts(c))
+          continue;
+        uint32_t step = level.current.steps[i];
+        if (closure(program, level, level.next, pc + 1, step, text, pos, depth)) {
+          // Every state on the path here leads to MATCH
+          for (; step != NO_STEP; step = level.trail[step].parent)
+            mark(matches_, program, level.trail[step]);
+          matched = true;
+          break;
+        }
+      }
+      std::swap(level.current, level.next);
+    }
+    if (!matched) {
+      for (const Step& step : level.trail)
+        mark(fails_, program, step);
+    }
+    return matched;
+  }
+
+  // Follow the zero-width instructions from `pc0` and add every pc reached
+  // to `set`; the consuming ones, which `parent` led to, are tried on the
+  // next byte. Returns true on reaching MATCH or a state marked as matching.
+  bool closure(const std::vector<Instruction>& program, Level& level, PcSet& set, uint32_t pc0,
+               uint32_t parent, const std::string& text, size_t pos, size_t depth) {
+    std::vector<uint32_t>& stack = level.stack;
+    stack.clear();
+    stack.push_back(pc0);
+    while (!stack.empty()) {
+      uint32_t pc = stack.back();
+      stack.pop_back();
+      while (pc < program.size()) {
+        const Instruction& inst = program[pc];
+        if (inst.consumes()) {
+          size_t word = markWord(program, pc, pos);
+          uint64_t bit = uint64_t(1) << (pos % BLOCK);
+          if (matches_[word] & bit)
+            return true;
+          if (fails_[word] & bit)
+            break;
+        }
+        if (!set.insert(pc))
+          break;
+        count(pc);
+        bool pass;
+        switch (inst.opcode) {
+          case Opcode::MATCH:
+            return true;
+          case Opcode::JUMP:
+            pc = inst.operand;
+            continue;
+          case Opcode::SPLIT:
+            stack.push_back(static_cast<uint32_t>(inst.charset));
+            pc = inst.operand;
+            continue;
+          case Opcode::SAVE:
+            pc = (inst.operand >> 16) > 0 ? (inst.operand >> 16) : pc + 1;
+            continue;
+          case Opcode::ANCHOR_START:
+            pass = pos == 0;
+            break;
+          case Opcode::ANCHOR_END:
+            pass = pos == text.length();
+            break;
+          case Opcode::LINE_START:
+            pass = atLineStart(text, pos);
+            break;
+          case Opcode::LINE_END:
+            pass = atLineEnd(text, pos);
+            break;
+          case Opcode::WORD_BOUNDARY:
+          case Opcode::NOT_WORD_BOUNDARY:
+            pass = atWordBoundary(text, pos) == (inst.opcode == Opcode::WORD_BOUNDARY);
+            break;
+          case Opcode::LOOKAHEAD:
+          case Opcode::NEG_LOOKAHEAD:
+          case Opcode::LOOKBEHIND:
+          case Opcode::NEG_LOOKBEHIND:
+            pass = evaluate(program, inst, text, pos, depth + 1);
+            break;
+          case Opcode::BACKREF:
+            pass = false;  // Not implemented, same as the engines
+            break;
+          default:
+            // Consuming: stays in the set for the next byte
+            set.steps[set.size - 1] = static_cast<uint32_t>(level.trail.size());
+            level.trail.push_back({pc, parent, pos});
+            pass = false;
+            break;
+        }
+        if (!pass)
+          break;
+        ++pc;
+      }
+    }
+    return false;
+  }
+};
+
+// ============================================================================
+// Virtual Machine - Non-recursive Execution Engine
+// ============================================================================
+class VM {
+ public:
+  explicit VM(const std::vector<Instruction>& instructions, int captureCount)
+      : VM(std::make_shared<const CompiledProgram>(instructions), captureCount) {}
+
+  // Run a program shared with other engines; the VM only adds its per-call state
+  VM(std::shared_ptr<const CompiledProgram> program, int captureCount)
+      : program_(std::move(program)),
+        instructions_(program_->instructions),
+        plan_(program_->plan),
+        captureCount_(captureCount) {
+    captures_.assign(captureCount * 2, std::string::npos);
+    hasCapture_ = false;
+  }
+
+  // Try to match starting at exactly one position
+  bool executeAt(const std::string& text, size_t pos, MatchResult& result) {
+    return executeAt(text, pos, text.length(), result) == MatchStatus::MATCHED;
+  }
+
+  // Try to match starting at exactly one position without consuming past `end`.
+  // Anchors still see the whole text, so '^' only matches at offset 0 and '$'
+  // only at text.length(), regardless of the window. `sameText` says the text
+  // is the previous call's, so lookaround results carry over.
+  MatchStatus executeAt(const std::string& text, size_t pos, size_t end, MatchResult& result,
+                        bool sameText = false) {
+    return executeFrom<false, false>(text, pos, end, result, sameText);
+  }
+
+  // Same as above, but enforcing `options` for the duration of the call
+  MatchStatus executeAt(const std::string& text, size_t pos, size_t end, MatchResult& result,
+                        const MatchOptions& options) {
+    limiter_.begin(options);
+    if (!options.stats && !options.profile)
+      return executeFrom<true, false>(text, pos, end, result);
+    beginStats(options, pos);
+    MatchStatus status = executeFrom<true, true>(text, pos, end, result);
+    endStats(pos);
+    return status;
+  }
+
+  // Try to match starting at any position (for search)
+  bool search(const std::string& text, size_t start, MatchResult& result) {
+    return search(text, start, text.length(), result) == MatchStatus::MATCHED;
+  }
+
+  // Search for a match that lies entirely within [start, end)
+  MatchStatus search(const std::string& text, size_t start, size_t end, MatchResult& result) {
+    return searchFrom<false, false>(text, start, end, result);
+  }
+
+  MatchStatus search(const std::string& text, size_t start, size_t end, MatchResult& result,
+                     const MatchOptions& options) {
+    limiter_.begin(options);
+    if (!options.stats && !options.profile)
+      return searchFrom<true, false>(text, start, end, result);
+    beginStats(options, start);
+    MatchStatus status = searchFrom<true, true>(text, start, end, result);
+    endStats(start);
+    return status;
+  }
+
+  // Stop with BACKTRACK_LIMIT once more than `limit` backtracks have been
+  // taken, counting across calls from now on. This is the thrashing detector
+  // behind Regex's adaptive fallback; UINT64_MAX turns it off.
+  void setBacktrackLimit(uint64_t limit) {
+    backtrackLimit_ = limit;
+    backtracks_ = 0;
+  }
+
+  uint64_t backtracks() const {
+    return backtracks_;
+  }
+
+  // Steps spent by the last checked call
+  uint64_t steps() const {
+    return limiter_.steps;
+  }
+
+  // Fill `result` from a capture array laid out as [start0, end0, start1, ...]
+  static void buildResult(const std::string& text, const size_t* captures, int captureCount,
+                          MatchResult& result) {
+    result.matched = true;
+    result.position = captures[0];
+    size_t length = captures[1] - captures[0];
+    result.matched_text = text.substr(captures[0], length);
+
+    result.captures.clear();
+    // One entry per group in pattern order, nested groups included; a group
+    // that did not take part in the match is npos
+    for (int i = 1; i < captureCount; ++i) {
+      size_t start = captures[i * 2];
+      size_t end = captures[i * 2 + 1];
+      if (start != std::string::npos && end != std::string::npos && end >= start) {
+        result.captures.push_back({start, end, text.substr(start, end - start)});
+      } else {
+        result.captures.push_back({std::string::npos, std::string::npos, ""});
+      }
+    }
+  }
+
+ private:
+  std::shared_ptr<const CompiledProgram> program_;
+  const std::vector<Instruction>& instructions_;
+  const SearchPlan& plan_;
+  std::vector<size_t> captures_;
+  int captureCount_;
+  bool hasCapture_;
+
+  // Stack for backtracking - stores {pc, textPos}
+  struct BacktrackPoint {
+    uint32_t pc;
+    size_t textPos;
+    std::vector<size_t> savedCaptures;
+  };
+  std::vector<BacktrackPoint> backtrackStack_;
+
+  // Limit state of the current checked call
+  StepLimiter limiter_;
+
+  // Thrashing detector, see setBacktrackLimit()
+  uint64_t backtrackLimit_ = UINT64_MAX;
+  uint64_t backtracks_ = 0;
+
+  Lookaround lookaround_;
+
+  // Counters of the current call when it asked for them, and the furthest
+  // text position it reached. A call that only wants a profile counts into
+  // unusedStats_.
+  MatchStats* stats_ = nullptr;
+  ProgramProfile* profile_ = nullptr;
+  MatchStats unusedStats_;
+  size_t scanTo_ = 0;
+
+  void beginStats(const MatchOptions& options, size_t start) {
+    stats_ = options.stats ? options.stats : &unusedStats_;
+    profile_ = options.profile;
+    if (profile_)
+      profile_->fit(instructions_.size());
+    scanTo_ = start;
+  }
+
+  void endStats(size_t start) {
+    stats_->bytesScanned += scanTo_ - start;
+  }
+
+  template <bool kChecked, bool kStats>
+  MatchStatus executeFrom(const std::string& text, size_t pos, size_t end, MatchResult& result,
+                          bool sameText = false) {
+    lookaround_.begin(sameText);
+    if (!plan_.admits(text, pos, end))
+      return MatchStatus::NO_MATCH;
+    if constexpr (kStats)
+      ++stats_->prefilterCandidates;
+    return run<kChecked, kStats>(text, pos, end, result);
+  }
+
+  // Core backtracking loop. The checked instantiation counts steps and polls
+  // the limits in limiter_; the unchecked one compiles that code away and
+  // only enforces VM_STACK_SIZE and the backtrack limit. kStats adds the
+  // MatchStats counters on top.
+  template <bool kChecked, bool kStats>
+  MatchStatus run(const std::string& text, size_t pos, size_t end, MatchResult& result) {
+    const size_t textLen = end;
+    const size_t maxDepth = kChecked ? limiter_.options->maxBacktrackDepth : VM_STACK_SIZE;
+
+    // Reset state
+    captures_.assign(captureCount_ * 2, std::string::npos);
+    // Cleared, not shrunk: the stack keeps the capacity earlier calls needed
+    backtrackStack_.clear();
+
+    size_t startPos = pos;
+    size_t textPos = startPos;
+    uint32_t pc = 0;
+    bool matched = false;
+
+    captures_[0] = startPos;
+    if constexpr (kStats)
+      ++stats_->startPositions;
+
+    // Main execution loop
+    while (true) {
+      // Execute current instruction path
+      while (pc < instructions_.size() && !matched) {
+        const Instruction& inst = instructions_[pc];
+        if constexpr (kChecked) {
+          if (++limiter_.steps >= limiter_.checkAt) {
+            MatchStatus status = limiter_.check();
+            if (status != MatchStatus::NO_MATCH)
+              return status;
+          }
+        }
+        if constexpr (kStats) {
+          ++stats_->instructions;
+          scanTo_ = std::max(scanTo_, textPos);
+          if (profile_)
+            ++profile_->hits[pc];
+        }
+
+        switch (inst.opcode) {
+          case Opcode::CHAR:
+            if (textPos < textLen && text[textPos] == inst.ch) {
+              ++textPos;
+              ++pc;
+            } else {
+              goto fail;
+            }
+            break;
+
+          case Opcode::ANY:
+            if (textPos < textLen) {
+              ++textPos;
+              ++pc;
+            } else {
+              goto fail;
+            }
+            break;
+
+          case Opcode::ANY_NO_NL:
+            if (textPos < textLen && text[textPos] != '\n') {
+              ++textPos;
+              ++pc;
+            } else {
+              goto fail;
+            }
+            break;
+
+          case Opcode::RANGE:
+            if (textPos < textLen && text[textPos] >= inst.lo && text[textPos] <= inst.hi) {
+              ++textPos;
+              ++pc;
+            } else {
+              goto fail;
+            }
+            break;
+
+          case Opcode::CLASS: {
+            if (textPos < textLen &&
+                CharClass::inClassExt(inst.charset_low, inst.charset_high, text[textPos])) {
+              ++textPos;
+              ++pc;
+            } else {
+              goto fail;
+            }
+            break;
+          }
+
+          case Opcode::NOT_CLASS: {
+            if (textPos < textLen &&
+                !CharClass::inClassExt(inst.charset_low, inst.charset_high, text[textPos])) {
+              ++textPos;
+              ++pc;
+            } else {
+              goto fail;
+            }
+            break;
+          }
+
+          case Opcode::CLASS_PRED: {
+            bool pred_matched = false;
+            bool negated = (inst.class_type & 0x10) != 0;
+            int base_type = inst.class_type & 0x0F;
+            if (textPos >= textLen)
+              goto fail;  // Negated classes must not match past the end either
+            char c = text[textPos];
+            switch (base_type) {
+              case CLASS_DIGIT:
+                pred_matched = CharClass::isDigit(c);
+                break;
+              case CLASS_WORD:
+                pred_matched = CharClass::isWordChar(c);
+                break;
+              case CLASS_SPACE:
+                pred_matched = CharClass::isSpace(c);
+                break;
+            }
+            if (negated)
+              pred_matched = !pred_matched;
+
+            if (pred_matched) {
+              ++textPos;
+              ++pc;
+            } else {
+              goto fail;
+            }
+            break;
+          }
+
+          case Opcode::JUMP:
+            pc = inst.operand;
+            break;
+
+          case Opcode::SPLIT: {
+            // inst.operand = target1, inst.charset = target2
+            // Push second alternative onto backtrack stack
+            if (backtrackStack_.size() >= maxDepth)
+              return MatchStatus::STACK_EXHAUSTED;
+            BacktrackPoint bp;
+            bp.pc = inst.charset;  // target2
+            bp.textPos = textPos;
+            bp.savedCaptures = captures_;
+            backtrackStack_.push_back(bp);
+            if constexpr (kStats) {
+              ++stats_->backtrackPushes;
+              stats_->maxBacktrackDepth =
+                  std::max<uint64_t>(stats_->maxBacktrackDepth, backtrackStack_.size());
+              if (profile_)
+                ++profile_->pushes[pc];
+            }
+            // Take first alternative
+            pc = inst.operand;  // target1
+            break;
+          }
+
+          case Opcode::SAVE: {
+            uint32_t group = inst.operand & 0xFFFF;
+            uint32_t next = inst.operand >> 16;
+            captures_[group] = textPos;
+            // Use next if it's a real jump target, otherwise just advance
+            pc = (next > 0) ? next : (pc + 1);
+            hasCapture_ = true;
+            break;
+          }
+
+          case Opcode::MATCH:
+            captures_[1] = textPos;
+            matched = true;
+            break;
+
+          case Opcode::ANCHOR_START: {
+            if (textPos == 0) {
+              ++pc;  // Advance to next instruction
+            } else {
+              goto fail;
+            }
+            break;
+          }
+
+          case Opcode::ANCHOR_END: {
+            if (textPos == text.length()) {
+              ++pc;  // Advance to next instruction
+            } else {
+              goto fail;
+            }
+            break;
+          }
+
+          case Opcode::LINE_START:
+            if (atLineStart(text, textPos)) {
+              ++pc;
+            } else {
+              goto fail;
+            }
+            break;
+
+          case Opcode::LINE_END:
+            if (atLineEnd(text, textPos)) {
+              ++pc;
+            } else {
+              goto fail;
+            }
+            break;
+
+          case Opcode::WORD_BOUNDARY:
+          case Opcode::NOT_WORD_BOUNDARY:
+            if (atWordBoundary(text, textPos) == (inst.opcode == Opcode::WORD_BOUNDARY)) {
+              ++pc;
+            } else {
+              goto fail;
+            }
+            break;
+
+          case Opcode::LOOKAHEAD:
+          case Opcode::NEG_LOOKAHEAD:
+          case Opcode::LOOKBEHIND:
+          case Opcode::NEG_LOOKBEHIND: {
+            bool holds =
+                lookaround_.holds(instructions_, inst, text, textPos, kStats ? profile_ : nullptr);
+            uint64_t steps = lookaround_.takeSteps();
+            if constexpr (kChecked)
+              limiter_.steps += steps;
+            if constexpr (kStats)
+              stats_->instructions += steps;
+            if (holds) {
+              ++pc;
+            } else {
+              goto fail;
+            }
+            break;
+          }
+
+          case Opcode::BACKREF: {
+            goto fail;  // Not implemented yet
+          }
+
+          default:
+            ++pc;
+            break;
+        }
+      }
+
+      // If we matched, return success
+      if (matched) {
+        hasCapture_ = true;
+        buildResult(text, captures_.data(), captureCount_, result);
+        return MatchStatus::MATCHED;
+      }
+
+    fail:
+      if constexpr (kStats) {
+        if (profile_ && pc < instructions_.size())
+          ++profile_->fails[pc];
+      }
+      // No match on current path - try backtracking
+      if (backtrackStack_.empty()) {
+        return MatchStatus::NO_MATCH;
+      }
+      if (++backtracks_ > backtrackLimit_) {
+        return MatchStatus::BACKTRACK_LIMIT;
+      }
+
+      // Restore from backtrack stack
+      const BacktrackPoint& bp = backtrackStack_.back();
+      pc = bp.pc;
+      textPos = bp.textPos;
+      captures_ = bp.savedCaptures;
+      backtrackStack_.pop_back();
+    }
+
+    // Should never reach here
+    return MatchStatus::NO_MATCH;
+  }
+
+  template <bool kChecked, bool kStats>
+  MatchStatus searchFrom(const std::string& text, size_t start, size_t end, MatchResult& result) {
+    const size_t textLen = end;
+    lookaround_.begin();
+
+    for (size_t pos = start; pos <= textLen; ++pos) {
+      // Jump straight to the next byte that can start a match
+      pos = plan_.next(text, pos, textLen);
+      if (pos == std::string::npos)
+        break;
+      if constexpr (kStats) {
+        ++stats_->prefilterCandidates;
+        scanTo_ = std::max(scanTo_, pos);
+      }
+      MatchResult tempResult;
+      MatchStatus status = run<kChecked, kStats>(text, pos, textLen, tempResult);
+      if (status == MatchStatus::MATCHED) {
+        // Skip zero-width matches before the end to prevent infinite loops
+        // in callers that resume after the match
+        if (tempResult.length() == 0 && pos < textLen)
+          continue;
+        result = tempResult;
+        return status;
+      }
+      if (status != MatchStatus::NO_MATCH)
+        return status;
+    }
+    if constexpr (kStats)
+      scanTo_ = textLen;  // The prefilter looked at everything left
+    return MatchStatus::NO_MATCH;
+  }
+};
+
+// ============================================================================
+// PikeVM - Linear-time Execution Engine
+// ============================================================================
+// Runs the same program as VM, but advances every live thread in lockstep one
+// input byte at a time instead of backtracking. A pc is added at most once
+// per position, so a call costs O(program size x input length) whatever the
+// pattern. Threads are kept in priority order and lower-priority threads are
+// cut when a higher one matches, which gives the same leftmost-first result
+// and captures as the backtracker.
+class PikeVM {
+ public:
+  PikeVM(const std::vector<Instruction>& instructions, int captureCount)
+      : PikeVM(std::make_shared<const CompiledProgram>(instructions), captureCount) {}
+
+  PikeVM(std::shared_ptr<const CompiledProgram> program, int captureCount)
+      : program_(std::move(program)),
+        instructions_(program_->instructions),
+        plan_(program_->plan),
+        captureCount_(captureCount),
+        slots_(captureCount * 2) {
+    clist_.init(instructions_.size(), slots_);
+    nlist_.init(instructions_.size(), slots_);
+    scratch_.assign(slots_, std::string::npos);
+    matchCaptures_.assign(slots_, std::string::npos);
+  }
+
+  // `sameText` as for VM::executeAt
+  MatchStatus executeAt(const std::string& text, size_t pos, size_t end, MatchResult& result,
+                        bool sameText = false) {
+    return run<false, false>(text, pos, end, true, result, sameText);
+  }
+
+  MatchStatus executeAt(const std::string& text, size_t pos, size_t end, MatchResult& result,
+                        const MatchOptions& options, uint64_t spentSteps = 0) {
+    limiter_.begin(options, spentSteps);
+    if (!options.stats && !options.profile)
+      return run<true, false>(text, pos, end, true, result);
+    beginStats(options);
+    return run<true, true>(text, pos, end, true, result);
+  }
+
+  // Leftmost-first search within [start, end). Like VM::search, a zero-width
+  // match before `end` does not count and the search moves on.
+  MatchStatus search(const std::string& text, size_t start, size_t end, MatchResult& result,
+                     bool sameText = false) {
+    return run<false, false>(text, start, end, false, result, sameText);
+  }
+
+  MatchStatus search(const std::string& text, size_t start, size_t end, MatchResult& result,
+                     const MatchOptions& options, uint64_t spentSteps = 0) {
+    limiter_.begin(options, spentSteps);
+    if (!options.stats && !options.profile)
+      return run<true, false>(text, start, end, false, result);
+    beginStats(options);
+    return run<true, true>(text, start, end, false, result);
+  }
+
+ private:
+  // Sparse set of pcs with a capture array per entry, in insertion (priority) order
+  struct ThreadList {
+    std::vector<uint32_t> sparse;
+    std::vector<uint32_t> dense;
+    std::vector<size_t> captures;
+    uint32_t size = 0;
+
+    void init(size_t n, size_t slots) {
+      sparse.assign(n, 0);
+      dense.assign(n, 0);
+      captures.assign(n * slots, std::string::npos);
+    }
+    bool contains(uint32_t pc) const {
+      uint32_t i = sparse[pc];
+      return i < size && dense[i] == pc;
+    }
+    uint32_t insert(uint32_t pc) {
+      sparse[pc] = size;
+      dense[size] = pc;
+      return size++;
+    }
+  };
+
+  // Work item of the closure walk: explore `pc`, or restore capture `slot`
+  // to `value` once every path through the SAVE that changed it is done
+  struct Frame {
+    uint32_t pc;
+    uint32_t slot;
+    size_t value;
+  };
+  static constexpr uint32_t NO_SLOT = UINT32_MAX;
+
+  std::shared_ptr<const CompiledProgram> program_;
+  const std::vector<Instruction>& instructions_;
+  const SearchPlan& plan_;
+  int captureCount_;
+  size_t slots_;
+  ThreadList clist_;
+  ThreadList nlist_;
+  std::vector<Frame> stack_;
+  std::vector<size_t> scratch_;
+  std::vector<size_t> matchCaptures_;
+  StepLimiter limiter_;
+  MatchStatus stopped_ = MatchStatus::NO_MATCH;
+  Lookaround lookaround_;
+  MatchStats* stats_ = nullptr;
+  ProgramProfile* profile_ = nullptr;
+  MatchStats unusedStats_;
+
+  void beginStats(const MatchOptions& options) {
+    stats_ = options.stats ? options.stats : &unusedStats_;
+    profile_ = options.profile;
+    if (profile_)
+      profile_->fit(instructions_.size());
+  }
+
+  // Follow JUMP/SPLIT/SAVE/anchors from `pc` at `pos` in priority order and
+  // add every consuming instruction and MATCH reached to `list`, with the
+  // captures of the path that reached it. Returns false if a limit stopped
+  // the call.
+  template <bool kChecked, bool kStats>
+  bool addThread(ThreadList& list, uint32_t pc0, const std::string& text, size_t pos) {
+    stack_.push_back({pc0, NO_SLOT, 0});
+    while (!stack_.empty()) {
+      Frame f = stack_.back();
+      stack_.pop_back();
+      if (f.slot != NO_SLOT) {
+        scratch_[f.slot] = f.value;
+        continue;
+      }
+      uint32_t pc = f.pc;
+      while (pc < instructions_.size() && !list.contains(pc)) {
+        uint32_t idx = list.insert(pc);
+        if constexpr (kStats) {
+          ++stats_->instructions;
+          if (profile_)
+            ++profile_->hits[pc];
+        }
+        if constexpr (kChecked) {
+          if (++limiter_.steps >= limiter_.checkAt) {
+            stopped_ = limiter_.check();
+            if (stopped_ != MatchStatus::NO_MATCH) {
+              stack_.clear();
+              return false;
+            }
+          }
+        }
+        const Instruction& inst = instructions_[pc];
+        switch (inst.opcode) {
+          case Opcode::JUMP:
+            pc = inst.operand;
+            continue;
+          case Opcode::SPLIT:
+            // target2 runs after target1
+            stack_.push_back({static_cast<uint32_t>(inst.charset), NO_SLOT, 0});
+            if constexpr (kStats) {
+              if (profile_)
+                ++profile_->pushes[pc];
+            }
+            pc = inst.operand;
+            continue;
+          case Opcode::SAVE: {
+            uint32_t slot = inst.operand & 0xFFFF;
+            uint32_t next = inst.operand >> 16;
+            if (slot < slots_) {
+              stack_.push_back({0, slot, scratch_[slot]});
+              scratch_[slot] = pos;
+            }
+            pc = next > 0 ? next : pc + 1;
+            continue;
+          }
+          case Opcode::ANCHOR_START:
+            if (pos != 0) {
+              countFail<kStats>(pc);
+              break;
+            }
+            ++pc;
+            continue;
+          case Opcode::ANCHOR_END:
+            if (pos != text.length()) {
+              countFail<kStats>(pc);
+              break;
+            }
+            ++pc;
+            continue;
+          case Opcode::LINE_START:
+            if (!atLineStart(text, pos)) {
+              countFail<kStats>(pc);
+              break;
+            }
+            ++pc;
+            continue;
+          case Opcode::LINE_END:
+            if (!atLineEnd(text, pos)) {
+              countFail<kStats>(pc);
+              break;
+            }
+            ++pc;
+            continue;
+          case Opcode::WORD_BOUNDARY:
+          case Opcode::NOT_WORD_BOUNDARY:
+            if (atWordBoundary(text, pos) != (inst.opcode == Opcode::WORD_BOUNDARY)) {
+              countFail<kStats>(pc);
+              break;
+            }
+            ++pc;
+            continue;
+          case Opcode::LOOKAHEAD:
+          case Opcode::NEG_LOOKAHEAD:
+          case Opcode::LOOKBEHIND:
+          case Opcode::NEG_LOOKBEHIND: {
+            bool holds =
+                lookaround_.holds(instructions_, inst, text, pos, kStats ? profile_ : nullptr);
+            uint64_t steps = lookaround_.takeSteps();
+            if constexpr (kChecked)
+              limiter_.steps += steps;
+            if constexpr (kStats)
+              stats_->instructions += steps;
+            if (!holds) {
+              countFail<kStats>(pc);
+              break;
+            }
+            ++pc;
+            continue;
+          }
+          case Opcode::BACKREF:
+            countFail<kStats>(pc);
+            break;  // Not implemented, same as VM
+          default:
+            // Consuming instruction or MATCH: park the thread here
+            std::copy(scratch_.begin(), scratch_.end(), list.captures.begin() + idx * slots_);
+            break;
+        }
+        break;
+      }
+    }
+    return true;
+  }
+
+  template <bool kChecked, bool kStats>
+  MatchStatus run(const std::string& text, size_t start, size_t end, bool anchored,
+                  MatchResult& result, bool sameText = false) {
+    lookaround_.begin(sameText);
+    clist_.size = 0;
+    nlist_.size = 0;
+    stopped_ = MatchStatus::NO_MATCH;
+    bool matched = false;
+    size_t pos = start;
+
+    for (;; ++pos) {
+      if (!matched && (!anchored || pos == start)) {
+        // With no thread alive, jump straight to the next byte that can
+        // start a match
+        if (clist_.size == 0 && !anchored) {
+          pos = plan_.next(text, pos, end);
+          if (pos == std::string::npos) {
+            pos = end;
+            break;
+          }
+        }
+        // A new thread for a match starting here, at the lowest priority
+        if (plan_.admits(text, pos, end)) {
+          if constexpr (kStats) {
+            ++stats_->prefilterCandidates;
+            ++stats_->startPositions;
+          }
+          std::fill(scratch_.begin(), scratch_.end(), std::string::npos);
+          scratch_[0] = pos;
+          if (!addThread<kChecked, kStats>(clist_, 0, text, pos))
+            return finish<kStats>(start, pos, stopped_);
+        }
+      }
+      if (clist_.size == 0 && (matched || anchored))
+        break;
+
+      for (uint32_t i = 0; i < clist_.size; ++i) {
+        uint32_t pc = clist_.dense[i];
+        const Instruction& inst = instructions_[pc];
+        const size_t* caps = clist_.captures.data() + i * slots_;
+        if (inst.opcode == Opcode::MATCH) {
+          // A search skips zero-width matches before the end, like VM::search
+          if (anchored || caps[0] != pos || pos == end) {
+            std::copy(caps, caps + slots_, matchCaptures_.begin());
+            matchCaptures_[1] = pos;
+            matched = true;
+          }
+          break;  // Lower-priority threads can only lose to this one
+        }
+        if (pos < end && inst.accepts(text[pos])) {
+          std::copy(caps, caps + slots_, scratch_.begin());
+          if (!addThread<kChecked, kStats>(nlist_, pc + 1, text, pos + 1))
+            return finish<kStats>(start, pos, stopped_);
+        } else {
+          countFail<kStats>(pc);
+        }
+      }
+
+      if (pos >= end)
+        break;
+      std::swap(clist_, nlist_);
+      nlist_.size = 0;
+    }
+
+    if (!matched)
+      return finish<kStats>(start, pos, MatchStatus::NO_MATCH);
+    VM::buildResult(text, matchCaptures_.data(), captureCount_, result);
+    return finish<kStats>(start, pos, MatchStatus::MATCHED);
+  }
+
+  template <bool kStats>
+  void countFail(uint32_t pc) {
+    if constexpr (kStats) {
+      if (profile_)
+        ++profile_->fails[pc];
+    }
+  }
+
+  template <bool kStats>
+  MatchStatus finish(size_t start, size_t pos, MatchStatus status) {
+    if constexpr (kStats)
+      stats_->bytesScanned += pos - start;
+    return status;
+  }
+};
+
+// ============================================================================
+// Program Listing
+// ============================================================================
+// Printable bytes as themselves, anything else as \xNN
+inline void appendEscapedByte(std::string& out, unsigned char c) {
+  if (c >= 0x20 && c < 0x7F && c != '\\' && c != '\'') {
+    out += static_cast<char>(c);
+  } else {
+    char buf[8];
+    std::snprintf(buf, sizeof(buf), "\\x%02X", c);
+    out += buf;
+  }
+}
+
+// Bytes 0-127 of a CLASS/NOT_CLASS bitmap as a bracket expression of ranges
+inline std::string formatClassBits(uint64_t low, uint64_t high, bool negated) {
+  std::string out = negated ? "[^" : "[";
+  auto has = [&](int c) { return ((c < 64 ? low >> c : high >> (c - 64)) & 1) != 0; };
+  for (int c = 0; c < 128; ++c) {
+    if (!has(c))
+      continue;
+    int last = c;
+    while (last + 1 < 128 && has(last + 1))
+      ++last;
+    appendEscapedByte(out, static_cast<unsigned char>(c));
+    if (last > c) {
+      if (last > c + 1)
+        out += '-';
+      appendEscapedByte(out, static_cast<unsigned char>(last));
+    }
+    c = last;
+  }
+  return out + "]";
+}
+
+// One line per instruction: pc, opcode and operands, the pattern offset it
+// was compiled from and the pattern text from there on. With a profile, the
+// hit, fail and push counts of each instruction are shown as well, so the
+// hot quantifier or alternation stands out. `sourceMap` is what
+// Compiler::sourceMap() returned for `program`.
+inline std::string disassemble(const std::vector<Instruction>& program,
+                               const std::vector<uint32_t>& sourceMap, const std::string& pattern,
+                               const ProgramProfile* profile = nullptr) {
+  // Indexed by Opcode
+  static const char* const names[] = {
+      "CHAR",    "ANY",        "RANGE",    "CLASS",     "NOT_CLASS",    "CLASS_PRED",
+      "JUMP",    "SPLIT",      "SAVE",     "MATCH",     "ANCHOR_START", "ANCHOR_END",
+      "BACKREF", "LINE_START", "LINE_END", "ANY_NO_NL", "WORD_BOUNDARY", "NOT_WORD_BOUNDARY",
+      "LOOKAHEAD", "NEG_LOOKAHEAD", "LOOKBEHIND", "NEG_LOOKBEHIND"};
+  static const char* const predicates[] = {"\\d", "\\w", "\\s", "\\D", "\\W", "\\S"};
+  const size_t SNIPPET = 24;
+  char buf[128];
+
+  std::string out;
+  if (profile) {
+    std::snprintf(buf, sizeof(buf), "%5s  %-30s %10s %10s %10s  %5s  %s\n", "pc", "instruction",
+                  "hits", "fails", "pushes", "src", "pattern");
+  } else {
+    std::snprintf(buf, sizeof(buf), "%5s  %-30s  %5s  %s\n", "pc", "instruction", "src",
+                  "pattern");
+  }
+  out += buf;
+
+  for (size_t pc = 0; pc < program.size(); ++pc) {
+    const Instruction& inst = program[pc];
+    std::string text = names[static_cast<int>(inst.opcode)];
+    text.resize(std::max<size_t>(text.size() + 1, 11), ' ');
+    switch (inst.opcode) {
+      case Opcode::CHAR:
+        text += '\'';
+        appendEscapedByte(text, static_cast<unsigned char>(inst.ch));
+        text += '\'';
+        break;
+      case Opcode::RANGE:
+        text += '\'';
+        appendEscapedByte(text, static_cast<unsigned char>(inst.lo));
+        text += "'-'";
+        appendEscapedByte(text, static_cast<unsigned char>(inst.hi));
+        text += '\'';
+        break;
+      case Opcode::CLASS:
+      case Opcode::NOT_CLASS:
+        text += formatClassBits(inst.charset_low, inst.charset_high,
+                                    inst.opcode == Opcode::NOT_CLASS);
+        break;
+      case Opcode::CLASS_PRED:
+        text += predicates[(inst.class_type & 0x0F) % 3 + ((inst.class_type & 0x10) ? 3 : 0)];
+        break;
+      case Opcode::JUMP:
+        text += std::to_string(inst.operand);
+        break;
+      case Opcode::SPLIT:
+        text += std::to_string(inst.operand) + ", " + std::to_string(inst.charset);
+        break;
+      case Opcode::SAVE:
+        text += std::to_string(inst.operand & 0xFFFF);
+        if (inst.operand >> 16)
+          text += " -> " + std::to_string(inst.operand >> 16);
+        break;
+      case Opcode::BACKREF:
+        text += "\\" + std::to_string(inst.operand & 0xFFFF);
+        break;
+      case Opcode::LOOKAHEAD:
+      case Opcode::NEG_LOOKAHEAD:
+        text += "-> " + std::to_string(inst.operand);
+        break;
+      case Opcode::LOOKBEHIND:
+      case Opcode::NEG_LOOKBEHIND:
+        text += "-> " + std::to_string(inst.operand);
+        if (inst.charset_high != 0)
+          text += ", " + std::to_string(inst.charset_high) + " bytes";
+        break;
+      default:
+        break;
+    }
+    if (text.size() > 30)
+      text = text.substr(0, 27) + "...";
+
+    uint32_t offset = pc < sourceMap.size() ? sourceMap[pc] : Compiler::NO_SOURCE;
+    std::string src = "-";
+    std::string snippet;
+    if (offset != Compiler::NO_SOURCE && offset < pattern.size()) {
+      src = std::to_string(offset);
+      snippet = pattern.substr(offset, SNIPPET);
+      if (pattern.size() - offset > SNIPPET)
+        snippet += "...";
+    }
+
+    if (profile) {
+      auto count = [](const std::vector<uint64_t>& v, size_t i) {
+        return static_cast<unsigned long long>(i < v.size() ? v[i] : 0);
+      };
+      std::snprintf(buf, sizeof(buf), "%5zu  %-30s %10llu %10llu %10llu  %5s", pc, text.c_str(),
+                    count(profile->hits, pc), count(profile->fails, pc),
+                    count(profile->pushes, pc), src.c_str());
+    } else {
+      std::snprintf(buf, sizeof(buf), "%5zu  %-30s  %5s", pc, text.c_str(), src.c_str());
+    }
+    out += buf;
+    if (!snippet.empty())
+      out += "  " + snippet;
+    out += '\n';
+  }
+  return out;
+}
+
+// ============================================================================
+// Thread Slots
+// ============================================================================
+// Per-thread state shared objects keep for their callers (metrics shards,
+// matching scratch) is indexed by a thread slot. A thread leases the lowest
+// free one of THREAD_SLOTS slots on first use and holds it until it exits,
+// when the slot passes to the next thread that asks. THREAD_SLOTS means
+// every slot was taken; callers then fall back to shared, synchronized
+// state.
+constexpr size_t THREAD_SLOTS = 64;
+
+inline size_t threadSlot() {
+  static_assert(THREAD_SLOTS == 64, "slots are tracked in one 64-bit mask");
+  // Plain copy of the lease's slot: a trivially initialized thread_local
+  // reads without the guard check of the one below
+  thread_local size_t cached = SIZE_MAX;
+  if (cached != SIZE_MAX)
+    return cached;
+  static std::atomic<uint64_t> taken{0};
+  struct Lease {
+    size_t slot = THREAD_SLOTS;
+    Lease() {
+      uint64_t mask = taken.load(std::memory_order_relaxed);
+      while (~mask) {
+        size_t free = 0;
+        while (mask & (uint64_t(1) << free))
+          ++free;
+        if (taken.compare_exchange_weak(mask, mask | (uint64_t(1) << free),
+                                        std::memory_order_acquire)) {
+          slot = free;
+          break;
+        }
+      }
+    }
+    ~Lease() {
+      if (slot < THREAD_SLOTS)
+        taken.fetch_and(~(uint64_t(1) << slot), std::memory_order_release);
+    }
+  };
+  thread_local Lease lease;
+  cached = lease.slot;
+  return cached;
+}
+
+// ============================================================================
+// Latency Metrics
+// ============================================================================
+// Log-linear latency histogram in the style of HdrHistogram. Values below
+// SUB_BUCKETS nanoseconds are exact; above that each power of two is split
+// into SUB_BUCKETS buckets, so a reported value is within 1/SUB_BUCKETS of
+// the latency that was recorded.
+struct LatencyHistogram {
+  static constexpr int SUB_BUCKET_BITS = 4;
+  static constexpr int SUB_BUCKETS = 1 << SUB_BUCKET_BITS;
+  static constexpr int MAX_EXPONENT = 47;  // 2^48 ns is about three days
+  static constexpr size_t BUCKETS = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) * SUB_BUCKETS;
+
+  std::array<uint64_t, BUCKETS> counts{};
+  uint64_t count = 0;
+  uint64_t totalNanos = 0;
+  uint64_t minNanos = UINT64_MAX;
+  uint64_t maxNanos = 0;
+
+  static size_t bucketOf(uint64_t nanos) {
+    if (nanos < static_cast<uint64_t>(SUB_BUCKETS))
+      return static_cast<size_t>(nanos);
+    int exponent = 0;  // Index of the highest set bit, by binary search
+    for (int step = 32; step > 0; step >>= 1) {
+      if (nanos >> (exponent + step))
+        exponent += step;
+    }
+    if (exponent > MAX_EXPONENT)
+      return BUCKETS - 1;
+    int shift = exponent - SUB_BUCKET_BITS;
+    return static_cast<size_t>(exponent - SUB_BUCKET_BITS + 1) * SUB_BUCKETS +
+           ((nanos >> shift) & (SUB_BUCKETS - 1));
+  }
+
+  // Largest value that lands in `bucket`
+  static uint64_t bucketLimit(size_t bucket) {
+    if (bucket < static_cast<size_t>(SUB_BUCKETS))
+      return bucket;
+    int shift = static_cast<int>(bucket / SUB_BUCKETS) - 1;
+    uint64_t low = static_cast<uint64_t>(SUB_BUCKETS + bucket % SUB_BUCKETS) << shift;
+    return low + (uint64_t(1) << shift) - 1;
+  }
+
+  void record(uint64_t nanos) {
+    ++counts[bucketOf(nanos)];
+    ++count;
+    totalNanos += nanos;
+    minNanos = std::min(minNanos, nanos);
+    maxNanos = std::max(maxNanos, nanos);
+  }
+
+  void merge(const LatencyHistogram& other) {
+    for (size_t i = 0; i < BUCKETS; ++i)
+      counts[i] += other.counts[i];
+    count += other.count;
+    totalNanos += other.totalNanos;
+    minNanos = std::min(minNanos, other.minNanos);
+    maxNanos = std::max(maxNanos, other.maxNanos);
+  }
+
+  // Latency that fraction `q` of the samples are at or below, rounded up to
+  // the limit of its bucket: percentile(0.99) is p99. 0 when empty.
+  uint64_t percentile(double q) const {
+    if (count == 0)
+      return 0;
+    uint64_t rank = static_cast<uint64_t>(std::ceil(q * static_cast<double>(count)));
+    rank = std::max<uint64_t>(1, std::min(rank, count));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; ++i) {
+      seen += counts[i];
+      if (seen >= rank)
+        return std::min(bucketLimit(i), maxNanos);
+    }
+    return maxNanos;
+  }
+
+  double mean() const {
+    return count ? static_cast<double>(totalNanos) / count : 0.0;
+  }
+};
+
+// Totals of one pattern at the time of PatternMetrics::snapshot()
+struct PatternMetricsSnapshot {
+  LatencyHistogram latency;  // One sample per call
+  uint64_t matches = 0;      // Calls that found a match
+  uint64_t bytes = 0;        // Sum of the input windows the calls were given
+
+  // Input bytes per second of time spent inside calls
+  double throughput() const {
+    return latency.totalNanos ? bytes * 1e9 / latency.totalNanos : 0.0;
+  }
+};
+
+// Latency recorder shared by every copy of a Regex that enabled metrics. It
+// is safe to record from many threads at once. Each live thread owns the
+// cache-line aligned shard of its threadSlot() and counts there with plain
+// relaxed loads and stores, so recording costs no locked instructions and
+// threads never share a line. Threads without a slot share one overflow
+// shard with atomic adds. Shards, and each power-of-two row of their
+// histogram, are allocated on first use and only merged when a snapshot is
+// taken. A shard is about 450 bytes plus 128 bytes per row its calls reach,
+// so a pattern whose latencies span a few powers of two costs about 1 KB
+// per thread that runs it.
+class PatternMetrics {
+ public:
+  static constexpr size_t METRICS_SHARDS = THREAD_SLOTS;
+
+  PatternMetrics() = default;
+  PatternMetrics(const PatternMetrics&) = delete;
+  PatternMetrics& operator=(const PatternMetrics&) = delete;
+
+  ~PatternMetrics() {
+    for (auto& shard : shards_)
+      delete shard.load(std::memory_order_relaxed);
+  }
+
+  void record(uint64_t nanos, size_t bytes, bool matched) {
+    size_t slot = threadSlot();
+    Shard& s = shard(slot);
+    if (slot < METRICS_SHARDS)
+      s.add<false>(nanos, bytes, matched);
+    else
+      s.add<true>(nanos, bytes, matched);
+  }
+
+  // Merge every shard. Calls still running on other threads may or may not
+  // be included.
+  PatternMetricsSnapshot snapshot() const {
+    PatternMetricsSnapshot out;
+    LatencyHistogram& h = out.latency;
+    for (const auto& entry : shards_) {
+      const Shard* s = entry.load(std::memory_order_acquire);
+      if (!s)
+        continue;
+      for (size_t r = 0; r < Shard::ROWS; ++r) {
+        const Shard::Row* row = s->rows[r].load(std::memory_order_acquire);
+        if (!row)
+          continue;
+        for (size_t i = 0; i < row->size(); ++i) {
+          uint64_t n = (*row)[i].load(std::memory_order_relaxed);
+          h.counts[r * row->size() + i] += n;
+          h.count += n;
+        }
+      }
+      h.totalNanos += s->totalNanos.load(std::memory_order_relaxed);
+      h.minNanos = std::min(h.minNanos, s->minNanos.load(std::memory_order_relaxed));
+      h.maxNanos = std::max(h.maxNanos, s->maxNanos.load(std::memory_order_relaxed));
+      out.matches += s->matches.load(std::memory_order_relaxed);
+      out.bytes += s->bytes.load(std::memory_order_relaxed);
+    }
+    return out;
+  }
+
+ private:
+  struct alignas(64) Shard {
+    // Histogram counts, one row of SUB_BUCKETS per power of two
+    using Row = std::array<std::atomic<uint64_t>, LatencyHistogram::SUB_BUCKETS>;
+    static constexpr size_t ROWS = LatencyHistogram::BUCKETS / LatencyHistogram::SUB_BUCKETS;
+
+    std::array<std::atomic<Row*>, ROWS> rows{};
+    std::atomic<uint64_t> matches;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> totalNanos;
+    std::atomic<uint64_t> minNanos;
+    std::atomic<uint64_t> maxNanos;
+
+    Shard() : matches(0), bytes(0), totalNanos(0), minNanos(UINT64_MAX), maxNanos(0) {}
+    Shard(const Shard&) = delete;
+    Shard& operator=(const Shard&) = delete;
+
+    ~Shard() {
+      for (auto& row : rows)
+        delete row.load(std::memory_order_relaxed);
+    }
+
+    std::atomic<uint64_t>& counter(size_t bucket) {
+      std::atomic<Row*>& entry = rows[bucket / LatencyHistogram::SUB_BUCKETS];
+      Row* row = entry.load(std::memory_order_acquire);
+      if (!row) {
+        Row* fresh = new Row();
+        for (auto& c : *fresh)
+          c.store(0, std::memory_order_relaxed);
+        if (entry.compare_exchange_strong(row, fresh, std::memory_order_acq_rel))
+          row = fresh;
+        else
+          delete fresh;  // Another thread sharing the overflow shard got there first
+      }
+      return (*row)[bucket % LatencyHistogram::SUB_BUCKETS];
+    }
+
+    // kShared: other threads may write this shard concurrently
+    template <bool kShared>
+    static void bump(std::atomic<uint64_t>& counter, uint64_t value) {
+      if (kShared)
+        counter.fetch_add(value, std::memory_order_relaxed);
+      else
+        counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    template <bool kShared>
+    static void lower(std::atomic<uint64_t>& bound, uint64_t value) {
+      uint64_t seen = bound.load(std::memory_order_relaxed);
+      if (!kShared) {
+        if (value < seen)
+          bound.store(value, std::memory_order_relaxed);
+        return;
+      }
+      while (value < seen && !bound.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+      }
+    }
+
+    template <bool kShared>
+    static void raise(std::atomic<uint64_t>& bound, uint64_t value) {
+      uint64_t seen = bound.load(std::memory_order_relaxed);
+      if (!kShared) {
+        if (value > seen)
+          bound.store(value, std::memory_order_relaxed);
+        return;
+      }
+      while (value > seen && !bound.compare_exchange_weak(seen, value, std::memory_order_relaxed)) {
+      }
+    }
+
+    template <bool kShared>
+    void add(uint64_t nanos, size_t bytesSeen, bool matched) {
+      bump<kShared>(counter(LatencyHistogram::bucketOf(nanos)), 1);
+      bump<kShared>(totalNanos, nanos);
+      bump<kShared>(bytes, bytesSeen);
+      if (matched)
+        bump<kShared>(matches, 1);
+      lower<kShared>(minNanos, nanos);
+      raise<kShared>(maxNanos, nanos);
+    }
+  };
+
+  // Owned shards, then the overflow shard
+  std::array<std::atomic<Shard*>, METRICS_SHARDS + 1> shards_{};
+
+  Shard& shard(size_t slot) {
+    std::atomic<Shard*>& entry = shards_[slot];
+    Shard* s = entry.load(std::memory_order_acquire);
+    if (s)
+      return *s;
+    Shard* fresh = new Shard();
+    if (entry.compare_exchange_strong(s, fresh, std::memory_order_acq_rel))
+      return *fresh;
+    delete fresh;  // Another thread sharing the overflow shard got there first
+    return *s;
+  }
+};
+
+// ============================================================================
+// Workload Recording
+// ============================================================================
+// Opt-in capture of the calls made on Regex objects, so a production mix of
+// patterns and inputs can be replayed against another build or engine (see
+// benchmarks/replay_benchmark.cc). A recorder writes a compact binary file:
+// the magic "AMWL" and a version byte, then one record per pattern and per
+// sampled call:
+//   'P' id flags pattern
+//   'C' pattern-id api start end text
+// Integers are LEB128 varints and strings a varint length and the bytes.
+// `end` is stored plus one so npos is 0, and a text length of 0 means the
+// text of the previous call, which a rule set run over each line repeats.
+// Budgets and other MatchOptions are not recorded; those calls replay as
+// plain match and search calls.
+enum class RecordedApi : uint8_t { MATCH, SEARCH, SEARCH_ALL };
+
+constexpr char WORKLOAD_MAGIC[4] = {'A', 'M', 'W', 'L'};
+constexpr uint8_t WORKLOAD_VERSION = 1;
+
+// Writes the calls of every Regex it is attached to. Safe to use from many
+// threads; each thread decides on its own which calls to sample, and sampled
+// calls are written under a lock, so keep the sampling rate low on hot paths.
+class WorkloadRecorder {
+ public:
+  // Records every `sampleEvery`th call of each thread until the file reaches
+  // `maxBytes`
+  explicit WorkloadRecorder(const std::string& path, uint64_t sampleEvery = 1,
+                            uint64_t maxBytes = uint64_t(1) << 30)
+      : file_(std::fopen(path.c_str(), "wb")),
+        sampleEvery_(std::max<uint64_t>(1, sampleEvery)),
+        maxBytes_(maxBytes),
+        serial_(nextSerial()) {
+    if (file_) {
+      write(WORKLOAD_MAGIC, sizeof(WORKLOAD_MAGIC));
+      put(WORKLOAD_VERSION);
+    }
+  }
+  WorkloadRecorder(const WorkloadRecorder&) = delete;
+  WorkloadRecorder& operator=(const WorkloadRecorder&) = delete;
+
+  ~WorkloadRecorder() {
+    if (file_)
+      std::fclose(file_);
+  }
+
+  // False when the file could not be created
+  bool ok() const {
+    return file_ != nullptr;
+  }
 
-          case Opcode::BACKREF: {
-            goto fail;  // Not implemented yet
-          }
+  void record(const std::string& pattern, uint32_t flags, RecordedApi api,
+              const std::string& text, size_t start, size_t end) {
+    if (!sampled())
+      return;
+    std::string key = patternKey(pattern, flags);
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!file_ || bytes_ >= maxBytes_)
+      return;
+    uint64_t id = patternId(key, pattern, flags);
+    put('C');
+    putVarint(id);
+    put(static_cast<uint8_t>(api));
+    putVarint(start);
+    putVarint(end == std::string::npos ? 0 : uint64_t(end) + 1);
+    if (haveText_ && lastText_ == text) {
+      putVarint(0);
+    } else {
+      putString(text, 1);
+      lastText_ = text;
+      haveText_ = true;
+    }
+    ++recorded_;
+  }
 
-          default:
-            ++pc;
-            break;
-        }
-      }
+  // Calls written so far
+  uint64_t recordedCalls() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return recorded_;
+  }
 
-      // If we matched, return success
-      if (matched) {
-        hasCapture_ = true;
-        buildResult(text, result);
-        return true;
-      }
+  void flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (file_)
+      std::fflush(file_);
+  }
 
-    fail:
-      // No match on current path - try backtracking
-      if (backtrackStack_.empty()) {
-        return false;
-      }
+ private:
+  std::FILE* file_;
+  uint64_t sampleEvery_;
+  uint64_t maxBytes_;
+  uint64_t serial_;  // Tells this recorder's countdowns from an earlier one's
+  mutable std::mutex mutex_;
+  uint64_t bytes_ = 0;
+  uint64_t recorded_ = 0;
+  std::unordered_map<std::string, uint64_t> patternIds_;  // By patternKey()
+  std::string lastText_;
+  bool haveText_ = false;
+
+  static uint64_t nextSerial() {
+    static std::atomic<uint64_t> serial{0};
+    return serial.fetch_add(1, std::memory_order_relaxed) + 1;
+  }
 
-      // Restore from backtrack stack
-      const BacktrackPoint& bp = backtrackStack_.back();
-      pc = bp.pc;
-      textPos = bp.textPos;
-      captures_ = bp.savedCaptures;
-      backtrackStack_.pop_back();
+  // Each thread counts down its own calls, so a call that is not sampled
+  // touches nothing shared. A thread that moves between recorders starts
+  // over with a sampled call.
+  bool sampled() const {
+    struct Countdown {
+      uint64_t recorder;
+      uint64_t left;
+    };
+    thread_local Countdown countdown = {0, 0};
+    if (countdown.recorder != serial_) {
+      countdown.recorder = serial_;
+      countdown.left = 0;
+    }
+    if (countdown.left > 0) {
+      --countdown.left;
+      return false;
     }
+    countdown.left = sampleEvery_ - 1;
+    return true;
+  }
 
-    // Should never reach here
-    return false;
+  // The flags' bytes, then the pattern
+  static std::string patternKey(const std::string& pattern, uint32_t flags) {
+    std::string key(reinterpret_cast<const char*>(&flags), sizeof(flags));
+    return key += pattern;
   }
 
-  // Try to match starting at any position (for search)
-  bool search(const std::string& text, size_t start, MatchResult& result) {
-    const size_t textLen = text.length();
+  uint64_t patternId(const std::string& key, const std::string& pattern, uint32_t flags) {
+    auto it = patternIds_.find(key);
+    if (it != patternIds_.end())
+      return it->second;
+    uint64_t id = patternIds_.size();
+    patternIds_.emplace(key, id);
+    put('P');
+    putVarint(id);
+    putVarint(flags);
+    putString(pattern, 0);
+    return id;
+  }
 
-    // Track previous match length to prevent infinite loops with zero-width matches
-    size_t prevMatchLen = 0;
-    for (size_t pos = start; pos <= textLen;) {
-      MatchResult tempResult;
-      if (executeAt(text, pos, tempResult)) {
-        size_t matchLen = tempResult.length();
-        // Prevent infinite loop for zero-width matches
-        if (matchLen == 0 && matchLen == prevMatchLen && pos < textLen) {
-          pos++;  // Force advance to prevent loop
-        } else {
-          result = tempResult;
-          return true;
-        }
-      } else {
-        // No match, try next position
-        pos++;
-      }
-      prevMatchLen = (pos < textLen && tempResult.matched) ? (size_t)tempResult.length() : 0;
-    }
-    return false;
+  void write(const void* data, size_t n) {
+    bytes_ += std::fwrite(data, 1, n, file_);
   }
 
- private:
-  std::vector<Instruction> instructions_;  // Own a copy of instructions
-  std::vector<size_t> captures_;
-  int captureCount_;
-  bool hasCapture_;
+  void put(uint8_t byte) {
+    write(&byte, 1);
+  }
 
-  // Stack for backtracking - stores {pc, textPos}
-  struct BacktrackPoint {
-    uint32_t pc;
-    size_t textPos;
-    std::vector<size_t> savedCaptures;
-  };
-  std::vector<BacktrackPoint> backtrackStack_;
+  void putVarint(uint64_t v) {
+    uint8_t buf[10];
+    size_t n = 0;
+    do {
+      buf[n++] = static_cast<uint8_t>((v & 0x7f) | (v > 0x7f ? 0x80 : 0));
+      v >>= 7;
+    } while (v);
+    write(buf, n);
+  }
 
-  void buildResult(const std::string& text, MatchResult& result) {
-    result.matched = true;
-    result.position = captures_[0];
-    size_t length = captures_[1] - captures_[0];
-    result.matched_text = text.substr(captures_[0], length);
+  // Length plus `bias`, then the bytes
+  void putString(const std::string& s, uint64_t bias) {
+    putVarint(s.size() + bias);
+    write(s.data(), s.size());
+  }
+};
 
-    result.captures.clear();
-    // Find groups that are NOT contained in other groups (excluding the full match)
-    // A group is contained in another if its start >= other.start and end <= other.end
-    std::vector<bool> is_contained(captureCount_, false);
-    for (int i = 1; i < captureCount_; ++i) {
-      size_t i_start = captures_[i * 2];
-      size_t i_end = captures_[i * 2 + 1];
-      if (i_start == std::string::npos || i_end == std::string::npos)
-        continue;
-      for (int j = 1; j < captureCount_; ++j) {
-        if (i == j || is_contained[j])
-          continue;
-        size_t j_start = captures_[j * 2];
-        size_t j_end = captures_[j * 2 + 1];
-        if (j_start == std::string::npos || j_end == std::string::npos)
-          continue;
-        // i is contained in j if j's range covers i's range and they're not equal
-        if (j_start <= i_start && i_end <= j_end && (j_start < i_start || i_end < j_end)) {
-          is_contained[i] = true;
+// A recorded workload, read back whole
+struct RecordedPattern {
+  std::string pattern;
+  uint32_t flags = 0;
+};
+
+struct RecordedCall {
+  uint32_t pattern = 0;  // Index into RecordedWorkload::patterns
+  RecordedApi api = RecordedApi::SEARCH;
+  size_t start = 0;
+  size_t end = std::string::npos;
+  uint32_t text = 0;  // Index into RecordedWorkload::texts
+};
+
+struct RecordedWorkload {
+  std::vector<RecordedPattern> patterns;
+  std::vector<std::string> texts;
+  std::vector<RecordedCall> calls;
+};
+
+// Returns false with `error` set when the file is missing or malformed. A
+// file cut short mid-record, as by a crash, keeps the calls before the cut.
+inline bool readWorkload(const std::string& path, RecordedWorkload& out, std::string& error) {
+  std::FILE* file = std::fopen(path.c_str(), "rb");
+  if (!file) {
+    error = "cannot open " + path;
+    return false;
+  }
+  std::string data;
+  char buf[1 << 16];
+  for (size_t n; (n = std::fread(buf, 1, sizeof(buf), file)) > 0;)
+    data.append(buf, n);
+  std::fclose(file);
+
+  // Both return false at the end of the data
+  size_t pos = 0;
+  auto varint = [&](uint64_t& v) {
+    v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      if (pos >= data.size())
+        return false;
+      uint8_t byte = static_cast<uint8_t>(data[pos++]);
+      v |= uint64_t(byte & 0x7f) << shift;
+      if (!(byte & 0x80))
+        return true;
+    }
+    return false;
+  };
+  auto bytes = [&](uint64_t n, std::string& s) {
+    if (n > data.size() - pos)
+      return false;
+    s.assign(data, pos, n);
+    pos += n;
+    return true;
+  };
+
+  if (data.size() < 5 || std::memcmp(data.data(), WORKLOAD_MAGIC, 4) != 0) {
+    error = path + " is not a recorded workload";
+    return false;
+  }
+  if (static_cast<uint8_t>(data[4]) != WORKLOAD_VERSION) {
+    error = path + " has unsupported format version " +
+            std::to_string(static_cast<uint8_t>(data[4]));
+    return false;
+  }
+  pos = 5;
+  out = RecordedWorkload();
+  while (pos < data.size()) {
+    char tag = data[pos++];
+    uint64_t id, flags, api, start, end, length;
+    if (tag == 'P') {
+      RecordedPattern p;
+      if (!varint(id) || !varint(flags) || !varint(length) || !bytes(length, p.pattern))
+        break;
+      if (id != out.patterns.size()) {
+        error = path + ": pattern ids out of order";
+        return false;
+      }
+      p.flags = static_cast<uint32_t>(flags);
+      out.patterns.push_back(std::move(p));
+    } else if (tag == 'C') {
+      RecordedCall c;
+      if (!varint(id) || pos >= data.size())
+        break;
+      api = static_cast<uint8_t>(data[pos++]);
+      if (!varint(start) || !varint(end) || !varint(length))
+        break;
+      if (length > 0) {
+        std::string text;
+        if (!bytes(length - 1, text))
           break;
-        }
+        out.texts.push_back(std::move(text));
       }
-    }
-    // Only add non-contained groups to captures
-    for (int i = 1; i < captureCount_; ++i) {
-      if (!is_contained[i]) {
-        size_t start = captures_[i * 2];
-        size_t end = captures_[i * 2 + 1];
-        if (start != std::string::npos && end != std::string::npos && end > start) {
-          result.captures.push_back({start, end, text.substr(start, end - start)});
-        } else {
-          result.captures.push_back({std::string::npos, std::string::npos, ""});
-        }
+      if (id >= out.patterns.size() || api > uint8_t(RecordedApi::SEARCH_ALL) ||
+          out.texts.empty()) {
+        error = path + ": call refers to an unknown pattern, API or text";
+        return false;
       }
+      c.pattern = static_cast<uint32_t>(id);
+      c.api = static_cast<RecordedApi>(api);
+      c.start = static_cast<size_t>(start);
+      c.end = end == 0 ? std::string::npos : static_cast<size_t>(end - 1);
+      c.text = static_cast<uint32_t>(out.texts.size() - 1);
+      out.calls.push_back(c);
+    } else {
+      error = path + ": unknown record type";
+      return false;
     }
   }
-};
+  return true;
+}
 
 // ============================================================================
 // FastRegex Main Class
 // ============================================================================
+// Matching calls (match, search, searchAll, replace) may run on one Regex
+// from many threads at once; each thread matches with its own scratch
+// engines. Changing a Regex (setEngine, enableMetrics, assignment) must not
+// overlap with calls on it.
 class Regex {
  public:
   enum class CompileFlag {
@@ -1397,8 +4553,24 @@ class Regex {
     EXTENDED = 8
   };
 
+  friend constexpr CompileFlag operator|(CompileFlag a, CompileFlag b) {
+    return static_cast<CompileFlag>(static_cast<int>(a) | static_cast<int>(b));
+  }
+
+  // Parser modes for `flags`, so analyze() sees the pattern a Regex compiles
+  static ParserOptions parserOptions(CompileFlag flags) {
+    auto has = [flags](CompileFlag flag) {
+      return (static_cast<int>(flags) & static_cast<int>(flag)) != 0;
+    };
+    ParserOptions options;
+    options.ignoreCase = has(CompileFlag::CASE_INSENSITIVE);
+    options.multiline = has(CompileFlag::MULTILINE);
+    options.dotAll = has(CompileFlag::DOTALL);
+    return options;
+  }
+
   explicit Regex(const std::string& pattern, CompileFlag flags = CompileFlag::DEFAULT)
-      : pattern_(pattern), flags_(flags), compiled_(false) {
+      : pattern_(pattern), flags_(flags), compiled_(false), recorder_(defaultRecorder()) {
     compile();
   }
 
@@ -1406,12 +4578,15 @@ class Regex {
   Regex(const Regex& other)
       : pattern_(other.pattern_),
         flags_(other.flags_),
-        instructions_(other.instructions_),
-        engine_(nullptr),
         compiled_(other.compiled_),
-        numCaptures_(other.numCaptures_) {
+        numCaptures_(other.numCaptures_),
+        engineChoice_(other.engineChoice_),
+        preferLinear_(other.preferLinear_.load(std::memory_order_relaxed)),
+        fallbacks_(other.fallbacks_.load(std::memory_order_relaxed)),
+        metrics_(other.metrics_),
+        recorder_(other.recorder_) {
     if (compiled_) {
-      engine_ = std::make_unique<VM>(instructions_, numCaptures_ + 1);
+      scratch_ = std::make_unique<ScratchPool>(other.scratch_->program(), numCaptures_ + 1);
     }
   }
 
@@ -1420,14 +4595,20 @@ class Regex {
     if (this != &other) {
       pattern_ = other.pattern_;
       flags_ = other.flags_;
-      instructions_ = other.instructions_;
       numCaptures_ = other.numCaptures_;
       compiled_ = other.compiled_;
       if (compiled_) {
-        engine_ = std::make_unique<VM>(instructions_, numCaptures_ + 1);
+        scratch_ = std::make_unique<ScratchPool>(other.scratch_->program(), numCaptures_ + 1);
       } else {
-        engine_.reset();
+        scratch_.reset();
       }
+      engineChoice_ = other.engineChoice_;
+      preferLinear_.store(other.preferLinear_.load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+      fallbacks_.store(other.fallbacks_.load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+      metrics_ = other.metrics_;
+      recorder_ = other.recorder_;
     }
     return *this;
   }
@@ -1436,10 +4617,14 @@ class Regex {
   Regex(Regex&& other) noexcept
       : pattern_(std::move(other.pattern_)),
         flags_(other.flags_),
-        instructions_(std::move(other.instructions_)),
-        engine_(std::move(other.engine_)),
         compiled_(other.compiled_),
-        numCaptures_(other.numCaptures_) {
+        numCaptures_(other.numCaptures_),
+        scratch_(std::move(other.scratch_)),
+        engineChoice_(other.engineChoice_),
+        preferLinear_(other.preferLinear_.load(std::memory_order_relaxed)),
+        fallbacks_(other.fallbacks_.load(std::memory_order_relaxed)),
+        metrics_(std::move(other.metrics_)),
+        recorder_(std::move(other.recorder_)) {
     other.compiled_ = false;
   }
 
@@ -1448,62 +4633,80 @@ class Regex {
     if (this != &other) {
       pattern_ = std::move(other.pattern_);
       flags_ = other.flags_;
-      instructions_ = std::move(other.instructions_);
-      engine_ = std::move(other.engine_);
       compiled_ = other.compiled_;
       numCaptures_ = other.numCaptures_;
+      scratch_ = std::move(other.scratch_);
+      engineChoice_ = other.engineChoice_;
+      preferLinear_.store(other.preferLinear_.load(std::memory_order_relaxed),
+                          std::memory_order_relaxed);
+      fallbacks_.store(other.fallbacks_.load(std::memory_order_relaxed),
+                       std::memory_order_relaxed);
+      metrics_ = std::move(other.metrics_);
+      recorder_ = std::move(other.recorder_);
       other.compiled_ = false;
     }
     return *this;
   }
 
   bool match(const std::string& text) {
-    if (!compiled_)
-      return false;
     MatchResult result;
-    return engine_->executeAt(text, 0, result);
+    return match(text, result);
   }
 
-  bool match(const std::string& text, MatchResult& result, size_t start = 0) {
-    if (!compiled_)
-      return false;
-    return engine_->executeAt(text, start, result);
+  // Match anchored at `start`. Only text[start, end) may be consumed, but anchors
+  // and other context checks still see the whole string, so windows over a large
+  // buffer can be scanned in place and all offsets stay relative to `text`.
+  bool match(const std::string& text, MatchResult& result, size_t start = 0,
+             size_t end = std::string::npos) {
+    if (recorder_)
+      recordCall(RecordedApi::MATCH, text, start, end);
+    if (metrics_)
+      return measured(text, start, end, [&] { return matchImpl(text, result, start, end); });
+    return matchImpl(text, result, start, end);
   }
 
-  bool search(const std::string& text, MatchResult& result, size_t start = 0) {
-    if (!compiled_)
-      return false;
-    return engine_->search(text, start, result);
+  // Find the first match inside text[start, end); see match() for window semantics
+  bool search(const std::string& text, MatchResult& result, size_t start = 0,
+              size_t end = std::string::npos) {
+    if (recorder_)
+      recordCall(RecordedApi::SEARCH, text, start, end);
+    if (metrics_)
+      return measured(text, start, end, [&] { return searchImpl(text, result, start, end); });
+    return searchImpl(text, result, start, end);
   }
 
-  std::vector<MatchResult> searchAll(const std::string& text) {
-    std::vector<MatchResult> results;
-    if (!compiled_)
-      return results;
+  // Budgeted variants for untrusted patterns or input. Instead of a bool they
+  // report why a call stopped, so running out of budget is not mistaken for
+  // "no match". A fallback keeps spending from the same budget. A
+  // maxBacktrackDepth lowered below VM_STACK_SIZE is a hard limit and reports
+  // STACK_EXHAUSTED instead of falling back.
+  MatchStatus match(const std::string& text, MatchResult& result, const MatchOptions& options,
+                    size_t start = 0, size_t end = std::string::npos) {
+    if (recorder_)
+      recordCall(RecordedApi::MATCH, text, start, end);
+    if (metrics_)
+      return measured(text, start, end,
+                      [&] { return matchImpl(text, result, options, start, end); });
+    return matchImpl(text, result, options, start, end);
+  }
 
-    size_t pos = 0;
-    const size_t textLen = text.length();
-    size_t prevMatchLen = 0;
+  MatchStatus search(const std::string& text, MatchResult& result, const MatchOptions& options,
+                     size_t start = 0, size_t end = std::string::npos) {
+    if (recorder_)
+      recordCall(RecordedApi::SEARCH, text, start, end);
+    if (metrics_)
+      return measured(text, start, end,
+                      [&] { return searchImpl(text, result, options, start, end); });
+    return searchImpl(text, result, options, start, end);
+  }
 
-    while (pos <= textLen) {
-      MatchResult result;
-      if (engine_->executeAt(text, pos, result)) {
-        size_t matchLen = result.length();
-        // Prevent infinite loop for zero-width matches
-        if (matchLen == 0 && matchLen == prevMatchLen && pos < textLen) {
-          pos++;  // Force advance to prevent loop
-          continue;
-        }
-        results.push_back(result);
-        pos = result.position + (result.length() > 0 ? result.length() : 1);
-        prevMatchLen = matchLen;
-      } else {
-        // No match found at this position, move to next
-        pos++;
-        prevMatchLen = 0;
-      }
-    }
-    return results;
+  std::vector<MatchResult> searchAll(const std::string& text, size_t start = 0,
+                                     size_t end = std::string::npos) {
+    if (recorder_)
+      recordCall(RecordedApi::SEARCH_ALL, text, start, end);
+    if (metrics_)
+      return measured(text, start, end, [&] { return searchAllImpl(text, start, end); });
+    return searchAllImpl(text, start, end);
   }
 
   std::string replace(const std::string& text, const std::string& replacement, bool all = true) {
@@ -1536,32 +4739,412 @@ class Regex {
   const std::string& pattern() const {
     return pattern_;
   }
+  CompileFlag flags() const {
+    return flags_;
+  }
   bool isCompiled() const {
     return compiled_;
   }
 
+  // Annotated program listing, see amaranth::disassemble(). Pass the
+  // profile collected through MatchOptions::profile to see where calls on
+  // this pattern spent their time.
+  std::string disassemble(const ProgramProfile* profile = nullptr) const {
+    if (!compiled_)
+      return std::string();
+    // Compile once more for the source map; listings are a tuning aid, so
+    // the Regex does not keep one around
+    ASTArena arena;
+    arena.reserve(pattern_.length());
+    Parser parser(pattern_, arena, parserOptions());
+    NodeId root = parser.parse();
+    Compiler compiler;
+    std::vector<Instruction> program = compiler.compile(arena, root, parser.numCaptures());
+    return amaranth::disassemble(program, compiler.sourceMap(), pattern_, profile);
+  }
+
+  // Engine selection. AUTO, the default, starts on the backtracker and moves
+  // the pattern to the linear engine for good the first time a call thrashes:
+  // more than FALLBACK_BACKTRACKS_PER_BYTE backtracks per input byte (and at
+  // least FALLBACK_MIN_BACKTRACKS), or a full backtrack stack. That call is
+  // rerun on the linear engine, and so is every later one. Setting AUTO again
+  // forgets the decision. BACKTRACKING never switches, but a bool call (or
+  // searchAll) that fills the backtrack stack is rerun on the linear engine
+  // so it cannot miss a match; the MatchStatus overloads report
+  // STACK_EXHAUSTED instead.
+  void setEngine(Engine engine) {
+    engineChoice_ = engine;
+    preferLinear_.store(false, std::memory_order_relaxed);
+  }
+  Engine engine() const {
+    return engineChoice_;
+  }
+  bool usesLinearEngine() const {
+    return engineChoice_ == Engine::LINEAR || preferLinear_.load(std::memory_order_relaxed);
+  }
+  // Calls that AUTO moved to the linear engine
+  uint64_t fallbackCount() const {
+    return fallbacks_.load(std::memory_order_relaxed);
+  }
+
+  // Latency metrics. Once enabled, every match, search and searchAll call
+  // records its duration, input size and outcome; see exportPrometheus() and
+  // exportJson(). Copies made afterwards record into the same PatternMetrics,
+  // so a pattern copied into several threads is still reported once.
+  // Disabling drops the counters. Each thread that runs the pattern gets its
+  // own shard of about 1 KB (see PatternMetrics), so 1,000 rules on 64
+  // threads take about 64 MB.
+  void enableMetrics(bool enabled = true) {
+    if (!enabled)
+      metrics_.reset();
+    else if (!metrics_)
+      metrics_ = std::make_shared<PatternMetrics>();
+  }
+  std::shared_ptr<PatternMetrics> metrics() const {
+    return metrics_;
+  }
+
+  // Workload recording. Once set, match, search and searchAll calls are
+  // sampled into `recorder`, as are those of copies made afterwards; null
+  // stops recording. Regexes constructed while recordAllTo() has a recorder
+  // start out recording into it, so a whole process can be captured without
+  // touching the code that builds its patterns.
+  void recordTo(std::shared_ptr<WorkloadRecorder> recorder) {
+    recorder_ = std::move(recorder);
+  }
+  std::shared_ptr<WorkloadRecorder> recorder() const {
+    return recorder_;
+  }
+  static void recordAllTo(std::shared_ptr<WorkloadRecorder> recorder) {
+    DefaultRecorder& d = defaultRecorderState();
+    std::lock_guard<std::mutex> lock(d.mutex);
+    d.set.store(recorder != nullptr, std::memory_order_relaxed);
+    d.recorder = std::move(recorder);
+  }
+
  private:
   std::string pattern_;
   CompileFlag flags_;
-  std::vector<Instruction> instructions_;
-  std::unique_ptr<VM> engine_;
   bool compiled_;
   int numCaptures_;
 
+  // Engines of one caller: the backtracker and, built on first use, the
+  // linear engine. They hold the per-call state (captures, stacks, thread
+  // lists), so concurrent calls each need their own; the program and its
+  // SearchPlan are shared by all of them.
+  struct Scratch {
+    VM backtracker;
+    std::unique_ptr<PikeVM> linearEngine;
+    const std::shared_ptr<const CompiledProgram>& program;
+    int slots;
+
+    Scratch(const std::shared_ptr<const CompiledProgram>& prog, int captureSlots)
+        : backtracker(prog, captureSlots), program(prog), slots(captureSlots) {}
+
+    PikeVM& linear() {
+      if (!linearEngine)
+        linearEngine = std::make_unique<PikeVM>(program, slots);
+      return *linearEngine;
+    }
+  };
+
+  // One Scratch per threadSlot(), made on the thread's first call, so
+  // threads sharing a Regex never contend. Threads without a slot borrow
+  // one from a locked free list. Holds the program the engines share, so
+  // moving the Regex leaves it in place; copies of the Regex share it too.
+  class ScratchPool {
+   public:
+    ScratchPool(std::shared_ptr<const CompiledProgram> program, int captureSlots)
+        : program_(std::move(program)), captureSlots_(captureSlots) {}
+
+    const std::shared_ptr<const CompiledProgram>& program() const {
+      return program_;
+    }
+
+    // Scratch of the calling thread for the duration of one call
+    class Lease {
+     public:
+      explicit Lease(ScratchPool& pool) : pool_(pool), slot_(threadSlot()) {
+        if (slot_ < THREAD_SLOTS) {
+          std::unique_ptr<Scratch>& owned = pool_.owned_[slot_];
+          if (!owned)
+            owned = std::make_unique<Scratch>(pool_.program_, pool_.captureSlots_);
+          scratch_ = owned.get();
+        } else {
+          std::lock_guard<std::mutex> lock(pool_.mutex_);
+          if (pool_.spare_.empty()) {
+            scratch_ = new Scratch(pool_.program_, pool_.captureSlots_);
+          } else {
+            scratch_ = pool_.spare_.back().release();
+            pool_.spare_.pop_back();
+          }
+        }
+      }
+      ~Lease() {
+        if (slot_ < THREAD_SLOTS)
+          return;
+        std::lock_guard<std::mutex> lock(pool_.mutex_);
+        pool_.spare_.emplace_back(scratch_);
+      }
+      Lease(const Lease&) = delete;
+      Lease& operator=(const Lease&) = delete;
+
+      Scratch* operator->() const {
+        return scratch_;
+      }
+
+     private:
+      ScratchPool& pool_;
+      size_t slot_;
+      Scratch* scratch_;
+    };
+
+   private:
+    std::shared_ptr<const CompiledProgram> program_;
+    int captureSlots_;
+    // A slot is only touched by the thread leasing it; the slot lease orders
+    // one owner's use before the next one's
+    std::array<std::unique_ptr<Scratch>, THREAD_SLOTS> owned_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Scratch>> spare_;
+  };
+
+  std::unique_ptr<ScratchPool> scratch_;
+  Engine engineChoice_ = Engine::AUTO;
+  std::atomic<bool> preferLinear_{false};
+  std::atomic<uint64_t> fallbacks_{0};
+  std::shared_ptr<PatternMetrics> metrics_;  // Shared with copies, null when disabled
+  std::shared_ptr<WorkloadRecorder> recorder_;  // Shared with copies, null when not recording
+
+  struct DefaultRecorder {
+    std::atomic<bool> set{false};  // Lets construction skip the lock when unset
+    std::mutex mutex;
+    std::shared_ptr<WorkloadRecorder> recorder;
+  };
+
+  static DefaultRecorder& defaultRecorderState() {
+    static DefaultRecorder state;
+    return state;
+  }
+
+  static std::shared_ptr<WorkloadRecorder> defaultRecorder() {
+    DefaultRecorder& d = defaultRecorderState();
+    if (!d.set.load(std::memory_order_relaxed))
+      return nullptr;
+    std::lock_guard<std::mutex> lock(d.mutex);
+    return d.recorder;
+  }
+
+  void recordCall(RecordedApi api, const std::string& text, size_t start, size_t end) {
+    recorder_->record(pattern_, static_cast<uint32_t>(flags_), api, text, start, end);
+  }
+
+  // Limit the backtracks of the call about to run on `vm`; only AUTO uses it
+  void armFallback(VM& vm, size_t length) const {
+    vm.setBacktrackLimit(engineChoice_ == Engine::AUTO
+                             ? FALLBACK_MIN_BACKTRACKS + FALLBACK_BACKTRACKS_PER_BYTE * length
+                             : UINT64_MAX);
+  }
+
+  // Whether a backtracker `status` means AUTO should rerun on the linear engine
+  bool fallBack(MatchStatus status, size_t depthLimit = VM_STACK_SIZE) {
+    if (engineChoice_ != Engine::AUTO)
+      return false;
+    if (status != MatchStatus::BACKTRACK_LIMIT &&
+        !(status == MatchStatus::STACK_EXHAUSTED && depthLimit >= VM_STACK_SIZE))
+      return false;
+    preferLinear_.store(true, std::memory_order_relaxed);
+    fallbacks_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Whether a bool call should rerun on the linear engine. A bool cannot say
+  // STACK_EXHAUSTED, so even on BACKTRACKING such a call is rerun rather than
+  // answered "no match"; the pattern itself stays on the backtracker.
+  bool rerunLinear(MatchStatus status) {
+    return fallBack(status) || status == MatchStatus::STACK_EXHAUSTED;
+  }
+
+  // Time one public call into metrics_. The sample covers the whole call,
+  // including a rerun on the linear engine.
+  template <typename Call>
+  auto measured(const std::string& text, size_t start, size_t end, Call call)
+      -> decltype(call()) {
+    auto began = std::chrono::steady_clock::now();
+    auto outcome = call();
+    auto elapsed = std::chrono::steady_clock::now() - began;
+    size_t limit = std::min(end, text.length());
+    metrics_->record(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                     start < limit ? limit - start : 0, found(outcome));
+    return outcome;
+  }
+
+  static bool found(bool matched) {
+    return matched;
+  }
+  static bool found(MatchStatus status) {
+    return status == MatchStatus::MATCHED;
+  }
+  static bool found(const std::vector<MatchResult>& results) {
+    return !results.empty();
+  }
+
+  bool matchImpl(const std::string& text, MatchResult& result, size_t start, size_t end) {
+    if (!compiled_ || !clampWindow(text, start, end))
+      return false;
+    ScratchPool::Lease scratch(*scratch_);
+    if (usesLinearEngine())
+      return scratch->linear().executeAt(text, start, end, result) == MatchStatus::MATCHED;
+    armFallback(scratch->backtracker, end - start);
+    MatchStatus status = scratch->backtracker.executeAt(text, start, end, result);
+    if (rerunLinear(status))
+      status = scratch->linear().executeAt(text, start, end, result);
+    return status == MatchStatus::MATCHED;
+  }
+
+  bool searchImpl(const std::string& text, MatchResult& result, size_t start, size_t end) {
+    if (!compiled_ || !clampWindow(text, start, end))
+      return false;
+    ScratchPool::Lease scratch(*scratch_);
+    if (usesLinearEngine())
+      return scratch->linear().search(text, start, end, result) == MatchStatus::MATCHED;
+    armFallback(scratch->backtracker, end - start);
+    MatchStatus status = scratch->backtracker.search(text, start, end, result);
+    if (rerunLinear(status))
+      status = scratch->linear().search(text, start, end, result);
+    return status == MatchStatus::MATCHED;
+  }
+
+  MatchStatus matchImpl(const std::string& text, MatchResult& result, const MatchOptions& options,
+                        size_t start, size_t end) {
+    if (!compiled_ || !clampWindow(text, start, end))
+      return MatchStatus::NO_MATCH;
+    ScratchPool::Lease scratch(*scratch_);
+    if (usesLinearEngine())
+      return scratch->linear().executeAt(text, start, end, result, options);
+    armFallback(scratch->backtracker, end - start);
+    MatchStatus status = scratch->backtracker.executeAt(text, start, end, result, options);
+    if (fallBack(status, options.maxBacktrackDepth)) {
+      if (options.stats)
+        ++options.stats->fallbacks;
+      status = scratch->linear().executeAt(text, start, end, result, options,
+                                           scratch->backtracker.steps());
+    }
+    return status;
+  }
+
+  MatchStatus searchImpl(const std::string& text, MatchResult& result,
+                         const MatchOptions& options, size_t start, size_t end) {
+    if (!compiled_ || !clampWindow(text, start, end))
+      return MatchStatus::NO_MATCH;
+    ScratchPool::Lease scratch(*scratch_);
+    if (usesLinearEngine())
+      return scratch->linear().search(text, start, end, result, options);
+    armFallback(scratch->backtracker, end - start);
+    MatchStatus status = scratch->backtracker.search(text, start, end, result, options);
+    if (fallBack(status, options.maxBacktrackDepth)) {
+      if (options.stats)
+        ++options.stats->fallbacks;
+      status = scratch->linear().search(text, start, end, result, options,
+                                        scratch->backtracker.steps());
+    }
+    return status;
+  }
+
+  std::vector<MatchResult> searchAllImpl(const std::string& text, size_t start, size_t end) {
+    std::vector<MatchResult> results;
+    if (!compiled_ || !clampWindow(text, start, end))
+      return results;
+    ScratchPool::Lease scratch(*scratch_);
+
+    size_t pos = start;
+    const size_t textLen = end;
+    size_t prevMatchLen = 0;
+
+    if (!usesLinearEngine()) {
+      // One backtrack allowance for the whole scan, so a pattern that is
+      // merely slow at every position is caught as well
+      armFallback(scratch->backtracker, end - start);
+      while (pos <= textLen) {
+        MatchResult result;
+        MatchStatus status =
+            scratch->backtracker.executeAt(text, pos, textLen, result, pos > start);
+        if (status == MatchStatus::MATCHED) {
+          size_t matchLen = result.length();
+          // Prevent infinite loop for zero-width matches
+          if (matchLen == 0 && matchLen == prevMatchLen && pos < textLen) {
+            pos++;  // Force advance to prevent loop
+            continue;
+          }
+          results.push_back(result);
+          pos = result.position + (result.length() > 0 ? result.length() : 1);
+          prevMatchLen = matchLen;
+        } else if (rerunLinear(status)) {
+          break;  // Finish from `pos` on the linear engine
+        } else {
+          // No match found at this position, move to next
+          pos++;
+          prevMatchLen = 0;
+        }
+      }
+    }
+
+    // Same results as the loop above, but each step is an unanchored search
+    // so the scan stays linear: the only start where a zero-width match
+    // counts before the end is right after a non-empty match. Lookaround
+    // results carry over from one step to the next.
+    bool sameText = false;
+    while (pos <= textLen) {
+      MatchResult result;
+      if (prevMatchLen > 0) {
+        if (scratch->linear().executeAt(text, pos, textLen, result, sameText) !=
+            MatchStatus::MATCHED) {
+          pos++;
+          prevMatchLen = 0;
+          sameText = true;
+          continue;
+        }
+      } else if (scratch->linear().search(text, pos, textLen, result, sameText) !=
+                 MatchStatus::MATCHED) {
+        break;
+      }
+      sameText = true;
+      results.push_back(result);
+      pos = result.position + (result.length() > 0 ? result.length() : 1);
+      prevMatchLen = result.length();
+    }
+    return results;
+  }
+
+  // Clamp `end` to the text and reject inverted windows
+  static bool clampWindow(const std::string& text, size_t start, size_t& end) {
+    if (end > text.length())
+      end = text.length();
+    return start <= end;
+  }
+
+  bool hasFlag(CompileFlag flag) const {
+    return (static_cast<int>(flags_) & static_cast<int>(flag)) != 0;
+  }
+
+  ParserOptions parserOptions() const {
+    return parserOptions(flags_);
+  }
+
   void compile() {
     try {
-      Lexer lexer(pattern_);
-      auto tokens = lexer.tokenize();
-
-      Parser parser(tokens);
-      auto ast = parser.parse();
+      // All AST nodes of this compile live in one arena, freed on return
+      ASTArena arena;
+      arena.reserve(pattern_.length());
+      Parser parser(pattern_, arena, parserOptions());
+      NodeId root = parser.parse();
 
       numCaptures_ = parser.numCaptures();
 
       Compiler compiler;
-      instructions_ = compiler.compile(ast, numCaptures_);
-
-      engine_ = std::make_unique<VM>(instructions_, numCaptures_ + 1);
+      scratch_ = std::make_unique<ScratchPool>(
+          std::make_shared<const CompiledProgram>(compiler.compile(arena, root, numCaptures_)),
+          numCaptures_ + 1);
       compiled_ = true;
     } catch (const RegexError& e) {
       compiled_ = false;
@@ -1610,6 +5193,148 @@ class Regex {
   }
 };
 
+// ============================================================================
+// Metrics Export
+// ============================================================================
+// Latency quantiles reported by both exporters
+constexpr double METRICS_QUANTILES[] = {0.5, 0.9, 0.99, 0.999};
+
+// What the exporters report for one pattern text and set of flags
+struct PatternMetricsEntry {
+  std::string pattern;
+  uint32_t flags = 0;
+  PatternMetricsSnapshot snapshot;
+};
+
+// One entry per pattern text and flags among the Regexes in `patterns` that
+// enabled metrics, in order of first appearance. Copies of a Regex share one
+// PatternMetrics, which is counted once; separate Regexes with the same text
+// and flags are summed, so no series is exported twice.
+inline std::vector<PatternMetricsEntry> collectMetrics(const std::vector<const Regex*>& patterns) {
+  std::vector<PatternMetricsEntry> entries;
+  std::unordered_set<const PatternMetrics*> seen;
+  std::unordered_map<std::string, size_t> index;  // By flags, then pattern text
+  for (const Regex* re : patterns) {
+    auto metrics = re ? re->metrics() : nullptr;
+    if (!metrics || !seen.insert(metrics.get()).second)
+      continue;
+    uint32_t flags = static_cast<uint32_t>(re->flags());
+    std::string key(reinterpret_cast<const char*>(&flags), sizeof(flags));
+    key += re->pattern();
+    PatternMetricsSnapshot snap = metrics->snapshot();
+    auto it = index.find(key);
+    if (it == index.end()) {
+      index.emplace(std::move(key), entries.size());
+      entries.push_back({re->pattern(), flags, std::move(snap)});
+      continue;
+    }
+    PatternMetricsSnapshot& total = entries[it->second].snapshot;
+    total.latency.merge(snap.latency);
+    total.matches += snap.matches;
+    total.bytes += snap.bytes;
+  }
+  return entries;
+}
+
+// Prometheus text exposition format of every pattern in `patterns` with
+// metrics enabled: call latency as a summary with quantiles, plus match and
+// input byte counters, each series labelled with the pattern text and its
+// Regex::CompileFlag bits. Serving it is up to the caller.
+inline std::string exportPrometheus(const std::vector<const Regex*>& patterns) {
+  auto label = [](const PatternMetricsEntry& entry) {
+    std::string out = "{pattern=\"";
+    for (char c : entry.pattern) {
+      if (c == '\\' || c == '"') {
+        out += '\\';
+        out += c;
+      } else if (c == '\n') {
+        out += "\\n";
+      } else {
+        out += c;
+      }
+    }
+    return out + "\",flags=\"" + std::to_string(entry.flags) + "\"";
+  };
+  char buf[64];
+  std::string latency =
+      "# HELP amaranth_call_duration_seconds Duration of match and search calls.\n"
+      "# TYPE amaranth_call_duration_seconds summary\n";
+  std::string matches =
+      "# HELP amaranth_matches_total Calls that found a match.\n"
+      "# TYPE amaranth_matches_total counter\n";
+  std::string bytes =
+      "# HELP amaranth_input_bytes_total Input bytes handed to match and search calls.\n"
+      "# TYPE amaranth_input_bytes_total counter\n";
+  for (const PatternMetricsEntry& entry : collectMetrics(patterns)) {
+    const PatternMetricsSnapshot& snap = entry.snapshot;
+    std::string labels = label(entry);
+    for (double q : METRICS_QUANTILES) {
+      std::snprintf(buf, sizeof(buf), ",quantile=\"%g\"} %.9g\n", q,
+                    snap.latency.percentile(q) * 1e-9);
+      latency += "amaranth_call_duration_seconds" + labels + buf;
+    }
+    std::snprintf(buf, sizeof(buf), "} %.9g\n", snap.latency.totalNanos * 1e-9);
+    latency += "amaranth_call_duration_seconds_sum" + labels + buf;
+    latency += "amaranth_call_duration_seconds_count" + labels + "} " +
+               std::to_string(snap.latency.count) + "\n";
+    matches += "amaranth_matches_total" + labels + "} " + std::to_string(snap.matches) + "\n";
+    bytes += "amaranth_input_bytes_total" + labels + "} " + std::to_string(snap.bytes) + "\n";
+  }
+  return latency + matches + bytes;
+}
+
+// The same data as a JSON array with one object per pattern; latencies are
+// in nanoseconds and throughput in input bytes per second. Patterns are byte
+// strings, so bytes outside ASCII are written as \u00XX escapes and the
+// output stays valid UTF-8.
+inline std::string exportJson(const std::vector<const Regex*>& patterns) {
+  auto quote = [](const std::string& text) {
+    std::string out = "\"";
+    for (char c : text) {
+      unsigned char uc = static_cast<unsigned char>(c);
+      if (c == '"' || c == '\\') {
+        out += '\\';
+        out += c;
+      } else if (uc < 0x20 || uc >= 0x80) {
+        char buf[8];
+        std::snprintf(buf, sizeof(buf), "\\u%04x", uc);
+        out += buf;
+      } else {
+        out += c;
+      }
+    }
+    return out + "\"";
+  };
+  char buf[64];
+  std::string out = "[";
+  bool first = true;
+  for (const PatternMetricsEntry& entry : collectMetrics(patterns)) {
+    const PatternMetricsSnapshot& snap = entry.snapshot;
+    const LatencyHistogram& h = snap.latency;
+    out += first ? "\n" : ",\n";
+    first = false;
+    out += "  {\"pattern\": " + quote(entry.pattern);
+    out += ", \"flags\": " + std::to_string(entry.flags);
+    out += ", \"calls\": " + std::to_string(h.count);
+    out += ", \"matches\": " + std::to_string(snap.matches);
+    out += ", \"bytes\": " + std::to_string(snap.bytes);
+    out += ", \"min_ns\": " + std::to_string(h.count ? h.minNanos : 0);
+    std::snprintf(buf, sizeof(buf), "%.1f", h.mean());
+    out += std::string(", \"mean_ns\": ") + buf;
+    for (double q : METRICS_QUANTILES) {
+      // p50, p90, p99, p999
+      std::snprintf(buf, sizeof(buf), "%g", q * 100);
+      std::string key = buf;
+      key.erase(std::remove(key.begin(), key.end(), '.'), key.end());
+      out += ", \"p" + key + "_ns\": " + std::to_string(h.percentile(q));
+    }
+    out += ", \"max_ns\": " + std::to_string(h.maxNanos);
+    std::snprintf(buf, sizeof(buf), "%.0f", snap.throughput());
+    out += std::string(", \"bytes_per_second\": ") + buf + "}";
+  }
+  return out + (first ? "]\n" : "\n]\n");
+}
+
 // ============================================================================
 // Factory functions
 // ============================================================================
@@ -1634,4 +5359,17 @@ inline std::string replace(const std::string& text, const std::string& pattern,
   return regex.replace(text, replacement, all);
 }
 
+// Static worst-case cost of a pattern as Regex compiles it with `flags`;
+// throws RegexError if it does not parse
+inline PatternAnalysis analyze(const std::string& pattern,
+                               Regex::CompileFlag flags = Regex::CompileFlag::DEFAULT) {
+  ASTArena arena;
+  arena.reserve(pattern.length());
+  Parser parser(pattern, arena, Regex::parserOptions(flags));
+  NodeId root = parser.parse();
+  Compiler compiler;
+  std::vector<Instruction> program = compiler.compile(arena, root, parser.numCaptures());
+  return PatternAnalyzer(arena, root).analyze(program);
+}
+
 }  // namespace amaranth
@@ -0,0 +1,81 @@
+#include "amaranth/amaranth.h"
+
+#define AMARANTH_COUNT_ALLOCATIONS 1
+#include "../benchmarks/alloc_count.h"
+
+#include <cassert>
+#include <iostream>
+#include <string>
+
+using namespace amaranth;
+
+// Allocations made by `call`, after one untimed call has built lazy state
+template <typename Fn>
+uint64_t allocationsOf(Fn call) {
+  call();
+  uint64_t before = bench::allocationCount().allocations;
+  call();
+  return bench::allocationCount().allocations - before;
+}
+
+void test_counting() {
+  std::cout << "Testing allocation counting... ";
+  static int* volatile sink;  // Keeps the compiler from eliding the pair
+  bench::AllocationCount before = bench::allocationCount();
+  sink = new int(7);
+  bench::AllocationCount after = bench::allocationCount();
+  delete sink;
+  assert(after.allocations == before.allocations + 1);
+  assert(after.bytes == before.bytes + sizeof(int));
+  (void)before;
+  (void)after;
+  std::cout << "PASS" << std::endl;
+}
+
+void test_failed_calls_do_not_allocate() {
+  std::cout << "Testing failed calls do not allocate... ";
+  const char* patterns[] = {"hello", R"((\d+)-(\d+))", "[aeiou]+x", "(a|b)*c"};
+  std::string text = "zzzz yyyy 12 wwww abab";
+  for (const char* pattern : patterns) {
+    Regex re(pattern);
+    MatchResult result;
+    re.setEngine(Engine::LINEAR);
+    assert(allocationsOf([&] { re.search(text, result); }) == 0);
+    assert(allocationsOf([&] { re.match(text, result); }) == 0);
+    // The backtracker copies captures per SPLIT, so only check matches that
+    // fail before the first one
+    re.setEngine(Engine::BACKTRACKING);
+    assert(allocationsOf([&] { re.match(text, result); }) == 0);
+  }
+  std::cout << "PASS" << std::endl;
+}
+
+void test_repeated_calls_are_stable() {
+  std::cout << "Testing repeated matches allocate the same each time... ";
+  const char* patterns[] = {R"((\d{4})-(\d{2})-(\d{2}))", R"(\w+)", "a|b|c"};
+  std::string text = "on 2024-01-15 a word";
+  for (const char* pattern : patterns) {
+    for (Engine engine : {Engine::BACKTRACKING, Engine::LINEAR}) {
+      Regex re(pattern);
+      re.setEngine(engine);
+      MatchResult result;
+      uint64_t first = allocationsOf([&] { re.search(text, result); });
+      uint64_t second = allocationsOf([&] { re.search(text, result); });
+      assert(first == second);
+      (void)first;
+      (void)second;
+    }
+  }
+  std::cout << "PASS" << std::endl;
+}
+
+int main() {
+  std::cout << "=== Amarantine Allocation Tests ===" << std::endl << std::endl;
+
+  test_counting();
+  test_failed_calls_do_not_allocate();
+  test_repeated_calls_are_stable();
+
+  std::cout << std::endl << "=== All Allocation Tests Passed! ===" << std::endl;
+  return 0;
+}
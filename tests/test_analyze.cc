@@ -0,0 +1,238 @@
+#include "amaranth/amaranth.h"
+
+#include <cassert>
+#include <iostream>
+
+using namespace amaranth;
+
+[[maybe_unused]] static bool has_finding(const PatternAnalysis& a, AnalysisFinding::Kind kind) {
+  for (const auto& f : a.findings) {
+    if (f.kind == kind)
+      return true;
+  }
+  return false;
+}
+
+void test_linear_patterns() {
+  std::cout << "Testing linear patterns... ";
+  for (const char* p : {R"(\d+\.\d+)", R"([a-z]+@[a-z]+\.com)", R"((\d+)-(\d+))",
+                        "(GET|POST|PUT)*x", "(a+)+", R"(^(\d+\.)+$)"}) {
+    PatternAnalysis a = analyze(p);
+    assert(a.complexity == Complexity::LINEAR);
+    assert(a.recommendedEngine == Engine::BACKTRACKING);
+    assert(a.attack.empty());
+    assert(a.findings.empty());
+    (void)a;
+  }
+  std::cout << "PASS" << std::endl;
+}
+
+void test_nested_quantifier() {
+  std::cout << "Testing nested quantifier... ";
+  PatternAnalysis a = analyze(R"(x(\w+\s?)+$)");
+  assert(a.complexity == Complexity::EXPONENTIAL);
+  assert(a.recommendedEngine == Engine::LINEAR);
+  assert(has_finding(a, AnalysisFinding::Kind::NESTED_QUANTIFIER));
+  assert(a.findings[0].position == 1);
+  assert(a.loopDepth == 2);
+
+  // The attack string really blows up the backtracker
+  Regex re(R"(x(\w+\s?)+$)");
+  re.setEngine(Engine::BACKTRACKING);
+  MatchResult result;
+  MatchOptions options;
+  options.maxSteps = 1000000;
+  assert(a.attack.prefix == "x");
+  assert(re.match(a.attack.str(), result, options) == MatchStatus::BUDGET_EXCEEDED);
+  assert(re.match(a.attack.build(4), result, options) == MatchStatus::NO_MATCH);
+  (void)a;
+  std::cout << "PASS" << std::endl;
+}
+
+void test_ambiguous_alternation() {
+  std::cout << "Testing ambiguous alternation... ";
+  PatternAnalysis a = analyze("(a|aa)*b");
+  assert(a.complexity == Complexity::EXPONENTIAL);
+  assert(has_finding(a, AnalysisFinding::Kind::AMBIGUOUS_ALTERNATION));
+  Regex re("(a|aa)*b");
+  re.setEngine(Engine::BACKTRACKING);
+  MatchResult result;
+  MatchOptions options;
+  options.maxSteps = 1000000;
+  assert(re.match(a.attack.str(), result, options) == MatchStatus::BUDGET_EXCEEDED);
+
+  // Alternatives that differ somewhere never share a path
+  assert(analyze("(ab|ac)*d").complexity == Complexity::LINEAR);
+  (void)a;
+  std::cout << "PASS" << std::endl;
+}
+
+void test_compile_flags() {
+  std::cout << "Testing analysis under compile flags... ";
+  // Only case folding makes the alternatives overlap
+  assert(analyze("(a|A)*b").complexity == Complexity::LINEAR);
+  PatternAnalysis a = analyze("(a|A)*b", Regex::CompileFlag::CASE_INSENSITIVE);
+  assert(a.complexity == Complexity::EXPONENTIAL);
+  assert(has_finding(a, AnalysisFinding::Kind::AMBIGUOUS_ALTERNATION));
+  Regex re("(a|A)*b", Regex::CompileFlag::CASE_INSENSITIVE);
+  re.setEngine(Engine::BACKTRACKING);
+  MatchResult result;
+  MatchOptions options;
+  options.maxSteps = 1000000;
+  assert(re.match(a.attack.str(), result, options) == MatchStatus::BUDGET_EXCEEDED);
+
+  // Only dot-all lets '.' consume the '\n' of the other alternative
+  assert(analyze("(.|\n)*x").complexity == Complexity::LINEAR);
+  assert(analyze("(.|\n)*x", Regex::CompileFlag::DOTALL).complexity == Complexity::EXPONENTIAL);
+  (void)a;
+  std::cout << "PASS" << std::endl;
+}
+
+void test_empty_loop() {
+  std::cout << "Testing empty loop... ";
+  PatternAnalysis a = analyze("(a*)*b");
+  assert(a.complexity == Complexity::EXPONENTIAL);
+  assert(has_finding(a, AnalysisFinding::Kind::EMPTY_LOOP));
+  (void)a;
+  std::cout << "PASS" << std::endl;
+}
+
+void test_polynomial() {
+  std::cout << "Testing polynomial degree... ";
+  PatternAnalysis a = analyze(R"(\d+\d+x)");
+  assert(a.complexity == Complexity::POLYNOMIAL);
+  assert(a.degree == 2);
+  assert(a.recommendedEngine == Engine::LINEAR);
+  assert(has_finding(a, AnalysisFinding::Kind::OVERLAPPING_QUANTIFIERS));
+
+  a = analyze("a.*b.*c.*d");
+  assert(a.complexity == Complexity::POLYNOMIAL);
+  assert(a.degree == 3);
+  assert(a.attack.prefix == "a");
+
+  // Counted repeats are unrolled
+  a = analyze("(.*a){20}");
+  assert(a.complexity == Complexity::POLYNOMIAL);
+  assert(a.degree == 20);
+
+  // A separator the first loop cannot consume breaks the chain
+  assert(analyze(R"(\d+-\d+x)").complexity == Complexity::LINEAR);
+  (void)a;
+  std::cout << "PASS" << std::endl;
+}
+
+void test_optional_run() {
+  std::cout << "Testing optional runs in counted repeats... ";
+  MatchResult result;
+  MatchOptions options;
+  options.maxSteps = 1000000;
+  // Every a? can take or leave a character, so (a?){n}a{n} has 2^n splits
+  for (int n : {16, 25, 40}) {
+    std::string pattern = "^(a?){" + std::to_string(n) + "}a{" + std::to_string(n) + "}$";
+    PatternAnalysis a = analyze(pattern);
+    assert(a.complexity == Complexity::EXPONENTIAL);
+    assert(a.recommendedEngine == Engine::LINEAR);
+    assert(has_finding(a, AnalysisFinding::Kind::OPTIONAL_RUN));
+    (void)a;
+  }
+  PatternAnalysis a = analyze("^(a?){25}a{25}$");
+  Regex re("^(a?){25}a{25}$");
+  re.setEngine(Engine::BACKTRACKING);
+  assert(re.match(a.attack.str(), result, options) == MatchStatus::BUDGET_EXCEEDED);
+
+  // Ambiguous alternations are choice points on every iteration too
+  for (int n : {16, 20, 40}) {
+    std::string count = "{" + std::to_string(n) + "}";
+    a = analyze("(a|aa)" + count + "c");
+    assert(a.complexity == Complexity::EXPONENTIAL);
+    assert(has_finding(a, AnalysisFinding::Kind::OPTIONAL_RUN));
+    // Reported like (a|ab)*: the alternatives share a prefix
+    a = analyze("(a|ab)" + count + "c");
+    assert(a.complexity == Complexity::EXPONENTIAL);
+    assert(has_finding(a, AnalysisFinding::Kind::OPTIONAL_RUN));
+  }
+  a = analyze("(a|aa){20}c");
+  Regex alt("(a|aa){20}c");
+  alt.setEngine(Engine::BACKTRACKING);
+  assert(alt.match(a.attack.str(), result, options) == MatchStatus::BUDGET_EXCEEDED);
+
+  // Short runs, optional copies that all skip to one place, and bodies that
+  // cannot match nothing stay linear
+  for (const char* p :
+       {"^(a?){4}a{4}$", "(a|ab){4}c", "a{0,25}b", "(ab?){20}c", R"(\d?\d?:\d\d)"}) {
+    assert(analyze(p).complexity == Complexity::LINEAR);
+    (void)p;
+  }
+  (void)a;
+  std::cout << "PASS" << std::endl;
+}
+
+void test_lookaround() {
+  std::cout << "Testing lookarounds... ";
+  // A lookahead body runs on the linear simulation and is never backtracked
+  // into, but it can still make the loops before it fail
+  PatternAnalysis a = analyze(R"((?=(a|aa){20}b)\w+)");
+  assert(a.complexity == Complexity::LINEAR && a.findings.empty());
+  a = analyze(R"(x(\w+\s?)+(?=!))");
+  assert(a.complexity == Complexity::EXPONENTIAL);
+  assert(has_finding(a, AnalysisFinding::Kind::NESTED_QUANTIFIER));
+
+  // A body with an unbounded repeat can read the rest of the text each time
+  // it is tested, and the attack makes it do so at every position
+  for (const char* p : {"(?=.*c)b", R"(\w(?=\w*!))", "(?!.*c)b", R"((?=(a|aa)*b)\w+)",
+                        "(?<=c.*)b", R"((?<=c\w*)b)", "(?<!c.*)b"}) {
+    a = analyze(p);
+    assert(a.complexity == Complexity::POLYNOMIAL && a.degree == 2);
+    assert(a.recommendedEngine == Engine::LINEAR);
+    assert(a.findings.size() == 1);
+    assert(has_finding(a, AnalysisFinding::Kind::LOOKAROUND_SCAN));
+  }
+  a = analyze("(?=.*c)b");
+  assert(a.attack.pump == "b");
+  Regex re("(?=.*c)b");
+  MatchResult result;
+  assert(!re.search(a.attack.str(), result));
+  a = analyze(R"(\w(?=\w*!))");
+  assert(!Regex(R"(\w(?=\w*!))").search(a.attack.str(), result));
+  a = analyze("(?!.*c)b");
+  assert(a.attack.suffix == "c" && !Regex("(?!.*c)b").search(a.attack.str(), result));
+  for (const char* p : {"(?<=c.*)b", R"((?<=c\w*)b)", "(?<!c.*)b"}) {
+    a = analyze(p);
+    assert(a.attack.pump == "b" && !Regex(p).search(a.attack.str(), result));
+  }
+  assert(analyze("(?<!c.*)b").attack.prefix == "c");
+  assert(analyze("(?=a{1,50}c)b").complexity == Complexity::LINEAR);
+  assert(analyze("(?<=ca{1,50})b").complexity == Complexity::LINEAR);
+  (void)a;
+  std::cout << "PASS" << std::endl;
+}
+
+void test_invalid_pattern() {
+  std::cout << "Testing invalid pattern... ";
+  bool threw = false;
+  try {
+    analyze("(a");
+  } catch (const RegexError&) {
+    threw = true;
+  }
+  assert(threw);
+  (void)threw;
+  std::cout << "PASS" << std::endl;
+}
+
+int main() {
+  std::cout << "=== Amarantine Analyzer Tests ===" << std::endl << std::endl;
+
+  test_linear_patterns();
+  test_nested_quantifier();
+  test_ambiguous_alternation();
+  test_compile_flags();
+  test_empty_loop();
+  test_polynomial();
+  test_optional_run();
+  test_lookaround();
+  test_invalid_pattern();
+
+  std::cout << std::endl << "=== All Analyzer Tests Passed! ===" << std::endl;
+  return 0;
+}
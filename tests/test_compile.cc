@@ -2,6 +2,7 @@
 
 #include <cassert>
 #include <iostream>
+#include <string>
 #include <vector>
 
 using namespace amaranth;
@@ -88,6 +89,172 @@ void test_multiple_patterns() {
   std::cout << "PASS" << std::endl;
 }
 
+void test_long_rule() {
+  std::cout << "Testing long rule compile... ";
+  // ~2,000 character alternation of keywords
+  std::string pattern;
+  for (int i = 0; i < 300; ++i) {
+    if (i > 0)
+      pattern += '|';
+    pattern += "key" + std::to_string(i) + "x";
+  }
+  Regex re(pattern);
+  assert(re.isCompiled());
+  MatchResult result;
+  assert(re.search("value=key299x;", result));
+  assert(result.matched_text == "key299x");
+  assert(result.position == 6);
+  assert(!re.search("key300x", result));
+  std::cout << "PASS" << std::endl;
+}
+
+void test_non_capturing_group() {
+  std::cout << "Testing non-capturing group... ";
+  Regex re("(?:ab)+(c)");
+  MatchResult result;
+  assert(re.match("ababc", result));
+  assert(result.matched_text == "ababc");
+  assert(result.group(1) == "c");
+  std::cout << "PASS" << std::endl;
+}
+
+void test_pattern_spaces() {
+  std::cout << "Testing spaces in patterns... ";
+  MatchResult result;
+  Regex spaced("a b");
+  assert(!spaced.match("ab"));
+  assert(spaced.search("ab a b", result) && result.position == 3);
+  assert(Regex("a\tb").match("a\tb"));
+  std::cout << "PASS" << std::endl;
+}
+
+void test_counted_repeat() {
+  std::cout << "Testing counted repeats... ";
+  MatchResult result;
+  Regex range(R"(\d{2,3})");
+  assert(range.search("a12345", result) && result.matched_text == "123");
+  assert(!range.search("a1b", result));
+  Regex atLeast("a{2,}");
+  assert(!atLeast.search("a", result));
+  assert(atLeast.search("baaaa", result) && result.matched_text == "aaaa");
+  assert(Regex("^x{0,2}$").match(""));
+  assert(!Regex("^x{0,2}$").match("xxx"));
+  try {
+    Regex reversed("a{3,2}");
+    assert(!"reversed range accepted");
+  } catch (const RegexError&) {
+  }
+  try {
+    Regex huge("(?:(?:a{1000}){1000}){1000}");
+    assert(!"oversized repeat accepted");
+  } catch (const RegexError& e) {
+    assert(std::string(e.what()) == "Pattern compiles too large");
+  }
+  // x+ loops over one copy of x, so nesting it does not double the program
+  std::string nested = "a";
+  for (int i = 0; i < 40; ++i)
+    nested = "(" + nested + ")+";
+  Regex deep(nested);
+  assert(deep.search("xaaa", result) && result.matched_text == "aaa");
+  assert(result.group(40) == "a");
+  assert(Regex("a+?").search("aaa", result) && result.matched_text == "a");
+  assert(Regex("^(ab){2,}$").match("ababab"));
+  assert(!Regex("^(ab){2,}$").match("ab"));
+  std::cout << "PASS" << std::endl;
+}
+
+void test_lazy_quantifier() {
+  std::cout << "Testing lazy quantifiers... ";
+  MatchResult result;
+  Regex lazy("<.+?>");
+  assert(lazy.search("<a><b>", result) && result.matched_text == "<a>");
+  Regex lazyRange("x{1,3}?y?");
+  assert(lazyRange.search("xxx", result) && result.matched_text == "x");
+  assert(Regex("a*?b").search("aab", result) && result.matched_text == "aab");
+  assert(Regex(R"((a??)a)").match("a", result) && result.group(1).empty());
+  std::cout << "PASS" << std::endl;
+}
+
+void test_class_shorthands() {
+  std::cout << "Testing shorthands inside classes... ";
+  MatchResult result;
+  assert(Regex(R"([\w.]+)").search("! x_y.2 ab", result) && result.matched_text == "x_y.2");
+  assert(Regex(R"([\D]+)").search("12ab34", result) && result.matched_text == "ab");
+  assert(Regex(R"([\W]+)").search("ab!?cd", result) && result.matched_text == "!?");
+  assert(Regex(R"([\S]+)").search("  xy z", result) && result.matched_text == "xy");
+  assert(!Regex(R"([^\w])").search("abc_9", result));
+  std::cout << "PASS" << std::endl;
+}
+
+void test_trailing_dash() {
+  std::cout << "Testing trailing '-' in a class... ";
+  MatchResult result;
+  Regex dash("[a-]+");
+  assert(dash.search("xa-a-y", result) && result.matched_text == "a-a-");
+  assert(!dash.search("b", result));
+  Regex classes(R"([\w-]+ [\D]+)");
+  assert(classes.search("! x-y_2 ab", result) && result.matched_text == "x-y_2 ab");
+  std::cout << "PASS" << std::endl;
+}
+
+void test_nested_groups() {
+  std::cout << "Testing nested group numbering... ";
+  Regex re(R"(((\w)\w*)@(\w+))");
+  MatchResult result;
+  assert(re.search("to: bob@example", result));
+  assert(result.captures.size() == 3);
+  assert(result.group(1) == "bob");
+  assert(result.group(2) == "b");
+  assert(result.group(3) == "example");
+
+  // An empty group keeps its position; one that did not take part is npos
+  Regex optional("(a*)b(c)?");
+  assert(optional.search("xb", result));
+  assert(result.captures.size() == 2);
+  assert(result.captures[0].start == 1 && result.captures[0].end == 1);
+  assert(result.captures[1].start == std::string::npos);
+  std::cout << "PASS" << std::endl;
+}
+
+void test_deep_nesting() {
+  std::cout << "Testing deep nesting... ";
+  auto nested = [](size_t depth) {
+    std::string pattern;
+    for (size_t i = 0; i < depth; ++i)
+      pattern += "(?:";
+    pattern += "a";
+    for (size_t i = 0; i < depth; ++i)
+      pattern += ")";
+    return pattern;
+  };
+  Regex re(nested(MAX_NESTING_DEPTH));
+  assert(re.match("a"));
+  // Far deeper than the native stack could take with recursive descent
+  for (size_t depth : {MAX_NESTING_DEPTH + 1, size_t(200000)}) {
+    try {
+      Regex too_deep(nested(depth));
+      assert(!"nesting limit not enforced");
+    } catch (const RegexError&) {
+    }
+  }
+  std::cout << "PASS" << std::endl;
+}
+
+void test_arena_reserve() {
+  std::cout << "Testing arena reservation bound... ";
+  // Alternations and groups add nodes that no single character accounts for
+  for (const char* p : {"a", "ab|cd", "a|b|c", "((a|b)(c|d))", "(?:(?:ab|cd)|ef)+?", "(a)(b)(c)",
+                        "(?=a|b)(?<!c|d)e", R"(\d+\.\d*|x{2,3})"}) {
+    std::string pattern = p;
+    ASTArena arena;
+    arena.reserve(pattern.length());
+    Parser parser(pattern, arena);
+    parser.parse();
+    assert(arena.size() <= 2 * pattern.length() + 2);
+  }
+  std::cout << "PASS" << std::endl;
+}
+
 int main() {
   std::cout << "=== Amarantine Compile Tests ===" << std::endl << std::endl;
 
@@ -100,6 +267,16 @@ int main() {
   test_move_assign();
   test_compile_error();
   test_multiple_patterns();
+  test_long_rule();
+  test_non_capturing_group();
+  test_pattern_spaces();
+  test_counted_repeat();
+  test_lazy_quantifier();
+  test_class_shorthands();
+  test_trailing_dash();
+  test_nested_groups();
+  test_deep_nesting();
+  test_arena_reserve();
 
   std::cout << std::endl << "=== All Compile Tests Passed! ===" << std::endl;
   return 0;
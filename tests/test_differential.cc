@@ -0,0 +1,539 @@
+// Differential test: generated patterns and inputs run through every engine
+//
+// A seeded generator builds patterns from the supported syntax (literals,
+// classes and their shorthands, groups, alternation, greedy and lazy
+// quantifiers, anchors, word boundaries, lookaheads and lookbehinds), some of
+// them with the case-insensitive, multiline or dot-all mode, together with
+// multi-line inputs over the same small alphabet, so most patterns match
+// somewhere. Each pattern is searched in every input by each engine
+// available in the build:
+//   amarantine-bt      - the backtracking VM
+//   amarantine-linear  - the linear engine
+//   amarantine         - AUTO
+//   std                - std::regex, ECMAScript grammar
+//   re2, pcre2         - when built with HAVE_RE2 / HAVE_PCRE2
+// std::regex has no dot-all mode or lookbehind, RE2 no lookaround at all, and
+// PCRE2 before 10.43 no variable-length lookbehind; each skips the patterns it
+// cannot express, and std also those it gets wrong (see
+// Pattern::edgeInLookahead). All engines must report the same match span;
+// the Amarantine engines must also agree on every group. The time each engine
+// spent searching is printed relative to the backtracker, so an optimization
+// that is enabled by default shows up here both as a correctness and as a
+// speed change.
+//
+// Usage: test_differential [--seed=N] [--patterns=N]
+#include "amaranth/amaranth.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+#ifdef HAVE_RE2
+#include <re2/re2.h>
+#endif
+
+#ifdef HAVE_PCRE2
+#define PCRE2_CODE_UNIT_WIDTH 8
+#include <pcre2.h>
+#endif
+
+using namespace amaranth;
+
+struct Pattern {
+  std::string text;
+  bool ignoreCase = false;
+  bool multiline = false;
+  bool dotAll = false;
+  bool inlineFlags = false;  // Amarantine gets "(?ims)" in front instead of flags
+  bool lookahead = false;    // Contains (?=...) or (?!...)
+  bool lookbehind = false;   // Contains (?<=...) or (?<!...)
+  // Has ^, \b or \B inside a lookahead, which libstdc++ evaluates as if the
+  // text began where the lookahead does
+  bool edgeInLookahead = false;
+
+  // The modes as an inline modifier group, or "" when none is set
+  std::string modifiers() const {
+    std::string m = std::string(ignoreCase ? "i" : "") + (multiline ? "m" : "") +
+                    (dotAll ? "s" : "");
+    return m.empty() ? m : "(?" + m + ")";
+  }
+};
+
+static const size_t INPUTS_PER_PATTERN = 24;
+static const size_t MAX_INPUT = 32;
+// Backtracking steps per search before a pattern counts as explosive. Such
+// patterns skip the backtracker and std::regex, which would backtrack the same way
+static const uint64_t PROBE_STEPS = 200000;
+static const size_t MAX_REPORTED = 10;  // Of each kind of failure
+
+// ============================================================================
+// Generator
+// ============================================================================
+class Generator {
+ public:
+  explicit Generator(uint32_t seed) : rng_(seed) {}
+
+  // Never matches the empty string: search() skips zero-width matches
+  // before the end of the text, which the other libraries report
+  Pattern pattern() {
+    bool nullable;
+    Pattern p;
+    do {
+      lookahead_ = lookbehind_ = edgeInLookahead_ = false;
+      p.text = alternation(0, nullable);
+    } while (nullable);
+    p.lookahead = lookahead_;
+    p.lookbehind = lookbehind_;
+    p.edgeInLookahead = edgeInLookahead_;
+    if (chance(10))
+      p.text = "^" + p.text;
+    else if (chance(10))
+      p.text = "\\b" + p.text;  // Filtered by the search plan
+    if (chance(10))
+      p.text += "$";
+    p.ignoreCase = chance(20);
+    p.multiline = chance(20);
+    p.dotAll = chance(20);
+    p.inlineFlags = chance(50);
+    return p;
+  }
+
+  std::string input() {
+    static const char ALPHABET[] = "aabbcc01_- .ABC\n";
+    std::string s(pick(MAX_INPUT + 1), ' ');
+    for (char& c : s)
+      c = ALPHABET[pick(sizeof(ALPHABET) - 1)];
+    return s;
+  }
+
+ private:
+  std::mt19937 rng_;
+  bool lookahead_ = false;   // The pattern being built has a lookahead
+  bool lookbehind_ = false;  // ... or a lookbehind
+  bool edgeInLookahead_ = false;
+  int lookaheadDepth_ = 0;
+
+  size_t pick(size_t n) {
+    return std::uniform_int_distribution<size_t>(0, n - 1)(rng_);
+  }
+
+  bool chance(int percent) {
+    return static_cast<int>(pick(100)) < percent;
+  }
+
+  // `nullable` tells whether the result can match the empty string; only
+  // non-nullable bodies get an unbounded quantifier
+  std::string alternation(int depth, bool& nullable) {
+    size_t count = chance(25) ? 2 + pick(2) : 1;
+    std::string s;
+    nullable = false;
+    for (size_t i = 0; i < count; ++i) {
+      bool n;
+      s += (i ? "|" : "") + concatenation(depth, n);
+      nullable = nullable || n;
+    }
+    return s;
+  }
+
+  std::string concatenation(int depth, bool& nullable) {
+    size_t count = 1 + pick(4);
+    std::string s;
+    nullable = true;
+    for (size_t i = 0; i < count; ++i) {
+      bool n;
+      s += quantified(depth, n);
+      nullable = nullable && n;
+      // Assertions go between items, as a quantified one is an error in std
+      if (chance(8)) {
+        static const char* const ASSERTIONS[] = {"^", "$", "\\b", "\\B"};
+        size_t k = pick(4);
+        s += ASSERTIONS[k];
+        edgeInLookahead_ = edgeInLookahead_ || (lookaheadDepth_ > 0 && k != 1);
+      }
+    }
+    return s;
+  }
+
+  std::string quantified(int depth, bool& nullable) {
+    std::string s = atom(depth, nullable);
+    // std rejects a quantifier right after a lookahead; (?:(?=a)){2} is fine
+    if (!chance(40) || s.compare(0, 3, "(?=") == 0 || s.compare(0, 3, "(?!") == 0 ||
+        s.compare(0, 3, "(?<") == 0)
+      return s;
+    static const char* const BOUNDED[] = {"?", "{2}", "{0,2}", "{1,3}"};
+    static const char* const UNBOUNDED[] = {"*", "+", "{2,}"};
+    if (nullable || chance(40)) {
+      size_t k = pick(std::size(BOUNDED));
+      s += BOUNDED[k];
+      nullable = nullable || k == 0 || k == 2;
+    } else {
+      size_t k = pick(std::size(UNBOUNDED));
+      s += UNBOUNDED[k];
+      nullable = k == 0;
+    }
+    if (chance(25))
+      s += "?";  // Lazy
+    return s;
+  }
+
+  std::string atom(int depth, bool& nullable) {
+    static const char* const LEAVES[] = {
+        "a",     "b",     "c",    "0",     "1",    "_",      "A",      "B",      " ",
+        R"(\.)", R"(\-)", ".",    R"(\d)", R"(\w)", R"(\s)", R"(\D)", R"(\W)",
+        R"(\S)", "[abc]", "[^a]", "[a-c0]", "[\\d_]", "[a-]", "[-b]", "[^\\w ]",
+        "[\\S]", "[.]",   "[B-C]", "ab",   "ba"};
+    nullable = false;
+    if (depth < 3 && chance(20)) {
+      std::string body = alternation(depth + 1, nullable);
+      return (chance(50) ? "(" : "(?:") + body + ")";
+    }
+    if (depth < 3 && chance(5)) {
+      ++lookaheadDepth_;
+      std::string body = alternation(depth + 1, nullable);
+      --lookaheadDepth_;
+      nullable = true;
+      static const char* const OPENERS[] = {"(?=", "(?!", "(?<=", "(?<!"};
+      size_t k = pick(std::size(OPENERS));
+      (k < 2 ? lookahead_ : lookbehind_) = true;
+      return OPENERS[k] + body + ")";
+    }
+    return LEAVES[pick(std::size(LEAVES))];
+  }
+};
+
+// ============================================================================
+// Engines
+// ============================================================================
+struct Span {
+  bool matched = false;
+  size_t position = 0;
+  size_t length = 0;
+  std::vector<std::pair<size_t, size_t>> groups;  // Amarantine engines only
+
+  bool operator==(const Span& other) const {
+    return matched == other.matched &&
+           (!matched || (position == other.position && length == other.length));
+  }
+};
+
+// One engine under test. compile() returns false when the engine rejects the
+// pattern; search() runs the last compiled pattern over one input
+struct Contender {
+  const char* name;
+  std::function<bool(const Pattern& pattern)> compile;
+  std::function<Span(const std::string& text)> search;
+  double ns = 0;
+  size_t searches = 0;
+  bool groups = false;     // Reports group spans
+  bool lookahead = true;   // Supports (?=...) and (?!...)
+  bool lookbehind = true;  // Supports (?<=...) and (?<!...) of any length
+};
+
+static Span fromResult(bool matched, const MatchResult& r) {
+  Span s;
+  s.matched = matched;
+  if (matched) {
+    s.position = r.position;
+    s.length = r.length();
+    for (const auto& c : r.captures)
+      s.groups.push_back({c.start, c.end});
+  }
+  return s;
+}
+
+// Null when the pattern does not compile
+static std::unique_ptr<Regex> compileRegex(const Pattern& pattern) {
+  using Flag = Regex::CompileFlag;
+  try {
+    if (pattern.inlineFlags)
+      return std::make_unique<Regex>(pattern.modifiers() + pattern.text);
+    Flag flags = Flag::DEFAULT;
+    if (pattern.ignoreCase)
+      flags = flags | Flag::CASE_INSENSITIVE;
+    if (pattern.multiline)
+      flags = flags | Flag::MULTILINE;
+    if (pattern.dotAll)
+      flags = flags | Flag::DOTALL;
+    return std::make_unique<Regex>(pattern.text, flags);
+  } catch (const RegexError&) {
+    return nullptr;
+  }
+}
+
+static Contender amarantine(const char* name, amaranth::Engine engine) {
+  auto re = std::make_shared<std::unique_ptr<Regex>>();
+  auto result = std::make_shared<MatchResult>();
+  Contender e;
+  e.name = name;
+  e.groups = true;
+  e.compile = [re, engine](const Pattern& pattern) {
+    *re = compileRegex(pattern);
+    if (*re)
+      (*re)->setEngine(engine);
+    return *re != nullptr;
+  };
+  e.search = [re, result](const std::string& text) {
+    return fromResult((*re)->search(text, *result), *result);
+  };
+  return e;
+}
+
+static Contender stdRegex() {
+  auto re = std::make_shared<std::regex>();
+  Contender e;
+  e.lookbehind = false;
+  e.name = "std";
+  e.compile = [re](const Pattern& pattern) {
+    auto flags = std::regex::ECMAScript;
+    if (pattern.ignoreCase)
+      flags |= std::regex::icase;
+    if (pattern.multiline)
+      flags |= std::regex::multiline;
+    try {
+      *re = std::regex(pattern.text, flags);
+      return true;
+    } catch (const std::regex_error&) {
+      return false;
+    }
+  };
+  e.search = [re](const std::string& text) {
+    std::smatch m;
+    Span s;
+    s.matched = std::regex_search(text, m, *re);
+    if (s.matched) {
+      s.position = static_cast<size_t>(m.position(0));
+      s.length = static_cast<size_t>(m.length(0));
+    }
+    return s;
+  };
+  return e;
+}
+
+#ifdef HAVE_RE2
+static Contender re2Engine() {
+  auto re = std::make_shared<std::unique_ptr<RE2>>();
+  Contender e;
+  e.name = "re2";
+  e.lookahead = false;
+  e.lookbehind = false;
+  e.compile = [re](const Pattern& pattern) {
+    re->reset(new RE2(pattern.modifiers() + pattern.text, RE2::Quiet));
+    return (*re)->ok();
+  };
+  e.search = [re](const std::string& text) {
+    re2::StringPiece input(text), match;
+    Span s;
+    s.matched = (*re)->Match(input, 0, text.size(), RE2::UNANCHORED, &match, 1);
+    if (s.matched) {
+      s.position = static_cast<size_t>(match.data() - text.data());
+      s.length = match.size();
+    }
+    return s;
+  };
+  return e;
+}
+#endif
+
+#ifdef HAVE_PCRE2
+static Contender pcre2Engine() {
+  auto code = std::make_shared<std::shared_ptr<pcre2_code>>();
+  auto data = std::make_shared<std::shared_ptr<pcre2_match_data>>();
+  Contender e;
+  e.name = "pcre2";
+#if PCRE2_MAJOR == 10 && PCRE2_MINOR < 43
+  e.lookbehind = false;  // Fixed-length bodies only
+#endif
+  e.compile = [code, data](const Pattern& pattern) {
+    int errorcode;
+    PCRE2_SIZE erroroffset;
+    // Without DOLLAR_ENDONLY, '$' would also match before a final '\n'
+    uint32_t options = PCRE2_DOLLAR_ENDONLY;
+    if (pattern.ignoreCase)
+      options |= PCRE2_CASELESS;
+    if (pattern.multiline)
+      options |= PCRE2_MULTILINE;
+    if (pattern.dotAll)
+      options |= PCRE2_DOTALL;
+    pcre2_code* c = pcre2_compile(reinterpret_cast<PCRE2_SPTR>(pattern.text.c_str()),
+                                  pattern.text.size(), options, &errorcode, &erroroffset, NULL);
+    if (!c)
+      return false;
+    code->reset(c, pcre2_code_free);
+    data->reset(pcre2_match_data_create_from_pattern(c, NULL), pcre2_match_data_free);
+    return true;
+  };
+  e.search = [code, data](const std::string& text) {
+    Span s;
+    int rc = pcre2_match(code->get(), reinterpret_cast<PCRE2_SPTR>(text.c_str()), text.size(), 0,
+                         0, data->get(), NULL);
+    s.matched = rc >= 0;
+    if (s.matched) {
+      PCRE2_SIZE* ovector = pcre2_get_ovector_pointer(data->get());
+      s.position = ovector[0];
+      s.length = ovector[1] - ovector[0];
+    }
+    return s;
+  };
+  return e;
+}
+#endif
+
+// ============================================================================
+// Driver
+// ============================================================================
+static std::string describe(const Pattern& p) {
+  return "/" + p.text + "/" + std::string(p.ignoreCase ? "i" : "") + (p.multiline ? "m" : "") +
+         (p.dotAll ? "s" : "");
+}
+
+static std::string describe(const Span& s) {
+  if (!s.matched)
+    return "no match";
+  std::string d = "[" + std::to_string(s.position) + ", " +
+                  std::to_string(s.position + s.length) + ")";
+  for (const auto& g : s.groups) {
+    d += g.first == std::string::npos
+             ? " -"
+             : " (" + std::to_string(g.first) + "," + std::to_string(g.second) + ")";
+  }
+  return d;
+}
+
+// Whether the backtracker gets through every input within PROBE_STEPS
+static bool tame(const Pattern& pattern, const std::vector<std::string>& inputs) {
+  std::unique_ptr<Regex> re = compileRegex(pattern);
+  if (!re)
+    return false;  // Reported as a rejection by the other engines
+  re->setEngine(amaranth::Engine::BACKTRACKING);
+  MatchOptions options;
+  options.maxSteps = PROBE_STEPS;
+  MatchResult result;
+  for (const std::string& text : inputs) {
+    MatchStatus status = re->search(text, result, options);
+    if (status != MatchStatus::MATCHED && status != MatchStatus::NO_MATCH)
+      return false;
+  }
+  return true;
+}
+
+int main(int argc, char* argv[]) {
+  uint32_t seed = 20240611;
+  size_t patterns = 3000;
+  for (int i = 1; i < argc; ++i) {
+    if (std::strncmp(argv[i], "--seed=", 7) == 0) {
+      seed = static_cast<uint32_t>(std::strtoul(argv[i] + 7, nullptr, 10));
+    } else if (std::strncmp(argv[i], "--patterns=", 11) == 0) {
+      patterns = std::strtoull(argv[i] + 11, nullptr, 10);
+    } else {
+      std::cerr << "usage: " << argv[0] << " [--seed=N] [--patterns=N]\n";
+      return 2;
+    }
+  }
+
+  std::cout << "=== Amarantine Differential Tests ===" << std::endl << std::endl;
+  std::cout << "Seed " << seed << ", " << patterns << " patterns x " << INPUTS_PER_PATTERN
+            << " inputs" << std::endl;
+
+  std::vector<Contender> engines = {
+      amarantine("amarantine-bt", amaranth::Engine::BACKTRACKING),
+      amarantine("amarantine-linear", amaranth::Engine::LINEAR),
+      amarantine("amarantine", amaranth::Engine::AUTO),
+      stdRegex(),
+  };
+#ifdef HAVE_RE2
+  engines.push_back(re2Engine());
+#endif
+#ifdef HAVE_PCRE2
+  engines.push_back(pcre2Engine());
+#endif
+  const size_t BACKTRACKER = 0;
+  const size_t STD = 3;
+
+  Generator gen(seed);
+  size_t explosive = 0, rejected = 0, compared = 0, matched = 0;
+  size_t mismatches = 0;
+  std::vector<std::string> inputs(INPUTS_PER_PATTERN);
+  std::vector<std::vector<Span>> spans(engines.size(), std::vector<Span>(INPUTS_PER_PATTERN));
+  for (size_t n = 0; n < patterns; ++n) {
+    Pattern pattern = gen.pattern();
+    for (std::string& text : inputs)
+      text = gen.input();
+    bool isTame = tame(pattern, inputs);
+    explosive += !isTame;
+
+    std::vector<bool> ran(engines.size(), false);
+    for (size_t e = 0; e < engines.size(); ++e) {
+      if (!isTame && (e == BACKTRACKER || e == STD))
+        continue;
+      if (((pattern.dotAll || pattern.edgeInLookahead) && e == STD) ||
+          (pattern.lookahead && !engines[e].lookahead) ||
+          (pattern.lookbehind && !engines[e].lookbehind))
+        continue;
+      // Every generated pattern is valid, so a rejection is a failure too
+      if (!engines[e].compile(pattern)) {
+        if (++rejected <= MAX_REPORTED)
+          std::cout << "  " << engines[e].name << " rejects " << describe(pattern) << std::endl;
+        continue;
+      }
+      ran[e] = true;
+      auto start = std::chrono::steady_clock::now();
+      for (size_t i = 0; i < inputs.size(); ++i)
+        spans[e][i] = engines[e].search(inputs[i]);
+      engines[e].ns +=
+          std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start)
+              .count();
+      engines[e].searches += inputs.size();
+    }
+
+    // The linear engine runs every pattern, so it is the reference
+    const size_t reference = 1;
+    if (!ran[reference])
+      continue;
+    for (size_t i = 0; i < inputs.size(); ++i) {
+      const Span& expected = spans[reference][i];
+      ++compared;
+      matched += expected.matched;
+      for (size_t e = 0; e < engines.size(); ++e) {
+        if (!ran[e] || e == reference)
+          continue;
+        const Span& got = spans[e][i];
+        bool same = got == expected && (!engines[e].groups || got.groups == expected.groups);
+        if (same)
+          continue;
+        if (++mismatches <= MAX_REPORTED) {
+          std::cout << "  MISMATCH " << describe(pattern) << " on \"" << inputs[i] << "\": "
+                    << engines[e].name << " " << describe(got) << ", "
+                    << engines[reference].name << " " << describe(expected) << std::endl;
+        }
+      }
+    }
+  }
+
+  std::cout << compared << " searches compared (" << matched << " matched), " << explosive
+            << " explosive patterns, " << rejected << " rejections" << std::endl
+            << std::endl;
+  std::printf("%-20s %12s %12s %10s\n", "engine", "searches", "ns/search", "vs bt");
+  double base = engines[BACKTRACKER].searches
+                    ? engines[BACKTRACKER].ns / engines[BACKTRACKER].searches
+                    : 0;
+  for (const Contender& e : engines) {
+    double per = e.searches ? e.ns / e.searches : 0;
+    std::printf("%-20s %12zu %12.1f %9.2fx\n", e.name, e.searches, per, base > 0 ? per / base : 0);
+  }
+  std::cout << std::endl;
+
+  if (mismatches || rejected) {
+    std::cout << mismatches << " mismatches, " << rejected << " rejections" << std::endl;
+    return 1;
+  }
+  std::cout << "=== All Differential Tests Passed! ===" << std::endl;
+  return 0;
+}
@@ -0,0 +1,168 @@
+#include "amaranth/amaranth.h"
+
+#include <cassert>
+#include <iostream>
+
+using namespace amaranth;
+
+[[maybe_unused]] static bool same_result(const MatchResult& a, const MatchResult& b) {
+  if (a.matched != b.matched || a.position != b.position || a.matched_text != b.matched_text ||
+      a.captures.size() != b.captures.size())
+    return false;
+  for (size_t i = 0; i < a.captures.size(); ++i) {
+    if (a.captures[i].start != b.captures[i].start || a.captures[i].end != b.captures[i].end)
+      return false;
+  }
+  return true;
+}
+
+void test_engines_agree() {
+  std::cout << "Testing backtracking and linear engines agree... ";
+  struct Case {
+    const char* pattern;
+    const char* text;
+  };
+  const Case cases[] = {
+      {R"((\d+)-(\d+))", "id 123-456 and 7-8"},
+      {"(a|ab)(c|bcd)(d*)", "abcd"},
+      {"a*", "baaab"},
+      {"(a*)b", "xaab ab b"},
+      {R"(\w+@\w+\.com)", "mail bob@example.com now"},
+      {"^abc", "abcabc"},
+      {"c$", "abcabc"},
+      {"(?:x|y)+z", "xyxyz xz"},
+      {"[^a-c]+", "abcdefabc"},
+      {R"(\s*(\w+)\s*=\s*(\w+))", "  key = value ; k2=v2"},
+      {"a?b?", "ab ba"},
+      {R"(\D)", "12a"},
+  };
+  for (const auto& c : cases) {
+    Regex backtracking(c.pattern);
+    backtracking.setEngine(Engine::BACKTRACKING);
+    Regex linear(c.pattern);
+    linear.setEngine(Engine::LINEAR);
+    std::string text = c.text;
+
+    for (size_t start = 0; start <= text.size(); ++start) {
+      MatchResult r1, r2;
+      bool m1 = backtracking.match(text, r1, start);
+      bool m2 = linear.match(text, r2, start);
+      assert(m1 == m2 && (!m1 || same_result(r1, r2)));
+      m1 = backtracking.search(text, r1, start);
+      m2 = linear.search(text, r2, start);
+      assert(m1 == m2 && (!m1 || same_result(r1, r2)));
+      (void)m1;
+      (void)m2;
+    }
+    auto all1 = backtracking.searchAll(text);
+    auto all2 = linear.searchAll(text);
+    assert(all1.size() == all2.size());
+    for (size_t i = 0; i < all1.size(); ++i) {
+      assert(same_result(all1[i], all2[i]));
+    }
+  }
+  std::cout << "PASS" << std::endl;
+}
+
+void test_adaptive_fallback() {
+  std::cout << "Testing adaptive fallback... ";
+  Regex re("(a+)+$");
+  assert(re.engine() == Engine::AUTO);
+  assert(!re.usesLinearEngine());
+  assert(re.match("aaaa"));
+  assert(re.fallbackCount() == 0);
+
+  // Would take about 2^40 steps on the backtracker
+  std::string evil = std::string(40, 'a') + "!";
+  MatchResult result;
+  assert(!re.search(evil, result));
+  assert(re.fallbackCount() == 1);
+  assert(re.usesLinearEngine());
+
+  // The decision sticks: later calls go straight to the linear engine
+  assert(!re.match(evil));
+  assert(re.search(std::string(40, 'a'), result));
+  assert(result.position == 0 && result.length() == 40);
+  assert(re.fallbackCount() == 1);
+
+  // Setting AUTO again forgets it
+  re.setEngine(Engine::AUTO);
+  assert(!re.usesLinearEngine());
+  assert(re.searchAll(evil).empty());
+  assert(re.fallbackCount() == 2);
+  std::cout << "PASS" << std::endl;
+}
+
+void test_fallback_on_stack_exhaustion() {
+  std::cout << "Testing fallback on a full backtrack stack... ";
+  Regex re(R"(\d+)");
+  std::string many_digits(VM_STACK_SIZE + 10, '7');
+  MatchResult result;
+  assert(re.match(many_digits, result));
+  assert(result.length() == many_digits.size());
+  assert(re.fallbackCount() == 1);
+
+  // A pinned backtracker reruns that one bool call instead of missing the
+  // match, and stays pinned
+  Regex pinned("a*b|a+");
+  pinned.setEngine(Engine::BACKTRACKING);
+  std::string many_as(VM_STACK_SIZE + 10, 'a');
+  assert(pinned.search(many_as, result));
+  assert(pinned.match(many_as, result));
+  assert(result.length() == many_as.size());
+  assert(pinned.searchAll(many_as).size() == 1);
+  assert(pinned.fallbackCount() == 0);
+  assert(!pinned.usesLinearEngine());
+  assert(pinned.search(many_as, result, MatchOptions()) == MatchStatus::STACK_EXHAUSTED);
+  std::cout << "PASS" << std::endl;
+}
+
+void test_fallback_keeps_budget() {
+  std::cout << "Testing fallback under a step budget... ";
+  Regex re("(a+)+$");
+  std::string evil = std::string(30, 'a') + "!";
+  MatchOptions options;
+  options.maxSteps = 10000000;
+  MatchResult result;
+  assert(re.search(evil, result, options) == MatchStatus::NO_MATCH);
+  assert(re.fallbackCount() == 1);
+
+  // The linear engine honors the same limits
+  options.maxSteps = 50;
+  assert(re.search(evil, result, options) == MatchStatus::BUDGET_EXCEEDED);
+
+  // A lowered stack limit is a hard limit, not a reason to fall back
+  Regex digits(R"(\d+)");
+  MatchOptions shallow;
+  shallow.maxBacktrackDepth = 10;
+  assert(digits.match(std::string(100, '7'), result, shallow) == MatchStatus::STACK_EXHAUSTED);
+  assert(digits.fallbackCount() == 0);
+  std::cout << "PASS" << std::endl;
+}
+
+void test_copy_keeps_decision() {
+  std::cout << "Testing copies keep the engine decision... ";
+  Regex re("(a|aa)*b");
+  assert(!re.match(std::string(40, 'a')));
+  assert(re.usesLinearEngine());
+  Regex copy = re;
+  assert(copy.usesLinearEngine());
+  assert(copy.match("aaab"));
+  Regex moved = std::move(copy);
+  assert(moved.usesLinearEngine());
+  assert(moved.fallbackCount() == 1);
+  std::cout << "PASS" << std::endl;
+}
+
+int main() {
+  std::cout << "=== Amarantine Engine Tests ===" << std::endl << std::endl;
+
+  test_engines_agree();
+  test_adaptive_fallback();
+  test_fallback_on_stack_exhaustion();
+  test_fallback_keeps_budget();
+  test_copy_keeps_decision();
+
+  std::cout << std::endl << "=== All Engine Tests Passed! ===" << std::endl;
+  return 0;
+}
@@ -0,0 +1,176 @@
+#include "amaranth/amaranth.h"
+
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+using namespace amaranth;
+
+// (a+)+$ backtracks exponentially on a run of 'a' that cannot reach the end.
+// These tests pin the backtracking engine, since AUTO would move such a
+// pattern to the linear engine before any limit is reached.
+static const char* kEvilPattern = "(a+)+$";
+
+static std::string evil_input(size_t n) {
+  return std::string(n, 'a') + "!";
+}
+
+void test_within_budget() {
+  std::cout << "Testing match within budget... ";
+  Regex re(R"((\d+)-(\d+))");
+  MatchOptions options;
+  options.maxSteps = 1000;
+  MatchResult result;
+  assert(re.search("id 123-456", result, options) == MatchStatus::MATCHED);
+  assert(result.group(1) == "123");
+  assert(re.search("no digits", result, options) == MatchStatus::NO_MATCH);
+  assert(re.match("x123-456", result, options) == MatchStatus::NO_MATCH);
+  std::cout << "PASS" << std::endl;
+}
+
+void test_step_budget() {
+  std::cout << "Testing step budget... ";
+  Regex re(kEvilPattern);
+  re.setEngine(Engine::BACKTRACKING);
+  MatchOptions options;
+  options.maxSteps = 100000;
+  MatchResult result;
+  assert(re.search(evil_input(40), result, options) == MatchStatus::BUDGET_EXCEEDED);
+  assert(re.match(evil_input(40), result, options) == MatchStatus::BUDGET_EXCEEDED);
+  std::cout << "PASS" << std::endl;
+}
+
+void test_lookahead_budget() {
+  std::cout << "Testing step budget inside lookaheads... ";
+  // The first start position already scans the whole text in the lookahead
+  Regex re(R"(\w(?=\w*!))");
+  std::string text(200000, 'a');
+  MatchOptions options;
+  options.maxSteps = 100000;
+  MatchResult result;
+  for (Engine engine : {Engine::BACKTRACKING, Engine::LINEAR}) {
+    re.setEngine(engine);
+    assert(re.search(text, result, options) == MatchStatus::BUDGET_EXCEEDED);
+    assert(re.search("ab!", result, options) == MatchStatus::MATCHED && result.position == 0);
+  }
+  std::cout << "PASS" << std::endl;
+}
+
+void test_lookaround_linear() {
+  std::cout << "Testing lookarounds that scan the text stay linear... ";
+  // Each test of the lookahead would read to the end of the text, and of the
+  // lookbehind back to its start, but later tests stop at the states an
+  // earlier one found failing
+  std::string text(100000, 'b');
+  MatchOptions options;
+  options.maxSteps = 20 * text.size();
+  MatchResult result;
+  for (const char* pattern :
+       {"(?=.*c)b", R"(\w(?=\w*!))", "(?!.*b$)b", "(?<=c.*)b", R"((?<=c\w*)b)"}) {
+    Regex re(pattern);
+    for (Engine engine : {Engine::BACKTRACKING, Engine::LINEAR}) {
+      re.setEngine(engine);
+      assert(re.search(text, result, options) == MatchStatus::NO_MATCH);
+    }
+  }
+  // The negative lookbehind's body matches back to the 'c' at the start
+  Regex neg("(?<!c.*)b");
+  for (Engine engine : {Engine::BACKTRACKING, Engine::LINEAR}) {
+    neg.setEngine(engine);
+    assert(neg.search("c" + text, result, options) == MatchStatus::NO_MATCH);
+  }
+  // Likewise for states that are known to reach the end of the body
+  Regex re("(?=.*c)b");
+  assert(re.searchAll(text + "c").size() == text.size());
+  Regex behind("(?<=c.*)b");
+  assert(behind.searchAll("c" + text).size() == text.size());
+  std::cout << "PASS" << std::endl;
+}
+
+void test_unbudgeted_lookahead_steps() {
+  std::cout << "Testing unbudgeted lookahead steps are not charged later... ";
+  Regex re("x(?=abc)");
+  std::string text(2000, 'x');
+  MatchOptions options;
+  options.maxSteps = 100;
+  MatchResult result;
+  for (Engine engine : {Engine::BACKTRACKING, Engine::LINEAR}) {
+    re.setEngine(engine);
+    for (int i = 0; i < 50; ++i)
+      assert(!re.search(text, result));
+    assert(re.search("xabc", result, options) == MatchStatus::MATCHED && result.position == 0);
+  }
+  std::cout << "PASS" << std::endl;
+}
+
+void test_deadline() {
+  std::cout << "Testing deadline... ";
+  Regex re(kEvilPattern);
+  re.setEngine(Engine::BACKTRACKING);
+  MatchOptions options;
+  options.deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(20);
+  MatchResult result;
+  auto start = std::chrono::steady_clock::now();
+  assert(re.search(evil_input(64), result, options) == MatchStatus::DEADLINE_EXCEEDED);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  assert(elapsed < std::chrono::seconds(5));
+  (void)elapsed;
+  std::cout << "PASS" << std::endl;
+}
+
+void test_cancellation() {
+  std::cout << "Testing cancellation from another thread... ";
+  Regex re(kEvilPattern);
+  re.setEngine(Engine::BACKTRACKING);
+  CancellationToken token;
+  MatchOptions options;
+  options.cancel = &token;
+  std::thread canceller([&token] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    token.cancel();
+  });
+  MatchResult result;
+  MatchStatus status = re.search(evil_input(64), result, options);
+  canceller.join();
+  assert(status == MatchStatus::CANCELLED);
+
+  // A token that is already raised stops the call before it starts
+  assert(re.search("aaa", result, options) == MatchStatus::CANCELLED);
+  token.reset();
+  assert(re.search("aaa", result, options) == MatchStatus::MATCHED);
+  (void)status;
+  std::cout << "PASS" << std::endl;
+}
+
+void test_backtrack_stack_limit() {
+  std::cout << "Testing backtrack stack limit... ";
+  Regex re(R"(\d+)");
+  re.setEngine(Engine::BACKTRACKING);
+  std::string digits(100, '7');
+  MatchOptions options;
+  options.maxBacktrackDepth = 10;
+  MatchResult result;
+  assert(re.match(digits, result, options) == MatchStatus::STACK_EXHAUSTED);
+  // VM_STACK_SIZE applies to unbudgeted calls as well
+  std::string many_digits(VM_STACK_SIZE + 10, '7');
+  assert(re.match(many_digits, result, MatchOptions()) == MatchStatus::STACK_EXHAUSTED);
+  assert(re.match(digits, result));
+  std::cout << "PASS" << std::endl;
+}
+
+int main() {
+  std::cout << "=== Amarantine Limits Tests ===" << std::endl << std::endl;
+
+  test_within_budget();
+  test_step_budget();
+  test_lookahead_budget();
+  test_lookaround_linear();
+  test_unbudgeted_lookahead_steps();
+  test_deadline();
+  test_cancellation();
+  test_backtrack_stack_limit();
+
+  std::cout << std::endl << "=== All Limits Tests Passed! ===" << std::endl;
+  return 0;
+}
@@ -0,0 +1,189 @@
+#include "amaranth/amaranth.h"
+
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace amaranth;
+
+void test_histogram_buckets() {
+  std::cout << "Testing histogram buckets... ";
+  for (uint64_t v = 0; v < 100000; v = v < 64 ? v + 1 : v + v / 7) {
+    size_t b = LatencyHistogram::bucketOf(v);
+    assert(b < LatencyHistogram::BUCKETS);
+    assert(LatencyHistogram::bucketLimit(b) >= v);
+    // Within one sub-bucket of the value
+    assert(LatencyHistogram::bucketLimit(b) - v <= v / LatencyHistogram::SUB_BUCKETS);
+    if (b > 0)
+      assert(LatencyHistogram::bucketLimit(b - 1) < v);
+  }
+  assert(LatencyHistogram::bucketOf(UINT64_MAX) == LatencyHistogram::BUCKETS - 1);
+  std::cout << "PASS" << std::endl;
+}
+
+void test_histogram_percentiles() {
+  std::cout << "Testing histogram percentiles... ";
+  LatencyHistogram h;
+  assert(h.percentile(0.5) == 0);
+  for (uint64_t v = 1; v <= 1000; ++v)
+    h.record(v * 100);  // 100ns .. 100us
+  assert(h.count == 1000);
+  assert(h.minNanos == 100 && h.maxNanos == 100000);
+  uint64_t p50 = h.percentile(0.5);
+  uint64_t p99 = h.percentile(0.99);
+  assert(p50 >= 50000 && p50 <= 50000 + 50000 / LatencyHistogram::SUB_BUCKETS);
+  assert(p99 >= 99000 && p99 <= 100000);
+  assert(h.percentile(1.0) == 100000);
+  assert(h.mean() == 50050.0);
+
+  LatencyHistogram other;
+  other.record(7);
+  h.merge(other);
+  assert(h.count == 1001 && h.minNanos == 7);
+  assert(h.percentile(0.0001) == 7);
+  (void)p50;
+  (void)p99;
+  std::cout << "PASS" << std::endl;
+}
+
+void test_regex_records_calls() {
+  std::cout << "Testing Regex records calls... ";
+  Regex re(R"(\d+)");
+  assert(!re.metrics());
+  re.match("123");  // Not recorded
+  re.enableMetrics();
+  MatchResult result;
+  re.match("123", result);
+  re.search("abc 42", result);
+  re.search("no digits", result);
+  MatchOptions options;
+  re.search("x 7", result, options);
+  re.searchAll("1 2 3");
+
+  PatternMetricsSnapshot snap = re.metrics()->snapshot();
+  assert(snap.latency.count == 5);
+  assert(snap.matches == 4);
+  assert(snap.bytes == 3 + 6 + 9 + 3 + 5);
+  assert(snap.latency.maxNanos >= snap.latency.minNanos);
+  (void)snap;
+
+  // Copies share the recorder
+  Regex copy = re;
+  copy.match("5");
+  assert(re.metrics()->snapshot().latency.count == 6);
+
+  re.enableMetrics(false);
+  assert(!re.metrics());
+  assert(copy.metrics());
+  std::cout << "PASS" << std::endl;
+}
+
+void test_concurrent_recording() {
+  std::cout << "Testing concurrent recording... ";
+  Regex re("a+b");
+  re.enableMetrics();
+  const int threads = 8;
+  const int calls = 2000;
+  std::vector<std::thread> workers;
+  for (int t = 0; t < threads; ++t) {
+    // One Regex per thread, all recording into the same metrics
+    workers.emplace_back([re, calls]() mutable {
+      MatchResult result;
+      for (int i = 0; i < calls; ++i)
+        re.search("xxaab", result);
+    });
+  }
+  for (auto& w : workers)
+    w.join();
+  PatternMetricsSnapshot snap = re.metrics()->snapshot();
+  assert(snap.latency.count == static_cast<uint64_t>(threads * calls));
+  assert(snap.matches == snap.latency.count);
+  (void)snap;
+  std::cout << "PASS" << std::endl;
+}
+
+void test_export() {
+  std::cout << "Testing Prometheus and JSON export... ";
+  Regex quoted(R"("\w+")");
+  quoted.enableMetrics();
+  MatchResult result;
+  quoted.search("say \"hi\"", result);
+  Regex silent("x");  // No metrics: left out
+  std::vector<const Regex*> all = {&quoted, &silent};
+
+  // Quotes and backslashes in the pattern are escaped in the label
+  std::string label = R"({pattern="\"\\w+\"",flags="0")";
+  std::string prom = exportPrometheus(all);
+  assert(prom.find("# TYPE amaranth_call_duration_seconds summary") != std::string::npos);
+  assert(prom.find("amaranth_call_duration_seconds" + label + ",quantile=\"0.99\"} ") !=
+         std::string::npos);
+  assert(prom.find("amaranth_call_duration_seconds_count" + label + "} 1\n") != std::string::npos);
+  assert(prom.find("amaranth_matches_total" + label + "} 1\n") != std::string::npos);
+  assert(prom.find("pattern=\"x\"") == std::string::npos);
+
+  std::string json = exportJson(all);
+  assert(json.find(R"("pattern": "\"\\w+\"", "flags": 0,)") != std::string::npos);
+  assert(json.find("\"calls\": 1,") != std::string::npos);
+  assert(json.find("\"p999_ns\": ") != std::string::npos);
+  assert(json.find("\"bytes_per_second\": ") != std::string::npos);
+  assert(exportJson({&silent}) == "[]\n");
+  std::cout << "PASS" << std::endl;
+}
+
+void test_export_series_once() {
+  std::cout << "Testing each exported series appears once... ";
+  MatchResult result;
+  Regex plain("err");
+  plain.enableMetrics();
+  plain.search("err", result);
+  Regex copy = plain;  // Shares plain's metrics: not counted again
+  Regex twin("err");   // Same text and flags, separate metrics: summed
+  twin.enableMetrics();
+  twin.search("no", result);
+  Regex folded("err", Regex::CompileFlag::CASE_INSENSITIVE);
+  folded.enableMetrics();
+  folded.search("ERR", result);
+  std::vector<const Regex*> all = {&plain, &copy, &twin, &folded, &plain};
+
+  std::string prom = exportPrometheus(all);
+  auto count = [](const std::string& text, const std::string& needle) {
+    size_t n = 0;
+    for (size_t at = text.find(needle); at != std::string::npos; at = text.find(needle, at + 1))
+      ++n;
+    return n;
+  };
+  std::string count0 = R"(amaranth_call_duration_seconds_count{pattern="err",flags="0"} )";
+  std::string count1 = R"(amaranth_call_duration_seconds_count{pattern="err",flags="1"} )";
+  assert(count(prom, count0) == 1);
+  assert(prom.find(count0 + "2\n") != std::string::npos);
+  assert(count(prom, count1) == 1);
+  assert(prom.find(R"(amaranth_matches_total{pattern="err",flags="0"} 1)") != std::string::npos);
+
+  std::string json = exportJson(all);
+  assert(count(json, "\"pattern\"") == 2);
+  assert(json.find(R"("pattern": "err", "flags": 0, "calls": 2,)") != std::string::npos);
+  assert(json.find(R"("pattern": "err", "flags": 1, "calls": 1,)") != std::string::npos);
+
+  // Bytes outside ASCII are escaped so the document stays valid UTF-8
+  Regex binary("\xff\x80");
+  binary.enableMetrics();
+  assert(exportJson({&binary}).find(R"("pattern": "\u00ff\u0080")") != std::string::npos);
+  (void)count;
+  std::cout << "PASS" << std::endl;
+}
+
+int main() {
+  std::cout << "=== Amarantine Metrics Tests ===" << std::endl << std::endl;
+
+  test_histogram_buckets();
+  test_histogram_percentiles();
+  test_regex_records_calls();
+  test_concurrent_recording();
+  test_export();
+  test_export_series_once();
+
+  std::cout << std::endl << "=== All Metrics Tests Passed! ===" << std::endl;
+  return 0;
+}
@@ -0,0 +1,112 @@
+#include "amaranth/amaranth.h"
+
+#include <cassert>
+#include <iostream>
+#include <string>
+
+using namespace amaranth;
+
+void test_source_map() {
+  std::cout << "Testing compiler source map... ";
+  std::string pattern = "ab(c|d)+e";
+  ASTArena arena;
+  Parser parser(pattern, arena);
+  NodeId root = parser.parse();
+  Compiler compiler;
+  auto program = compiler.compile(arena, root, parser.numCaptures());
+  const auto& map = compiler.sourceMap();
+  assert(map.size() == program.size());
+  assert(map[0] == 0);  // 'a'
+  assert(map[1] == 1);  // 'b'
+  assert(map.back() == Compiler::NO_SOURCE);
+  for (size_t pc = 0; pc < program.size(); ++pc) {
+    if (program[pc].opcode == Opcode::CHAR)
+      assert(pattern[map[pc]] == program[pc].ch);
+    if (program[pc].opcode == Opcode::SAVE)
+      assert(pattern[map[pc]] == '(');
+  }
+  (void)map;
+  std::cout << "PASS" << std::endl;
+}
+
+void test_profile_counts() {
+  std::cout << "Testing per-instruction counts... ";
+  for (Engine engine : {Engine::BACKTRACKING, Engine::LINEAR}) {
+    Regex re("x(a|b)*c");
+    re.setEngine(engine);
+    ProgramProfile profile;
+    MatchOptions options;
+    options.profile = &profile;
+    MatchResult result;
+    assert(re.search("zz xababd xabc", result, options) == MatchStatus::MATCHED);
+    assert(result.matched_text == "xabc");
+    assert(!profile.hits.empty() && profile.hits.size() == profile.fails.size() &&
+           profile.hits.size() == profile.pushes.size());
+    assert(profile.hits[0] == 2);   // The 'x' ran at both candidates
+    assert(profile.fails[0] == 0);  // and the prefilter kept it from failing
+    uint64_t pushes = 0, fails = 0;
+    for (size_t pc = 0; pc < profile.hits.size(); ++pc) {
+      pushes += profile.pushes[pc];
+      fails += profile.fails[pc];
+      assert(profile.fails[pc] <= profile.hits[pc]);
+    }
+    assert(pushes > 0 && fails > 0);
+    (void)pushes;
+    (void)fails;
+  }
+  std::cout << "PASS" << std::endl;
+}
+
+void test_profile_without_stats() {
+  std::cout << "Testing profile alone leaves results unchanged... ";
+  Regex re(R"((\d+)-(\d+))");
+  ProgramProfile profile;
+  MatchOptions options;
+  options.profile = &profile;
+  MatchResult r1, r2;
+  assert(re.search("id 12-34", r1, options) == MatchStatus::MATCHED);
+  assert(re.search("id 12-34", r2));
+  assert(r1.matched_text == r2.matched_text && r1.position == r2.position);
+  uint64_t before = profile.hits[0];
+  assert(re.search("id 12-34", r1, options) == MatchStatus::MATCHED);
+  assert(profile.hits[0] == 2 * before);  // Calls add up
+  profile.reset();
+  assert(profile.hits[0] == 0);
+  (void)before;
+  std::cout << "PASS" << std::endl;
+}
+
+void test_disassemble() {
+  std::cout << "Testing annotated disassembly... ";
+  Regex re(R"(^[a-c]x\d?$)");
+  std::string listing = re.disassemble();
+  assert(listing.find("ANCHOR_START") != std::string::npos);
+  assert(listing.find("CLASS      [a-c]") != std::string::npos);
+  assert(listing.find("CHAR       'x'") != std::string::npos);
+  assert(listing.find("\\d") != std::string::npos);
+  assert(listing.find("SPLIT") != std::string::npos);
+  assert(listing.find("MATCH") != std::string::npos);
+  assert(listing.find("hits") == std::string::npos);
+
+  ProgramProfile profile;
+  MatchOptions options;
+  options.profile = &profile;
+  MatchResult result;
+  assert(re.match("bx7", result, options) == MatchStatus::MATCHED);
+  std::string annotated = re.disassemble(&profile);
+  assert(annotated.find("hits") != std::string::npos);
+  assert(annotated.find("pushes") != std::string::npos);
+  std::cout << "PASS" << std::endl;
+}
+
+int main() {
+  std::cout << "=== Amarantine Profile Tests ===" << std::endl << std::endl;
+
+  test_source_map();
+  test_profile_counts();
+  test_profile_without_stats();
+  test_disassemble();
+
+  std::cout << std::endl << "=== All Profile Tests Passed! ===" << std::endl;
+  return 0;
+}
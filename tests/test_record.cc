@@ -0,0 +1,207 @@
+#include "amaranth/amaranth.h"
+
+#include <cassert>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace amaranth;
+
+static const char* const PATH = "test_record.amwl";
+
+static RecordedWorkload readBack() {
+  RecordedWorkload workload;
+  std::string error;
+  bool ok = readWorkload(PATH, workload, error);
+  assert(ok && error.empty());
+  (void)ok;
+  return workload;
+}
+
+void test_round_trip() {
+  std::cout << "Testing recorded calls read back... ";
+  {
+    auto recorder = std::make_shared<WorkloadRecorder>(PATH);
+    assert(recorder->ok());
+    Regex digits(R"(\d+)");
+    Regex word(R"(\w+)", Regex::CompileFlag::CASE_INSENSITIVE);
+    digits.recordTo(recorder);
+    word.recordTo(recorder);
+    std::string line = "id 42 and 7";
+    MatchResult result;
+    digits.search(line, result);
+    word.match(line, result, 3, 5);
+    assert(digits.searchAll(line).size() == 2);
+    digits.search(std::string(300, 'x') + "1", result);
+    assert(recorder->recordedCalls() == 4);
+  }
+  RecordedWorkload w = readBack();
+  assert(w.patterns.size() == 2);
+  assert(w.patterns[0].pattern == R"(\d+)" && w.patterns[0].flags == 0);
+  assert(w.patterns[1].pattern == R"(\w+)" &&
+         w.patterns[1].flags == static_cast<uint32_t>(Regex::CompileFlag::CASE_INSENSITIVE));
+  assert(w.calls.size() == 4);
+  // The first three calls share one line, stored once
+  assert(w.texts.size() == 2 && w.texts[0] == "id 42 and 7" && w.texts[1].size() == 301);
+  assert(w.calls[0].api == RecordedApi::SEARCH && w.calls[0].pattern == 0);
+  assert(w.calls[0].start == 0 && w.calls[0].end == std::string::npos);
+  assert(w.calls[1].api == RecordedApi::MATCH && w.calls[1].pattern == 1);
+  assert(w.calls[1].start == 3 && w.calls[1].end == 5 && w.calls[1].text == 0);
+  assert(w.calls[2].api == RecordedApi::SEARCH_ALL && w.calls[2].text == 0);
+  assert(w.calls[3].text == 1);
+  std::cout << "PASS" << std::endl;
+}
+
+void test_empty_first_text() {
+  std::cout << "Testing a recording that starts with empty text... ";
+  {
+    auto recorder = std::make_shared<WorkloadRecorder>(PATH);
+    Regex re("a*");
+    re.recordTo(recorder);
+    MatchResult result;
+    re.match("", result);
+    re.match("", result);
+    re.search("baa", result);
+    assert(recorder->recordedCalls() == 3);
+  }
+  RecordedWorkload w = readBack();
+  assert(w.calls.size() == 3);
+  assert(w.texts.size() == 2 && w.texts[0].empty() && w.texts[1] == "baa");
+  assert(w.calls[0].text == 0 && w.calls[1].text == 0 && w.calls[2].text == 1);
+  std::cout << "PASS" << std::endl;
+}
+
+void test_sampling_and_limits() {
+  std::cout << "Testing sampling and the size limit... ";
+  {
+    auto recorder = std::make_shared<WorkloadRecorder>(PATH, 3);
+    Regex re("a");
+    re.recordTo(recorder);
+    for (int i = 0; i < 9; ++i)
+      re.match("abc");
+    assert(recorder->recordedCalls() == 3);
+  }
+  assert(readBack().calls.size() == 3);
+  {
+    auto recorder = std::make_shared<WorkloadRecorder>(PATH, 1, 64);
+    Regex re("a");
+    re.recordTo(recorder);
+    for (int i = 0; i < 10; ++i)
+      re.match(std::string(20, 'a') + std::to_string(i));
+    assert(recorder->recordedCalls() < 10);
+  }
+  std::cout << "PASS" << std::endl;
+}
+
+void test_threads_and_many_patterns() {
+  std::cout << "Testing per-thread sampling and many patterns... ";
+  {
+    auto recorder = std::make_shared<WorkloadRecorder>(PATH, 3);
+    // Every thread samples its own first call and each third one after it
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([&recorder] {
+        Regex re("a");
+        re.recordTo(recorder);
+        for (int i = 0; i < 9; ++i)
+          re.match("abc");
+      });
+    }
+    for (auto& thread : threads)
+      thread.join();
+    assert(recorder->recordedCalls() == 12);
+  }
+  {
+    auto recorder = std::make_shared<WorkloadRecorder>(PATH);
+    for (int i = 0; i < 3000; ++i) {
+      Regex re("rule" + std::to_string(i));
+      re.recordTo(recorder);
+      re.match("rule1");
+    }
+    // The same text under other flags is another pattern
+    Regex folded("rule1", Regex::CompileFlag::CASE_INSENSITIVE);
+    folded.recordTo(recorder);
+    folded.match("RULE1");
+    Regex again("rule1");
+    again.recordTo(recorder);
+    again.match("rule1");
+  }
+  RecordedWorkload w = readBack();
+  assert(w.patterns.size() == 3001 && w.patterns[3000].pattern == "rule1");
+  assert(w.calls.size() == 3002 && w.calls[3001].pattern == 1);
+  std::cout << "PASS" << std::endl;
+}
+
+void test_copies_and_default() {
+  std::cout << "Testing copies and recordAllTo()... ";
+  {
+    auto recorder = std::make_shared<WorkloadRecorder>(PATH);
+    Regex re("b+");
+    re.recordTo(recorder);
+    Regex copy = re;
+    copy.match("bb");
+    re.recordTo(nullptr);
+    re.match("bb");
+    assert(recorder->recordedCalls() == 1);
+
+    Regex::recordAllTo(recorder);
+    Regex fresh("c");
+    Regex::recordAllTo(nullptr);
+    Regex untracked("d");
+    fresh.match("c");
+    untracked.match("d");
+    assert(fresh.recorder() == recorder && !untracked.recorder());
+    assert(recorder->recordedCalls() == 2);
+  }
+  RecordedWorkload w = readBack();
+  assert(w.patterns.size() == 2 && w.patterns[1].pattern == "c");
+  std::cout << "PASS" << std::endl;
+}
+
+void test_damaged_files() {
+  std::cout << "Testing truncated and foreign files... ";
+  {
+    auto recorder = std::make_shared<WorkloadRecorder>(PATH);
+    Regex re("x");
+    re.recordTo(recorder);
+    MatchResult result;
+    re.search("one x", result);
+    re.search("two x", result);
+  }
+  // Cut into the second call's text
+  std::FILE* f = std::fopen(PATH, "rb");
+  std::string data(1024, '\0');
+  data.resize(std::fread(&data[0], 1, data.size(), f));
+  std::fclose(f);
+  f = std::fopen(PATH, "wb");
+  std::fwrite(data.data(), 1, data.size() - 2, f);
+  std::fclose(f);
+  assert(readBack().calls.size() == 1);
+
+  f = std::fopen(PATH, "wb");
+  std::fputs("not a workload", f);
+  std::fclose(f);
+  RecordedWorkload w;
+  std::string error;
+  assert(!readWorkload(PATH, w, error) && !error.empty());
+  assert(!readWorkload("no/such/file.amwl", w, error));
+  std::remove(PATH);
+  std::cout << "PASS" << std::endl;
+}
+
+int main() {
+  std::cout << "=== Amarantine Recording Tests ===" << std::endl << std::endl;
+
+  test_round_trip();
+  test_empty_first_text();
+  test_sampling_and_limits();
+  test_threads_and_many_patterns();
+  test_copies_and_default();
+  test_damaged_files();
+
+  std::cout << std::endl << "=== All Recording Tests Passed! ===" << std::endl;
+  return 0;
+}
@@ -98,6 +98,34 @@ void test_anchors() {
   std::cout << "PASS" << std::endl;
 }
 
+void test_search_window() {
+  std::cout << "Testing search window... ";
+  Regex re(R"(\d+)");
+  std::string text = "id=12345;next=678";
+  MatchResult result;
+  // Consumption stops at the window end, offsets stay relative to the text
+  assert(re.search(text, result, 3, 6));
+  assert(result.matched_text == "123");
+  assert(result.position == 3);
+  assert(re.search(text, result, 8));
+  assert(result.matched_text == "678");
+  assert(!re.search(text, result, 8, 14));
+
+  // Anchors see context outside the window
+  Regex start_re(R"(^\d)");
+  assert(!start_re.match(text, result, 3, 8));
+  Regex end_re(R"(\d$)");
+  assert(!end_re.search(text, result, 0, 8));
+  assert(end_re.search(text, result, 0));
+  assert(result.position == 16);
+
+  auto all = re.searchAll(text, 5, 16);
+  assert(all.size() == 2);
+  assert(all[0].matched_text == "345");
+  assert(all[1].matched_text == "67");
+  std::cout << "PASS" << std::endl;
+}
+
 void test_replace() {
   std::cout << "Testing replace... ";
   Regex re(R"(\d+)");
@@ -106,6 +134,150 @@ void test_replace() {
   std::cout << "PASS" << std::endl;
 }
 
+void test_case_insensitive() {
+  std::cout << "Testing case-insensitive matching... ";
+  MatchResult result;
+  Regex flag("error: [a-c]+", Regex::CompileFlag::CASE_INSENSITIVE);
+  assert(flag.search("log ERROR: AbC", result) && result.matched_text == "ERROR: AbC");
+  assert(!Regex("error").search("ERROR", result));
+
+  // Long enough for the vectorized prefilter to scan whole blocks
+  std::string text = std::string(40, '.') + "Warn" + std::string(20, '.') + "WARN";
+  auto all = Regex("warn", Regex::CompileFlag::CASE_INSENSITIVE).searchAll(text);
+  assert(all.size() == 2 && all[0].position == 40 && all[1].matched_text == "WARN");
+
+  // Inline modifiers: to the end of the group, scoped, and switched off
+  assert(Regex("(?i)get /API").match("GET /api"));
+  assert(Regex("a(?i:b)c").match("aBc"));
+  assert(!Regex("a(?i:b)c").match("aBC"));
+  assert(Regex("(x(?i)y)Y").match("xYY"));
+  assert(!Regex("(x(?i)y)y").match("xYY"));
+  assert(!Regex("(?i)a(?-i)b").match("AB"));
+  assert(Regex("[^x]", Regex::CompileFlag::CASE_INSENSITIVE).match("y"));
+  assert(!Regex("[^x]", Regex::CompileFlag::CASE_INSENSITIVE).match("X"));
+  std::cout << "PASS" << std::endl;
+}
+
+void test_line_modes() {
+  std::cout << "Testing multiline and dot-all modes... ";
+  MatchResult result;
+  std::string lines = "first\nsecond line\nthird";
+  assert(!Regex("^second").search(lines, result));
+  assert(Regex("(?m)^second").search(lines, result) && result.position == 6);
+  Regex word(R"(^\w+$)", Regex::CompileFlag::MULTILINE);
+  auto all = word.searchAll(lines);
+  assert(all.size() == 2 && all[0].matched_text == "first" && all[1].matched_text == "third");
+  auto starts = Regex(R"((?m)^\w)").searchAll("a\nb\n\nc");
+  assert(starts.size() == 3 && starts[2].position == 5);
+  assert(Regex("(?m)a$").search("ba\nb", result) && result.position == 1);
+  assert(!Regex("a$").search("ba\nb", result));
+
+  // '.' stops at line breaks unless DOTALL is set
+  assert(!Regex("a.b").match("a\nb"));
+  assert(Regex("a.b", Regex::CompileFlag::DOTALL).match("a\nb"));
+  assert(Regex("(?s)<.*>").search("<a\nb>", result) && result.matched_text == "<a\nb>");
+  assert(Regex("<.*>").searchAll("<a>\n<b>").size() == 2);
+  assert(Regex("a[^x]b").match("a\nb"));
+  std::cout << "PASS" << std::endl;
+}
+
+void test_word_boundary() {
+  std::cout << "Testing word boundaries... ";
+  MatchResult result;
+  std::string text = "errors terror error_count error. (error)";
+  Regex keyword(R"(\berror\b)");
+  auto all = keyword.searchAll(text);
+  assert(all.size() == 2 && all[0].position == 26 && all[1].position == 34);
+  assert(Regex(R"(\bab)").match("ab"));
+  assert(!Regex(R"(a\bb)").search("ab", result));
+  assert(Regex(R"(\Boo)").search("foo", result) && result.position == 1);
+  assert(!Regex(R"(\Bfoo)").search("foo", result));
+  assert(Regex(R"(x\B)").search("x-xy", result) && result.position == 2);
+
+  // Both engines; the search plan drops candidates that fail a leading \b
+  for (Engine engine : {Engine::BACKTRACKING, Engine::LINEAR}) {
+    Regex word(R"(\b\w+\b)");
+    word.setEngine(engine);
+    auto words = word.searchAll("a-bc  d_e!");
+    assert(words.size() == 3 && words[1].matched_text == "bc" && words[2].matched_text == "d_e");
+    Regex inner(R"(\B[a-z]\B)");
+    inner.setEngine(engine);
+    assert(inner.search("abc", result) && result.matched_text == "b");
+  }
+  std::cout << "PASS" << std::endl;
+}
+
+void test_lookahead() {
+  std::cout << "Testing lookahead... ";
+  MatchResult result;
+  for (Engine engine : {Engine::BACKTRACKING, Engine::LINEAR}) {
+    Regex price(R"(\d+(?=\$))");
+    price.setEngine(engine);
+    assert(price.search("7 items, 25$", result) && result.matched_text == "25");
+    Regex notTest(R"(\b(?!test_)\w+\.cc\b)");
+    notTest.setEngine(engine);
+    auto files = notTest.searchAll("test_a.cc main.cc test_b.cc util.cc");
+    assert(files.size() == 2 && files[0].matched_text == "main.cc" &&
+           files[1].matched_text == "util.cc");
+    // Several conditions on one position, nested
+    Regex password(R"(^(?=.*\d)(?=.*[a-z])(?!.*(?= )).{6,}$)");
+    password.setEngine(engine);
+    assert(password.match("abc123"));
+    assert(!password.match("abcdef"));
+    assert(!password.match("abc 123"));
+  }
+
+  // Groups inside are numbered but do not capture
+  assert(Regex("(?=(a))a(b)").match("ab", result));
+  assert(result.captures.size() == 2 && result.captures[0].start == std::string::npos);
+  assert(result.group(2) == "b");
+
+  // A repeated lookahead is the lookahead; an optional one always holds
+  assert(Regex("a(?:(?=b)){3}").search("ac ab", result) && result.position == 3);
+  assert(Regex("a(?=b)?").match("ac"));
+  std::cout << "PASS" << std::endl;
+}
+
+void test_lookbehind() {
+  std::cout << "Testing lookbehind... ";
+  MatchResult result;
+  for (Engine engine : {Engine::BACKTRACKING, Engine::LINEAR}) {
+    Regex user(R"((?<=user=)\w+)");
+    user.setEngine(engine);
+    assert(user.search("id=7 user=bob", result) && result.matched_text == "bob");
+    assert(!user.search("user bob", result));
+    Regex quote("(?<!\\\\)\"");
+    quote.setEngine(engine);
+    auto quotes = quote.searchAll(R"("a\"b")");
+    assert(quotes.size() == 2 && quotes[0].position == 0 && quotes[1].position == 5);
+    // Bodies of any length, also alternatives of different lengths
+    Regex unit(R"((?<=\d+)px|(?<=em|rem)\b)");
+    unit.setEngine(engine);
+    assert(unit.search("a px 12px", result) && result.position == 7);
+    Regex suffix(R"(\w(?<=a|bc)x)");
+    suffix.setEngine(engine);
+    auto found = suffix.searchAll("ax dx bcx");
+    assert(found.size() == 2 && found[1].matched_text == "cx");
+    // Assertions inside see the whole text, not where the lookbehind starts
+    Regex start(R"((?<=^)a|(?<=\bq)z)");
+    start.setEngine(engine);
+    assert(start.searchAll("aa qz xqz").size() == 2);
+    // Nested in and around lookaheads
+    Regex nested(R"((?<=a(?=b))b(?=c(?<=bc)))");
+    nested.setEngine(engine);
+    assert(nested.search("ab abc", result) && result.position == 4);
+  }
+
+  // A fixed-width body is checked byte by byte, others are simulated
+  assert(Regex("(?<=ab)c").disassemble().find("2 bytes") != std::string::npos);
+  assert(Regex("(?<=a(b))c").disassemble().find("bytes") == std::string::npos);
+  assert(Regex("(?<=a(b))c").search("bc abc", result) && result.position == 5);
+
+  // Groups inside are numbered but do not capture
+  assert(result.captures.size() == 1 && result.captures[0].start == std::string::npos);
+  std::cout << "PASS" << std::endl;
+}
+
 int main() {
   std::cout << "=== Amarantine Simple Tests ===" << std::endl << std::endl;
 
@@ -118,7 +290,13 @@ int main() {
   test_search_all();
   test_capture_group();
   test_anchors();
+  test_search_window();
   test_replace();
+  test_case_insensitive();
+  test_line_modes();
+  test_word_boundary();
+  test_lookahead();
+  test_lookbehind();
 
   std::cout << std::endl << "=== All Tests Passed! ===" << std::endl;
   return 0;
@@ -0,0 +1,150 @@
+#include "amaranth/amaranth.h"
+
+#include <cassert>
+#include <iostream>
+#include <string>
+
+using namespace amaranth;
+
+void test_search_counters() {
+  std::cout << "Testing search counters... ";
+  for (Engine engine : {Engine::BACKTRACKING, Engine::LINEAR}) {
+    Regex re(R"(x\d+)");
+    re.setEngine(engine);
+    std::string text = "aaaa x1 bbbb x22 cccc";
+    MatchStats stats;
+    MatchOptions options;
+    options.stats = &stats;
+    MatchResult result;
+    assert(re.search(text, result, options) == MatchStatus::MATCHED);
+    assert(result.matched_text == "x1");
+    assert(stats.instructions > 0);
+    assert(stats.startPositions >= 1);
+    assert(stats.prefilterCandidates == 1);  // Only the 'x' at offset 5 is tried
+    assert(stats.bytesScanned >= 6 && stats.bytesScanned <= text.size());
+    assert(stats.fallbacks == 0);
+  }
+  std::cout << "PASS" << std::endl;
+}
+
+void test_lookahead_counted() {
+  std::cout << "Testing lookahead steps are counted... ";
+  // The lookahead reads all 1000 bytes before the match can fail
+  for (Engine engine : {Engine::BACKTRACKING, Engine::LINEAR}) {
+    Regex re("x(?=a*!)");
+    re.setEngine(engine);
+    MatchStats stats;
+    MatchOptions options;
+    options.stats = &stats;
+    MatchResult result;
+    assert(re.search("x" + std::string(1000, 'a'), result, options) == MatchStatus::NO_MATCH);
+    assert(stats.instructions > 1000);
+  }
+  std::cout << "PASS" << std::endl;
+}
+
+void test_failed_search_scans_everything() {
+  std::cout << "Testing failed search scans the whole window... ";
+  for (Engine engine : {Engine::BACKTRACKING, Engine::LINEAR}) {
+    Regex re("zz");
+    re.setEngine(engine);
+    std::string text(1000, 'a');
+    text[500] = 'z';
+    MatchStats stats;
+    MatchOptions options;
+    options.stats = &stats;
+    MatchResult result;
+    assert(re.search(text, result, options) == MatchStatus::NO_MATCH);
+    assert(stats.bytesScanned == text.size());
+    assert(stats.prefilterCandidates == 1);
+  }
+  std::cout << "PASS" << std::endl;
+}
+
+void test_backtrack_counters() {
+  std::cout << "Testing backtrack counters... ";
+  Regex re("(a|b)*c");
+  re.setEngine(Engine::BACKTRACKING);
+  MatchStats stats;
+  MatchOptions options;
+  options.stats = &stats;
+  MatchResult result;
+  assert(re.match("ababab", result, options) == MatchStatus::NO_MATCH);
+  assert(stats.backtrackPushes >= 6);
+  assert(stats.maxBacktrackDepth >= 6);
+  assert(stats.maxBacktrackDepth <= stats.backtrackPushes);
+  std::cout << "PASS" << std::endl;
+}
+
+void test_fallback_counted() {
+  std::cout << "Testing fallbacks are counted... ";
+  Regex re("(a+)+b");
+  MatchStats stats;
+  MatchOptions options;
+  options.stats = &stats;
+  MatchResult result;
+  std::string text(40, 'a');
+  assert(re.search(text, result, options) == MatchStatus::NO_MATCH);
+  assert(stats.fallbacks == 1);
+  assert(re.usesLinearEngine());
+  std::cout << "PASS" << std::endl;
+}
+
+void test_accumulate_and_reset() {
+  std::cout << "Testing counters accumulate across calls... ";
+  Regex re("abc");
+  MatchStats stats;
+  MatchOptions options;
+  options.stats = &stats;
+  MatchResult result;
+  assert(re.search("xxabc", result, options) == MatchStatus::MATCHED);
+  uint64_t once = stats.instructions;
+  assert(re.search("xxabc", result, options) == MatchStatus::MATCHED);
+  assert(stats.instructions == 2 * once);
+  stats.reset();
+  assert(stats.instructions == 0 && stats.bytesScanned == 0 && stats.startPositions == 0);
+  (void)once;
+  std::cout << "PASS" << std::endl;
+}
+
+void test_stats_do_not_change_results() {
+  std::cout << "Testing results are the same with and without stats... ";
+  const char* patterns[] = {R"((\d+)-(\d+))", "a*", "^ab", "b$", "(?:x|y)+z", R"(\s+)"};
+  std::string text = "ab 12-34 xyz b";
+  for (const char* pattern : patterns) {
+    for (Engine engine : {Engine::BACKTRACKING, Engine::LINEAR}) {
+      Regex re(pattern);
+      re.setEngine(engine);
+      MatchStats stats;
+      MatchOptions counted;
+      counted.stats = &stats;
+      for (size_t start = 0; start <= text.size(); ++start) {
+        MatchResult r1, r2;
+        MatchStatus s1 = re.search(text, r1, MatchOptions(), start);
+        MatchStatus s2 = re.search(text, r2, counted, start);
+        assert(s1 == s2 && r1.position == r2.position && r1.matched_text == r2.matched_text);
+        s1 = re.match(text, r1, MatchOptions(), start);
+        s2 = re.match(text, r2, counted, start);
+        assert(s1 == s2 && r1.matched_text == r2.matched_text);
+        (void)s1;
+        (void)s2;
+      }
+    }
+  }
+  std::cout << "PASS" << std::endl;
+}
+
+int main() {
+  std::cout << "=== Amarantine Stats Tests ===" << std::endl << std::endl;
+
+  test_search_counters();
+  test_lookahead_counted();
+  test_failed_search_scans_everything();
+  test_backtrack_counters();
+  test_fallback_counted();
+  test_accumulate_and_reset();
+  test_stats_do_not_change_results();
+
+  std::cout << std::endl << "=== All Stats Tests Passed! ===" << std::endl;
+  return 0;
+}
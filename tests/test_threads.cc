@@ -0,0 +1,125 @@
+#include "amaranth/amaranth.h"
+
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace amaranth;
+
+// Texts with a known first match of R"((\w+)@(\w+)\.com)"
+static std::vector<std::pair<std::string, std::string>> samples() {
+  std::vector<std::pair<std::string, std::string>> out;
+  for (int i = 0; i < 50; ++i) {
+    std::string user = "user" + std::to_string(i);
+    out.push_back({"mail " + user + "@host.com now", user + "@host.com"});
+    out.push_back({"nothing here " + std::to_string(i), ""});
+  }
+  return out;
+}
+
+// Run `body(thread)` on `threads` threads that are all alive at once
+template <typename Body>
+void runTogether(int threads, Body body) {
+  std::atomic<int> ready{0};
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; ++t) {
+    pool.emplace_back([&, t] {
+      ready.fetch_add(1);
+      while (ready.load() < threads)
+        std::this_thread::yield();
+      body(t);
+    });
+  }
+  for (auto& th : pool)
+    th.join();
+}
+
+void test_shared_regex() {
+  std::cout << "Testing one Regex shared by many threads... ";
+  auto cases = samples();
+  for (Engine engine : {Engine::BACKTRACKING, Engine::LINEAR}) {
+    Regex re(R"((\w+)@(\w+)\.com)");
+    re.setEngine(engine);
+    std::atomic<int> wrong{0};
+    runTogether(8, [&](int) {
+      for (int round = 0; round < 200; ++round) {
+        for (const auto& c : cases) {
+          MatchResult result;
+          bool found = re.search(c.first, result);
+          if (found != !c.second.empty() || (found && result.matched_text != c.second))
+            wrong.fetch_add(1);
+        }
+      }
+    });
+    assert(wrong.load() == 0);
+  }
+  std::cout << "PASS" << std::endl;
+}
+
+void test_more_threads_than_slots() {
+  std::cout << "Testing more threads than thread slots... ";
+  Regex re(R"((\d+)-(\d+))");
+  std::atomic<int> wrong{0};
+  runTogether(static_cast<int>(THREAD_SLOTS) + 16, [&](int t) {
+    std::string text = "id " + std::to_string(t) + "-" + std::to_string(t * 7) + " end";
+    for (int round = 0; round < 100; ++round) {
+      MatchResult result;
+      if (!re.search(text, result) || result.group(1) != std::to_string(t) ||
+          result.group(2) != std::to_string(t * 7))
+        wrong.fetch_add(1);
+      if (re.searchAll(text).size() != 1)
+        wrong.fetch_add(1);
+    }
+  });
+  assert(wrong.load() == 0);
+  std::cout << "PASS" << std::endl;
+}
+
+void test_concurrent_fallback() {
+  std::cout << "Testing AUTO falls back once under concurrency... ";
+  Regex re("(a+)+b");
+  std::string text(40, 'a');
+  std::atomic<int> wrong{0};
+  runTogether(8, [&](int) {
+    for (int round = 0; round < 20; ++round) {
+      MatchResult result;
+      if (re.search(text, result))
+        wrong.fetch_add(1);
+    }
+  });
+  assert(wrong.load() == 0);
+  assert(re.usesLinearEngine());
+  // Threads that thrashed before any of them switched the pattern each count
+  assert(re.fallbackCount() >= 1 && re.fallbackCount() <= 8);
+  std::cout << "PASS" << std::endl;
+}
+
+void test_copies_keep_working() {
+  std::cout << "Testing copies and moves of a used Regex... ";
+  Regex re(R"(\d+)");
+  runTogether(4, [&](int) {
+    MatchResult result;
+    re.search("abc 123", result);
+  });
+  Regex copy = re;
+  Regex moved = std::move(copy);
+  MatchResult result;
+  assert(moved.search("x 42 y", result) && result.matched_text == "42");
+  assert(re.search("x 7 y", result) && result.matched_text == "7");
+  std::cout << "PASS" << std::endl;
+}
+
+int main() {
+  std::cout << "=== Amarantine Thread Tests ===" << std::endl << std::endl;
+
+  test_shared_regex();
+  test_more_threads_than_slots();
+  test_concurrent_fallback();
+  test_copies_keep_working();
+
+  std::cout << std::endl << "=== All Thread Tests Passed! ===" << std::endl;
+  return 0;
+}
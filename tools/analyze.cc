@@ -0,0 +1,138 @@
+// analyze.cc - Report the worst-case backtracking cost of patterns
+//
+// Usage: amaranth_analyze [-i] [-m] [-s] [pattern...]
+// Patterns come from the arguments, or one per line on stdin when there are
+// none. -i, -m and -s analyze them as compiled with CASE_INSENSITIVE,
+// MULTILINE and DOTALL. Exits 0 when every pattern is linear, 1 when at least one can
+// backtrack polynomially or exponentially, and 2 when one does not parse, so
+// it can gate rule files in CI.
+#include "amaranth/amaranth.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace amaranth;
+
+static const char* complexity_name(Complexity c) {
+  switch (c) {
+    case Complexity::LINEAR:
+      return "linear";
+    case Complexity::POLYNOMIAL:
+      return "polynomial";
+    case Complexity::EXPONENTIAL:
+      return "exponential";
+  }
+  return "?";
+}
+
+static const char* engine_name(Engine e) {
+  switch (e) {
+    case Engine::AUTO:
+      return "auto";
+    case Engine::BACKTRACKING:
+      return "backtracking";
+    case Engine::LINEAR:
+      return "linear";
+  }
+  return "?";
+}
+
+static const char* kind_name(AnalysisFinding::Kind k) {
+  switch (k) {
+    case AnalysisFinding::Kind::NESTED_QUANTIFIER:
+      return "nested quantifier";
+    case AnalysisFinding::Kind::AMBIGUOUS_ALTERNATION:
+      return "ambiguous alternation";
+    case AnalysisFinding::Kind::EMPTY_LOOP:
+      return "empty loop";
+    case AnalysisFinding::Kind::OVERLAPPING_QUANTIFIERS:
+      return "overlapping quantifiers";
+    case AnalysisFinding::Kind::OPTIONAL_RUN:
+      return "optional run";
+    case AnalysisFinding::Kind::LOOKAROUND_SCAN:
+      return "lookaround scan";
+  }
+  return "?";
+}
+
+// C-style quoting so control bytes in attack strings stay visible
+static std::string quote(const std::string& s) {
+  static const char hex[] = "0123456789abcdef";
+  std::string out = "\"";
+  for (char c : s) {
+    uint8_t uc = static_cast<uint8_t>(c);
+    if (c == '"' || c == '\\') {
+      out += '\\';
+      out += c;
+    } else if (uc < 0x20 || uc >= 0x7f) {
+      out += "\\x";
+      out += hex[uc >> 4];
+      out += hex[uc & 15];
+    } else {
+      out += c;
+    }
+  }
+  return out + "\"";
+}
+
+static int report(const std::string& pattern, Regex::CompileFlag flags) {
+  std::cout << "pattern:     " << pattern << "\n";
+  PatternAnalysis a;
+  try {
+    a = analyze(pattern, flags);
+  } catch (const RegexError& e) {
+    std::cout << "error:       " << e.what() << "\n\n";
+    return 2;
+  }
+
+  std::cout << "complexity:  " << complexity_name(a.complexity);
+  if (a.complexity == Complexity::POLYNOMIAL)
+    std::cout << " (n^" << a.degree << ")";
+  std::cout << "\n";
+  std::cout << "engine:      " << engine_name(a.recommendedEngine) << "\n";
+  std::cout << "program:     " << a.programSize << " instructions, " << a.choicePoints
+            << " choice points, loop depth " << a.loopDepth << "\n";
+  for (const auto& f : a.findings) {
+    std::cout << "finding:     " << kind_name(f.kind) << " at offset " << f.position << ": "
+              << f.detail << "\n";
+    std::cout << "               " << pattern << "\n";
+    std::cout << "               " << std::string(f.position, ' ') << "^\n";
+  }
+  if (!a.attack.empty()) {
+    std::cout << "attack:      " << quote(a.attack.prefix) << " + " << quote(a.attack.pump)
+              << " x " << a.attack.repeat << " + " << quote(a.attack.suffix) << "\n";
+  }
+  std::cout << "\n";
+  return a.complexity == Complexity::LINEAR ? 0 : 1;
+}
+
+int main(int argc, char* argv[]) {
+  Regex::CompileFlag flags = Regex::CompileFlag::DEFAULT;
+  std::vector<std::string> patterns;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "-i") {
+      flags = flags | Regex::CompileFlag::CASE_INSENSITIVE;
+    } else if (arg == "-m") {
+      flags = flags | Regex::CompileFlag::MULTILINE;
+    } else if (arg == "-s") {
+      flags = flags | Regex::CompileFlag::DOTALL;
+    } else {
+      patterns.push_back(arg);
+    }
+  }
+  if (patterns.empty()) {
+    std::string line;
+    while (std::getline(std::cin, line)) {
+      if (!line.empty())
+        patterns.push_back(line);
+    }
+  }
+
+  int status = 0;
+  for (const auto& p : patterns) {
+    status = std::max(status, report(p, flags));
+  }
+  return status;
+}
@@ -0,0 +1,97 @@
+// profile.cc - Show where a pattern spends its time on a sample of input
+//
+// Usage: amaranth_profile [--engine auto|backtracking|linear] pattern [file...]
+// Searches every line of the files (or stdin) for all matches of `pattern`
+// and prints the annotated program listing with per-instruction hit, fail
+// and push counts, followed by the call totals from MatchStats.
+#include "amaranth/amaranth.h"
+
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace amaranth;
+
+static void usage() {
+  std::cerr << "usage: amaranth_profile [--engine auto|backtracking|linear] pattern [file...]\n";
+}
+
+static uint64_t scan(Regex& re, std::istream& in, const MatchOptions& options) {
+  uint64_t matches = 0;
+  std::string line;
+  while (std::getline(in, line)) {
+    size_t pos = 0;
+    while (pos <= line.size()) {
+      MatchResult result;
+      if (re.search(line, result, options, pos) != MatchStatus::MATCHED)
+        break;
+      ++matches;
+      pos = result.position + (result.length() > 0 ? result.length() : 1);
+    }
+  }
+  return matches;
+}
+
+int main(int argc, char* argv[]) {
+  Engine engine = Engine::AUTO;
+  int arg = 1;
+  if (arg + 1 < argc && std::strcmp(argv[arg], "--engine") == 0) {
+    std::string name = argv[arg + 1];
+    if (name == "backtracking") {
+      engine = Engine::BACKTRACKING;
+    } else if (name == "linear") {
+      engine = Engine::LINEAR;
+    } else if (name != "auto") {
+      usage();
+      return 2;
+    }
+    arg += 2;
+  }
+  if (arg >= argc) {
+    usage();
+    return 2;
+  }
+
+  std::string pattern = argv[arg++];
+  std::unique_ptr<Regex> re;
+  try {
+    re = std::make_unique<Regex>(pattern);
+  } catch (const RegexError& e) {
+    std::cerr << "error: " << e.what() << " at offset " << e.position << "\n";
+    return 2;
+  }
+  re->setEngine(engine);
+
+  MatchStats stats;
+  ProgramProfile profile;
+  MatchOptions options;
+  options.stats = &stats;
+  options.profile = &profile;
+
+  uint64_t matches = 0;
+  if (arg == argc) {
+    matches = scan(*re, std::cin, options);
+  }
+  for (; arg < argc; ++arg) {
+    std::ifstream in(argv[arg]);
+    if (!in) {
+      std::cerr << "error: cannot open " << argv[arg] << "\n";
+      return 2;
+    }
+    matches += scan(*re, in, options);
+  }
+
+  std::cout << "pattern: " << pattern << "\n\n" << re->disassemble(&profile) << "\n";
+  std::cout << "matches:              " << matches << "\n";
+  std::cout << "instructions:         " << stats.instructions << "\n";
+  std::cout << "backtrack pushes:     " << stats.backtrackPushes << "\n";
+  std::cout << "max backtrack depth:  " << stats.maxBacktrackDepth << "\n";
+  std::cout << "start positions:      " << stats.startPositions << "\n";
+  std::cout << "prefilter candidates: " << stats.prefilterCandidates << "\n";
+  std::cout << "bytes scanned:        " << stats.bytesScanned << "\n";
+  std::cout << "fallbacks:            " << stats.fallbacks << "\n";
+  return 0;
+}